@@ -34,6 +34,7 @@ SOFTWARE.
 #define INCLUDED_MULTIFINDER_H
 
 #include <stdlib.h>
+#include <stdio.h>
 
 /*! \cond PRIVATE */
 #if !defined(DLL_EXPORT_MULTIFINDER)
@@ -56,7 +57,7 @@ SOFTWARE.
 /*! \brief major version number */
 #define MULTIFINDER_VERSION_MAJOR 0
 /*! \brief minor version number */
-#define MULTIFINDER_VERSION_MINOR 2
+#define MULTIFINDER_VERSION_MINOR 3
 /*! \brief micro version number */
 #define MULTIFINDER_VERSION_MICRO 0
 /*! @} */
@@ -134,6 +135,38 @@ typedef void (*multifinder_flush_callback_fn)(const char* data, size_t datalen,
  */
 DLL_EXPORT_MULTIFINDER multifinder multifinder_create (multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata);
 
+/*! \brief possible values for the mode parameter of multifinder_create_with_mode() and multifinder_create_with_patternset_and_mode()
+ *
+ * All modes find their matches in a single pass over the data.
+ * \sa     multifinder_create_with_mode
+ * \sa     multifinder_create_with_patternset_and_mode
+ * \name   MULTIFIND_MODE_*
+ * \{
+ */
+/*! \brief non-overlapping matches, the leftmost match wins and at the same position the pattern added first (default) \hideinitializer */
+#define MULTIFIND_MODE_LEFTMOST_FIRST           0x00
+/*! \brief non-overlapping matches, the leftmost match wins and at the same position the longest pattern (or the one added first if equally long) \hideinitializer */
+#define MULTIFIND_MODE_LEFTMOST_LONGEST         0x01
+/*! \brief all matches of all patterns, including overlapping ones, reported in order of their end position
+ *
+ * Matches ending at the same position are reported longest first, and in the order patterns were added if equally long.
+ * As data can be part of more than one match, all data is passed to the flush callback function, up to the end of each match before it is reported.
+ * \hideinitializer */
+#define MULTIFIND_MODE_OVERLAPPING              0x02
+/*! @} */
+
+/*! \brief initialize a new search with a specific match mode
+ * \sa     multifinder_free
+ * \param  mode                  match mode
+ * \param  foundfunction         function to call for each match (can be NULL)
+ * \param  flushfunction         function to call for all data that is not a match (can be NULL)
+ * \param  callbackdata          user data to pass to callback functions
+ * \return handle for a new search or NULL on error (e.g. invalid mode)
+ * \sa     MULTIFIND_MODE_*
+ * \sa     multifinder_create
+ */
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_with_mode (unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata);
+
 /*! \brief clean up an existing search
  * \param  handle                handle created with multifinder_create
  * \sa     multifinder_create
@@ -147,6 +180,9 @@ DLL_EXPORT_MULTIFINDER void multifinder_free (multifinder handle);
 DLL_EXPORT_MULTIFINDER void multifinder_reset (multifinder handle);
 
 /*! \brief possible values for the flags parameter of multifinder_add_pattern() and multifinder_add_allocated_pattern
+ *
+ * Word and line flags are checked while scanning (also across calls to multifinder_process), a match rejected by them
+ * is not reported and doesn't prevent other patterns from matching. The same pattern added with different flags is a different pattern.
  * \sa     multifinder_add_pattern
  * \sa     multifinder_add_allocated_pattern
  * \name   MULTIFIND_PATTERN_*
@@ -154,8 +190,18 @@ DLL_EXPORT_MULTIFINDER void multifinder_reset (multifinder handle);
  */
 /*! \brief case sensitive comparison (default) \hideinitializer */
 #define MULTIFIND_PATTERN_CASE_SENSITIVE        0x00
-/*! \brief case insensitive comparison \hideinitializer */
+/*! \brief case insensitive comparison (only for ASCII letters, not depending on locale) \hideinitializer */
 #define MULTIFIND_PATTERN_CASE_INSENSITIVE      0x01
+/*! \brief only match if not preceded by a word byte (see multifinder_set_word_bytes) \hideinitializer */
+#define MULTIFIND_PATTERN_WORD_BEFORE           0x02
+/*! \brief only match if not followed by a word byte (see multifinder_set_word_bytes) \hideinitializer */
+#define MULTIFIND_PATTERN_WORD_AFTER            0x04
+/*! \brief only match whole words (same as MULTIFIND_PATTERN_WORD_BEFORE | MULTIFIND_PATTERN_WORD_AFTER) \hideinitializer */
+#define MULTIFIND_PATTERN_WHOLE_WORD            0x06
+/*! \brief only match at the start of the stream or right after a line feed \hideinitializer */
+#define MULTIFIND_PATTERN_LINE_START            0x08
+/*! \brief only match at the end of the stream or right before a carriage return or line feed \hideinitializer */
+#define MULTIFIND_PATTERN_LINE_END              0x10
 /*! @} */
 
 /*! \brief add a search pattern (patterns added earlier take precedence in simultaneous matches)
@@ -171,8 +217,8 @@ DLL_EXPORT_MULTIFINDER void multifinder_add_pattern (multifinder handle, const c
 
 /*! \brief add a search pattern (patterns added earlier take precedence in simultaneous matches)
  * \param  handle                handle created with multifinder_create
- * \param  pattern               text to search (NULL terminated string)
- * \param  patternlen            length of text to search
+ * \param  pattern               data to search (may contain NULL bytes), will be freed after it is copied into the pattern storage
+ * \param  patternlen            length of data to search
  * \param  patterncallbackdata   user data to pass to callback function on each match
  * \sa     MULTIFIND_PATTERN_*
  * \sa     multifinder_add_pattern
@@ -180,9 +226,53 @@ DLL_EXPORT_MULTIFINDER void multifinder_add_pattern (multifinder handle, const c
  */
 DLL_EXPORT_MULTIFINDER void multifinder_add_allocated_pattern (multifinder handle, char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata);
 
+/*! \brief add multiple search patterns at once (patterns added earlier take precedence in simultaneous matches)
+ *
+ * Duplicate patterns are detected using a hash table, so adding a large number of patterns takes linear time.
+ * \param  handle                handle created with multifinder_create
+ * \param  patterns              array of patterns to search
+ * \param  patternlens           array with the length of each pattern (NULL if patterns are NULL terminated strings)
+ * \param  count                 number of patterns
+ * \param  flags                 flags (used for all patterns)
+ * \param  patterncallbackdata   array of user data to pass to callback function for each pattern (NULL to pass NULL for all patterns)
+ * \return 0 on success or non-zero on error
+ * \sa     MULTIFIND_PATTERN_*
+ * \sa     multifinder_add_pattern
+ * \sa     multifinder_add_patterns_from_file
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_add_patterns (multifinder handle, const char* const* patterns, const size_t* patternlens, size_t count, unsigned int flags, void* const* patterncallbackdata);
+
+/*! \brief add all search patterns listed in a file
+ *
+ * Patterns in the file are separated by NULL bytes if the file contains any, otherwise by newlines
+ * (a carriage return before the newline is not part of the pattern). Empty lines are skipped.
+ * The user data passed to the callback function is NULL for these patterns, batch mode can be used to know which pattern matched.
+ * \param  handle                handle created with multifinder_create
+ * \param  filename              path of file with patterns
+ * \param  flags                 flags (used for all patterns)
+ * \return 0 on success or non-zero on error
+ * \sa     MULTIFIND_PATTERN_*
+ * \sa     multifinder_add_patterns
+ * \sa     multifinder_set_batch
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_add_patterns_from_file (multifinder handle, const char* filename, unsigned int flags);
+
+/*! \brief remove a search pattern
+ *
+ * The pattern keeps its index (so the indices of other patterns don't change) and gets it back if it is added again.
+ * Removing a pattern that was not added is not an error.
+ * \param  handle                handle created with multifinder_create
+ * \param  pattern               pattern to remove (NULL terminated)
+ * \param  flags                 flags the pattern was added with
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_add_pattern
+ * \sa     multifinder_patternset_remove_pattern
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_remove_pattern (multifinder handle, const char* pattern, unsigned int flags);
+
 /*! \brief get the total number of patterns
  * \param  handle                handle created with multifinder_create
- * \return number of patterns
+ * \return number of patterns (including removed patterns, as they keep their index)
  * \param  patterncallbackdata   user data to pass to callback function on each match
  * \sa     multifinder_add_pattern
  * \sa     multifinder_add_allocated_pattern
@@ -190,7 +280,474 @@ DLL_EXPORT_MULTIFINDER void multifinder_add_allocated_pattern (multifinder handl
  */
 DLL_EXPORT_MULTIFINDER size_t multifinder_count_patterns (multifinder handle);
 
+/*! \brief get the length of the longest pattern
+ *
+ * No match is longer than this, so it is also the most data before the current position a match reported later can start in.
+ * \param  handle                handle created with multifinder_create
+ * \return length of the longest pattern (removed patterns may still be counted)
+ * \sa     multifinder_patternset_get_longest_pattern
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_get_longest_pattern (multifinder handle);
+
+/*! \brief get the number of bytes of memory used to store the patterns
+ *
+ * All pattern data is stored back to back in one block, next to a packed array with the offset, length, flags and user data of each pattern.
+ * Once the patterns are compiled the storage is trimmed to what is needed, so the memory used per pattern is
+ * the length of the pattern plus a small fixed overhead.
+ * \param  handle                handle created with multifinder_create
+ * \return number of bytes allocated for pattern storage (not including the compiled automaton)
+ * \sa     multifinder_count_patterns
+ * \sa     multifinder_patternset_get_pattern_memory
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_get_pattern_memory (multifinder handle);
+
+/*! \brief type used as handle for a set of search patterns that can be shared by multiple search handles
+ *
+ * A pattern set is reference counted and can only be changed while it has only one owner.
+ * Once compiled it is read-only, so search handles using the same pattern set can be used in different threads.
+ * \sa     multifinder_patternset_create
+ * \sa     multifinder_patternset_free
+ * \sa     multifinder_create_with_patternset
+ */
+typedef struct multifinder_patternset_struct* multifinder_patternset;
+
+/*! \brief create a new empty pattern set
+ * \return pattern set handle or NULL on error
+ * \sa     multifinder_patternset_free
+ * \sa     multifinder_patternset_add_pattern
+ * \sa     multifinder_create_with_patternset
+ */
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_patternset_create ();
+
+/*! \brief add an owner to a pattern set
+ * \param  patternset            pattern set handle
+ * \return \p patternset, must be released with multifinder_patternset_free
+ * \sa     multifinder_patternset_create
+ * \sa     multifinder_patternset_free
+ */
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_patternset_reference (multifinder_patternset patternset);
+
+/*! \brief release a pattern set, it is destroyed when the last owner releases it
+ * \param  patternset            pattern set handle
+ * \sa     multifinder_patternset_create
+ * \sa     multifinder_patternset_reference
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_patternset_free (multifinder_patternset patternset);
+
+/*! \brief add a search pattern to a pattern set (patterns added earlier take precedence in simultaneous matches)
+ * \param  patternset            pattern set handle
+ * \param  pattern               text to search (NULL terminated string)
+ * \param  flags                 flags
+ * \param  patterncallbackdata   user data to pass to callback function on each match
+ * \return 0 on success or non-zero on error (e.g. if the pattern set has more than one owner)
+ * \sa     MULTIFIND_PATTERN_*
+ * \sa     multifinder_patternset_add_allocated_pattern
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_pattern (multifinder_patternset patternset, const char* pattern, unsigned int flags, void* patterncallbackdata);
+
+/*! \brief add a search pattern to a pattern set (patterns added earlier take precedence in simultaneous matches)
+ * \param  patternset            pattern set handle
+ * \param  pattern               data to search (may contain NULL bytes), will be freed after it is copied into the pattern storage (or immediately on error)
+ * \param  patternlen            length of data to search
+ * \param  flags                 flags
+ * \param  patterncallbackdata   user data to pass to callback function on each match
+ * \return 0 on success or non-zero on error (e.g. if the pattern set has more than one owner)
+ * \sa     MULTIFIND_PATTERN_*
+ * \sa     multifinder_patternset_add_pattern
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_allocated_pattern (multifinder_patternset patternset, char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata);
+
+/*! \brief add multiple search patterns to a pattern set at once
+ * \param  patternset            pattern set handle
+ * \param  patterns              array of patterns to search
+ * \param  patternlens           array with the length of each pattern (NULL if patterns are NULL terminated strings)
+ * \param  count                 number of patterns
+ * \param  flags                 flags (used for all patterns)
+ * \param  patterncallbackdata   array of user data to pass to callback function for each pattern (NULL to pass NULL for all patterns)
+ * \return 0 on success or non-zero on error (e.g. if the pattern set has more than one owner)
+ * \sa     multifinder_add_patterns
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_patterns (multifinder_patternset patternset, const char* const* patterns, const size_t* patternlens, size_t count, unsigned int flags, void* const* patterncallbackdata);
+
+/*! \brief add all search patterns listed in a file to a pattern set
+ * \param  patternset            pattern set handle
+ * \param  filename              path of file with patterns (separated by NULL bytes or newlines)
+ * \param  flags                 flags (used for all patterns)
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_add_patterns_from_file
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_patterns_from_file (multifinder_patternset patternset, const char* filename, unsigned int flags);
+
+/*! \brief remove a search pattern from a pattern set
+ * \param  patternset            pattern set handle
+ * \param  pattern               pattern to remove
+ * \param  patternlen            length of the pattern
+ * \param  flags                 flags the pattern was added with
+ * \return 0 on success or non-zero on error (e.g. if the pattern set has more than one owner)
+ * \sa     multifinder_remove_pattern
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_remove_pattern (multifinder_patternset patternset, const char* pattern, size_t patternlen, unsigned int flags);
+
+/*! \brief get the total number of patterns in a pattern set
+ * \param  patternset            pattern set handle
+ * \return number of patterns (including removed patterns, as they keep their index)
+ * \sa     multifinder_patternset_add_pattern
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_count_patterns (multifinder_patternset patternset);
+
+/*! \brief get the length of the longest pattern in a pattern set
+ * \param  patternset            pattern set handle
+ * \return length of the longest pattern (removed patterns may still be counted)
+ * \sa     multifinder_get_longest_pattern
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_get_longest_pattern (multifinder_patternset patternset);
+
+/*! \brief get the number of bytes of memory used to store the patterns of a pattern set
+ * \param  patternset            pattern set handle
+ * \return number of bytes allocated for pattern storage (not including the compiled automaton)
+ * \sa     multifinder_get_pattern_memory
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_get_pattern_memory (multifinder_patternset patternset);
+
+/*! \brief compile the patterns of a pattern set into an automaton (done automatically when needed)
+ *
+ * After compiling the pattern set is read-only as long as it has more than one owner.
+ * \param  patternset            pattern set handle
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_create_with_patternset
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_compile (multifinder_patternset patternset);
+
+/*! \brief possible values for the type parameter of multifinder_patternset_set_automaton() and multifinder_set_automaton()
+ * \sa     multifinder_patternset_set_automaton
+ * \sa     multifinder_set_automaton
+ * \name   MULTIFIND_AUTOMATON_*
+ * \{
+ */
+/*! \brief the dense automaton if it fits in the memory budget (or in 256 MB if no budget was given), otherwise the compact one (default) \hideinitializer */
+#define MULTIFIND_AUTOMATON_AUTO                0x00
+/*! \brief full transition table, needs a single table lookup per input byte but stores a transition for every state and byte class \hideinitializer */
+#define MULTIFIND_AUTOMATON_DENSE               0x01
+/*! \brief double-array trie with 32-bit indices that only stores the transitions of the trie itself
+ *
+ * States with a single child (such as the tails of patterns that don't share their end with other patterns) keep that transition in the state itself.
+ * Missing transitions are resolved while scanning by following failure links, so scanning is slower than with the dense automaton.
+ * \hideinitializer */
+#define MULTIFIND_AUTOMATON_COMPACT             0x02
+/*! @} */
+
+/*! \brief choose the type of automaton the patterns of a pattern set are compiled into
+ *
+ * An automaton that was already compiled with different settings is released, so the patterns will be compiled again when needed.
+ * \param  patternset            pattern set handle
+ * \param  type                  automaton type
+ * \param  memorybudget          maximum number of bytes the compiled automaton may use including its prefilter (0 for no limit), compiling fails if even the compact automaton doesn't fit
+ * \return 0 on success or non-zero on error (invalid type or the pattern set is shared or loaded from a file)
+ * \sa     MULTIFIND_AUTOMATON_*
+ * \sa     multifinder_patternset_get_automaton_memory
+ * \sa     multifinder_set_automaton
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_set_automaton (multifinder_patternset patternset, unsigned int type, size_t memorybudget);
+
+/*! \brief get the number of bytes of memory used by the compiled automaton of a pattern set (compiling it if needed)
+ * \param  patternset            pattern set handle
+ * \param  ptype                 if not NULL, set to the type of the compiled automaton (MULTIFIND_AUTOMATON_DENSE or MULTIFIND_AUTOMATON_COMPACT)
+ * \return number of bytes used by the automaton and its prefilter, or 0 on error
+ * \sa     multifinder_patternset_set_automaton
+ * \sa     multifinder_patternset_get_pattern_memory
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_get_automaton_memory (multifinder_patternset patternset, unsigned int* ptype);
+
+/*! \brief set the bytes that are part of words for patterns added with MULTIFIND_PATTERN_WORD_BEFORE or MULTIFIND_PATTERN_WORD_AFTER
+ *
+ * By default words consist of ASCII letters, digits, underscores and all bytes from 0x80 (so UTF-8 encoded letters are part of words).
+ * \param  patternset            pattern set handle
+ * \param  wordbytes             all bytes that are part of words, or NULL to use the default
+ * \param  wordbyteslen          number of bytes in \p wordbytes
+ * \return 0 on success or non-zero on error (the pattern set is shared or loaded from a file)
+ * \sa     MULTIFIND_PATTERN_*
+ * \sa     multifinder_set_word_bytes
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_set_word_bytes (multifinder_patternset patternset, const char* wordbytes, size_t wordbyteslen);
+
+/*! \brief initialize a new search using an existing pattern set (which is compiled if needed)
+ * \param  patternset            pattern set handle (the new search handle will add itself as an owner)
+ * \param  foundfunction         function to call for each match (can be NULL)
+ * \param  flushfunction         function to call for all data that is not a match (can be NULL)
+ * \param  callbackdata          user data to pass to callback functions
+ * \return handle for a new search or NULL on error
+ * \sa     multifinder_patternset_create
+ * \sa     multifinder_create
+ * \sa     multifinder_free
+ */
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_with_patternset (multifinder_patternset patternset, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata);
+
+/*! \brief initialize a new search with a specific match mode using an existing pattern set (which is compiled if needed)
+ * \param  patternset            pattern set handle (the new search handle will add itself as an owner)
+ * \param  mode                  match mode
+ * \param  foundfunction         function to call for each match (can be NULL)
+ * \param  flushfunction         function to call for all data that is not a match (can be NULL)
+ * \param  callbackdata          user data to pass to callback functions
+ * \return handle for a new search or NULL on error (e.g. invalid mode)
+ * \sa     MULTIFIND_MODE_*
+ * \sa     multifinder_create_with_patternset
+ */
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_with_patternset_and_mode (multifinder_patternset patternset, unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata);
+
+/*! \brief save the compiled patterns of a pattern set to a file (compiling them if needed)
+ *
+ * The file contains the automaton and the patterns in the same layout as used in memory,
+ * so it can be loaded with multifinder_patternset_load_compiled() without compiling or parsing.
+ * Pattern callback data is not saved.
+ * The file format is versioned and can only be loaded on systems with the same byte order.
+ * \param  patternset            pattern set handle
+ * \param  filename              path of file to create
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_patternset_load_compiled
+ * \sa     multifinder_save_compiled
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_save_compiled (multifinder_patternset patternset, const char* filename);
+
+/*! \brief load a pattern set saved with multifinder_patternset_save_compiled()
+ *
+ * The file is memory mapped read-only and used for searching as is, so loading takes the same time for any number of patterns
+ * and processes loading the same file share the memory it uses.
+ * The file must not be changed while it is loaded and should come from a trusted source, as its contents are not validated.
+ * The loaded pattern set is read-only, no patterns can be added to it.
+ * \param  filename              path of file to load
+ * \param  patterncallbackdata   user data to pass to the callback function for each pattern, indexed in the order patterns were added (NULL to pass NULL for all patterns), must remain valid while the pattern set is used
+ * \return pattern set handle or NULL on error (e.g. if the file is not a compiled pattern set usable on this system)
+ * \sa     multifinder_patternset_save_compiled
+ * \sa     multifinder_patternset_free
+ * \sa     multifinder_create_with_patternset
+ * \sa     multifinder_load_compiled
+ */
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_patternset_load_compiled (const char* filename, void* const* patterncallbackdata);
+
+/*! \brief save the compiled patterns of a search to a file (compiling them if needed)
+ * \param  handle                handle created with multifinder_create
+ * \param  filename              path of file to create
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_patternset_save_compiled
+ * \sa     multifinder_load_compiled
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_save_compiled (multifinder handle, const char* filename);
+
+/*! \brief initialize a new search using compiled patterns saved with multifinder_save_compiled()
+ * \param  filename              path of file to load
+ * \param  foundfunction         function to call for each match (can be NULL), the pattern callback data is always NULL
+ * \param  flushfunction         function to call for all data that is not a match (can be NULL)
+ * \param  callbackdata          user data to pass to callback functions
+ * \return handle for a new search or NULL on error
+ * \sa     multifinder_save_compiled
+ * \sa     multifinder_patternset_load_compiled
+ * \sa     multifinder_free
+ */
+DLL_EXPORT_MULTIFINDER multifinder multifinder_load_compiled (const char* filename, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata);
+
+/*! \brief get the pattern set used by a search
+ * \param  handle                handle created with multifinder_create or multifinder_create_with_patternset
+ * \return pattern set handle (use multifinder_patternset_reference to keep it after freeing \p handle)
+ * \sa     multifinder_create_with_patternset
+ */
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_get_patternset (multifinder handle);
+
+/*! \brief choose the type of automaton the patterns of a search are compiled into
+ * \param  handle                handle created with multifinder_create
+ * \param  type                  automaton type
+ * \param  memorybudget          maximum number of bytes the compiled automaton may use including its prefilter (0 for no limit)
+ * \return 0 on success or non-zero on error (invalid type or the pattern set is shared or loaded from a file)
+ * \sa     MULTIFIND_AUTOMATON_*
+ * \sa     multifinder_patternset_set_automaton
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_set_automaton (multifinder handle, unsigned int type, size_t memorybudget);
+
+/*! \brief set the bytes that are part of words for patterns added with MULTIFIND_PATTERN_WORD_BEFORE or MULTIFIND_PATTERN_WORD_AFTER
+ * \param  handle                handle created with multifinder_create
+ * \param  wordbytes             all bytes that are part of words, or NULL to use the default (ASCII letters, digits, underscores and all bytes from 0x80)
+ * \param  wordbyteslen          number of bytes in \p wordbytes
+ * \return 0 on success or non-zero on error (the pattern set is shared or loaded from a file)
+ * \sa     multifinder_patternset_set_word_bytes
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_set_word_bytes (multifinder handle, const char* wordbytes, size_t wordbyteslen);
+
+/*! \brief type used as handle for a live pattern set, which publishes compiled snapshots of patterns that keep changing
+ *
+ * One thread changes the patterns and publishes a new snapshot with multifinder_live_publish, which compiles it in that thread.
+ * Search handles created with multifinder_create_live switch to the latest snapshot the next time data is passed to them,
+ * so searches never wait for patterns to be compiled. A snapshot is released once no search handle uses it any more.
+ * \sa     multifinder_live_create
+ * \sa     multifinder_create_live
+ */
+typedef struct multifinder_live_struct* multifinder_live;
+
+/*! \brief create a live pattern set
+ * \param  patternset            pattern set to publish as the first snapshot (the live pattern set adds itself as an owner), or NULL to start without patterns
+ * \return live pattern set handle or NULL on error (e.g. if the patterns can't be compiled)
+ * \sa     multifinder_live_free
+ * \sa     multifinder_create_live
+ */
+DLL_EXPORT_MULTIFINDER multifinder_live multifinder_live_create (multifinder_patternset patternset);
+
+/*! \brief release a live pattern set, it is destroyed when the search handles following it are freed as well
+ * \param  live                  live pattern set handle
+ * \sa     multifinder_live_create
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_live_free (multifinder_live live);
+
+/*! \brief add a search pattern to the next snapshot of a live pattern set (only to be called from the thread that publishes snapshots)
+ * \param  live                  live pattern set handle
+ * \param  pattern               pattern to search
+ * \param  patternlen            length of the pattern
+ * \param  flags                 flags
+ * \param  patterncallbackdata   user data to pass to callback function on each match
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_live_remove_pattern
+ * \sa     multifinder_live_publish
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_live_add_pattern (multifinder_live live, const char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata);
+
+/*! \brief remove a search pattern from the next snapshot of a live pattern set (only to be called from the thread that publishes snapshots)
+ * \param  live                  live pattern set handle
+ * \param  pattern               pattern to remove
+ * \param  patternlen            length of the pattern
+ * \param  flags                 flags the pattern was added with
+ * \return 0 on success or non-zero on error
+ * \sa     multifinder_live_add_pattern
+ * \sa     multifinder_live_publish
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_live_remove_pattern (multifinder_live live, const char* pattern, size_t patternlen, unsigned int flags);
+
+/*! \brief compile the patterns added and removed since the last snapshot and publish them as the new snapshot
+ *
+ * Compiling is done in the calling thread while search handles keep using the previous snapshot.
+ * \param  live                  live pattern set handle
+ * \return 0 on success (also if nothing changed) or non-zero on error (the previous snapshot stays published and the changes are kept)
+ * \sa     multifinder_live_add_pattern
+ * \sa     multifinder_live_remove_pattern
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_live_publish (multifinder_live live);
+
+/*! \brief get the latest snapshot of a live pattern set
+ * \param  live                  live pattern set handle
+ * \return compiled pattern set, must be released with multifinder_patternset_free
+ * \sa     multifinder_live_publish
+ */
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_live_get_patternset (multifinder_live live);
+
+/*! \brief initialize a new search that follows the snapshots published by a live pattern set
+ *
+ * A new snapshot is used from the next call that passes data, unless a match is pending (in which case the switch waits until it is reported).
+ * Matches that started in data already passed before the switch and end after it are not found if they only exist in one of the snapshots.
+ * \param  live                  live pattern set handle (the new search handle will add itself as an owner)
+ * \param  mode                  match mode
+ * \param  foundfunction         function to call for each match (can be NULL)
+ * \param  flushfunction         function to call for all data that is not a match (can be NULL)
+ * \param  callbackdata          user data to pass to callback functions
+ * \return handle for a new search or NULL on error (e.g. invalid mode)
+ * \sa     multifinder_live_create
+ * \sa     MULTIFIND_MODE_*
+ */
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_live (multifinder_live live, unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata);
+
+/*! \brief match information as stored in batch mode
+ * \sa     multifinder_set_batch
+ * \sa     multifinder_batch_callback_fn
+ */
+typedef struct multifinder_match_struct {
+  size_t pos;                   /**< position of the match in the input stream */
+  size_t length;                /**< length of the match */
+  size_t pattern;               /**< index of the matched pattern in the order patterns were added (not counting empty or duplicate patterns) */
+  void* patterncallbackdata;    /**< user data for the matched pattern */
+} multifinder_match;
+
+/*! \brief callback function called with a batch of matches in batch mode
+ * \param  matches               matches in the order of the input stream
+ * \param  count                 number of matches
+ * \param  callbackdata          user data
+ * \return 0 to continue processing or non-zero to abort
+ * \sa     multifinder_set_batch
+ */
+typedef int (*multifinder_batch_callback_fn)(const multifinder_match* matches, size_t count, void* callbackdata);
+
+/*! \brief switch a search to batch mode, in which matches are stored in an array instead of calling a callback function for each match
+ *
+ * In batch mode \p batchfunction is called when \p matches is full and at the end of each call to
+ * multifinder_process() and multifinder_finalize() that found matches, so the matches can be handled in a tight loop.
+ * The found and flush callback functions are not called in batch mode, data without matches lies between the matches.
+ * \param  handle                handle created with multifinder_create
+ * \param  matches               array that will receive the matches (NULL to leave batch mode)
+ * \param  maxmatches            number of entries in \p matches
+ * \param  batchfunction         function to call with the matches stored in \p matches
+ * \sa     multifinder_match
+ * \sa     multifinder_batch_callback_fn
+ * \sa     multifinder_process
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_set_batch (multifinder handle, multifinder_match* matches, size_t maxmatches, multifinder_batch_callback_fn batchfunction);
+
+/*! \brief a block of data
+ * \sa     multifinder_set_replace
+ * \sa     multifinder_output_callback_fn
+ */
+typedef struct multifinder_segment_struct {
+  const char* data;             /**< start of the data */
+  size_t datalen;               /**< length of the data */
+} multifinder_segment;
+
+/*! \brief callback function called with output in replace mode
+ * \param  segments              blocks of output data in order (only valid until the callback function returns)
+ * \param  count                 number of entries in \p segments
+ * \param  callbackdata          user data
+ * \return 0 to continue processing or non-zero to abort
+ * \sa     multifinder_set_replace
+ * \sa     multifinder_set_replace_buffer
+ */
+typedef int (*multifinder_output_callback_fn)(const multifinder_segment* segments, size_t count, void* callbackdata);
+
+/*! \brief switch a search to replace mode, in which the output is the input with each match replaced
+ *
+ * In replace mode the output is collected as a list of segments, which refer to the input data or the replacements
+ * without copying them (only the little data kept between calls to multifinder_process() is copied).
+ * \p outputfunction is called when \p segments is full and at the end of each call to multifinder_process() and
+ * multifinder_finalize(), so the segments can be written at once (e.g. with writev() on POSIX systems).
+ * The found and flush callback functions are not called in replace mode.
+ * Replace mode can't be used with MULTIFIND_MODE_OVERLAPPING.
+ * \param  handle                handle created with multifinder_create
+ * \param  replacements          replacement of each pattern in the order patterns were added (NULL if the pattern callback data of each pattern points to a multifinder_segment with its replacement), must remain valid while searching
+ * \param  replacementcount      number of entries in \p replacements (matches of patterns without replacement are copied to the output)
+ * \param  segments              array that will receive the output segments (NULL to leave replace mode)
+ * \param  maxsegments           number of entries in \p segments
+ * \param  outputfunction        function to call with the segments stored in \p segments
+ * \return 0 on success or non-zero if the match mode doesn't allow replacing
+ * \sa     multifinder_set_replace_buffer
+ * \sa     multifinder_replace_stream
+ * \sa     multifinder_output_callback_fn
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_set_replace (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, multifinder_segment* segments, size_t maxsegments, multifinder_output_callback_fn outputfunction);
+
+/*! \brief switch a search to replace mode, in which the output is the input with each match replaced and is copied into a buffer
+ *
+ * Same as multifinder_set_replace(), except that the output is copied into \p buffer and
+ * \p outputfunction is called with a single segment when \p buffer is full and at the end of each call to multifinder_process() and multifinder_finalize().
+ * \param  handle                handle created with multifinder_create
+ * \param  replacements          replacement of each pattern in the order patterns were added (NULL if the pattern callback data of each pattern points to a multifinder_segment with its replacement)
+ * \param  replacementcount      number of entries in \p replacements (matches of patterns without replacement are copied to the output)
+ * \param  buffer                buffer that will receive the output (NULL to leave replace mode)
+ * \param  buffersize            size of \p buffer
+ * \param  outputfunction        function to call with the data stored in \p buffer
+ * \return 0 on success or non-zero if the match mode doesn't allow replacing
+ * \sa     multifinder_set_replace
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_set_replace_buffer (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, char* buffer, size_t buffersize, multifinder_output_callback_fn outputfunction);
+
 /*! \brief find patterns in data and call \p callbackfunction for each match
+ *
+ * The first call after patterns were added compiles all patterns into an Aho-Corasick automaton,
+ * after which each byte of data is only scanned once, regardless of the number of patterns.
+ * By default matches don't overlap, if multiple patterns match at the same position the one added first is reported
+ * (see MULTIFIND_MODE_* for the other match modes).
+ * Data can be supplied in blocks of any size (even single bytes), between calls only the bytes that can still be part of
+ * a match are kept in a ring buffer, so data is never copied again once it has been seen.
  * \param  handle                handle created with multifinder_create
  * \param  data                  text to search (does not need to be NULL terminated), will be freed by multifinder_free
  * \param  datalen               length text to search
@@ -203,6 +760,22 @@ DLL_EXPORT_MULTIFINDER size_t multifinder_count_patterns (multifinder handle);
  */
 DLL_EXPORT_MULTIFINDER size_t multifinder_process (multifinder handle, const char* data, size_t datalen);
 
+/*! \brief find patterns in a large block of data using multiple threads, with the same results as \p multifinder_process
+ *
+ * The data is split in chunks (of at least 1 MB) that are scanned in parallel, after which the matches are
+ * merged so they are exactly the same as when scanning serially, including matches crossing chunk boundaries.
+ * The callback functions are only called from the calling thread and in the order of the input stream.
+ * Small blocks of data are simply processed by \p multifinder_process.
+ * \param  handle                handle created with multifinder_create
+ * \param  data                  text to search (does not need to be NULL terminated)
+ * \param  datalen               length text to search
+ * \param  threads               maximum number of threads to use (0 to use one thread for each processor)
+ * \return number of matches found
+ * \sa     multifinder_process
+ * \sa     multifinder_finalize
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_process_parallel (multifinder handle, const char* data, size_t datalen, unsigned int threads);
+
 /*! \brief finish finding patterns in data previously passed with \p multifinder_process and call \p callbackfunction for each match
  * \param  handle                handle created with multifinder_create
  * \return number of matches found
@@ -214,9 +787,86 @@ DLL_EXPORT_MULTIFINDER size_t multifinder_process (multifinder handle, const cha
  */
 DLL_EXPORT_MULTIFINDER size_t multifinder_finalize (multifinder handle);
 
+/*! \brief find patterns in the complete remaining input stream that is available in memory (e.g. a memory mapped file)
+ *
+ * This is the same as calling \p multifinder_process_parallel followed by \p multifinder_finalize.
+ * The data is scanned in place, only data that may be part of a match is copied at the end.
+ * \param  handle                handle created with multifinder_create
+ * \param  data                  text to search (does not need to be NULL terminated)
+ * \param  datalen               length text to search
+ * \param  threads               maximum number of threads to use (0 to use one thread for each processor, 1 to scan serially)
+ * \return number of matches found
+ * \sa     multifinder_process_parallel
+ * \sa     multifinder_process_file
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_process_mapped (multifinder handle, const char* data, size_t datalen, unsigned int threads);
+
+/*! \brief find patterns in the contents of a file and finalize the search
+ *
+ * Regular files are memory mapped and scanned in place (hinting the system the data is read sequentially),
+ * other files (like pipes) or files that can't be mapped are read in large blocks by a separate thread instead,
+ * so the next blocks are read while the current block is scanned.
+ * \param  handle                handle created with multifinder_create
+ * \param  filename              path of file to search (NULL to use standard input)
+ * \param  threads               maximum number of threads to use (0 to use one thread for each processor, 1 to scan serially)
+ * \param  pcount                pointer that will receive the number of matches found (can be NULL)
+ * \return 0 on success or non-zero if the file could not be opened or read
+ * \sa     multifinder_process_mapped
+ * \sa     multifinder_process
+ * \sa     multifinder_finalize
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_process_file (multifinder handle, const char* filename, unsigned int threads, size_t* pcount);
+
+/*! \brief replace patterns in the contents of a file and write the result to another file
+ *
+ * The input is read as with multifinder_process_file() and the output is collected in large blocks that are written
+ * by a separate thread while scanning continues. Callback functions and user data of \p handle are not used.
+ * \param  handle                handle created with multifinder_create
+ * \param  replacements          replacement of each pattern in the order patterns were added (NULL if the pattern callback data of each pattern points to a multifinder_segment with its replacement)
+ * \param  replacementcount      number of entries in \p replacements (matches of patterns without replacement are copied to the output)
+ * \param  filename              path of file to search (NULL to use standard input)
+ * \param  dst                   file to write the output to (written through its file descriptor if it has one, otherwise with fwrite())
+ * \param  threads               maximum number of threads to use (0 to use one thread for each processor, 1 to scan serially)
+ * \param  pcount                pointer that will receive the number of matches replaced (can be NULL)
+ * \return 0 on success, -1 if the file could not be opened or read, -2 if writing failed or -3 if the match mode doesn't allow replacing
+ * \sa     multifinder_set_replace
+ * \sa     multifinder_process_file
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_replace_stream (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, const char* filename, FILE* dst, unsigned int threads, size_t* pcount);
+
+/*! \brief type of callback function called by multifinder_count_files() after searching each file
+ * \param  filename              path of the file
+ * \param  status                0 if the file was searched or non-zero if the file or directory could not be read
+ * \param  count                 number of matches found in the file
+ * \param  callbackdata          user data as passed to multifinder_count_files
+ * \return 0 to continue processing or non-zero to abort
+ * \sa     multifinder_count_files
+ */
+typedef int (*multifinder_file_callback_fn)(const char* filename, int status, size_t count, void* callbackdata);
+
+/*! \brief count matches of each pattern in many files, searching directories recursively
+ *
+ * Files are searched by a pool of threads, each with its own search handle and counters that are added up at the end.
+ * A thread searches the files of the directories it read itself and takes work from other threads when it runs out,
+ * large files are searched after all other files, each split in chunks scanned by all threads.
+ * Only regular files are searched in directories and links to directories are not followed.
+ * \param  handle                handle created with multifinder_create (only its patterns and match mode are used)
+ * \param  paths                 paths of files and directories to search
+ * \param  pathcount             number of entries in \p paths
+ * \param  threads               maximum number of threads to use (0 to use one thread for each processor)
+ * \param  patterncounts         array with an entry for each pattern to which the number of matches of each pattern is added (can be NULL)
+ * \param  filefunction          function to call after searching each file or if a file or directory could not be read (can be NULL), called from one thread at a time
+ * \param  callbackdata          user data passed to \p filefunction
+ * \param  pcount                pointer that will receive the number of matches found (can be NULL)
+ * \return 0 on success, -1 on memory allocation error or the non-zero value \p filefunction returned to abort
+ * \sa     multifinder_process_file
+ * \sa     multifinder_count_patterns
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_count_files (multifinder handle, const char* const* paths, size_t pathcount, unsigned int threads, size_t* patterncounts, multifinder_file_callback_fn filefunction, void* callbackdata, size_t* pcount);
+
 /*! \brief finish finding patterns in data previously passed with \p multifinder_process and call \p callbackfunction for each match
  * \param  handle                handle created with multifinder_create
- * \return returns the non-zero status code the callbackfunction returned if the search was aborted or 0 otherwise
+ * \return returns the non-zero status code the callbackfunction returned if the search was aborted, -1 if compiling the patterns failed (e.g. out of memory) or 0 otherwise
  * \sa     multifinder_process
  * \sa     multifinder_finalize
  * \sa     multifinder_found_callback_fn
@@ -234,6 +884,152 @@ DLL_EXPORT_MULTIFINDER int multifinder_aborted (multifinder handle);
  */
 DLL_EXPORT_MULTIFINDER size_t multifinder_position (multifinder handle);
 
+/*! \brief pool of stream contexts
+ * \sa     multifinder_stream_pool_create
+ */
+typedef struct multifinder_stream_pool_struct* multifinder_stream_pool;
+
+/*! \brief context of a single input stream searched with a stream pool
+ * \sa     multifinder_stream_open
+ */
+typedef struct multifinder_stream_struct* multifinder_stream;
+
+/*! \brief create a pool of stream contexts to search many input streams with the same search handle
+ *
+ * Each stream context only holds the position in the stream and the state of the search, plus the data that can
+ * still be part of a match (which is not needed most of the time), so a large number of input streams can be
+ * searched at the same time.
+ * Contexts and data are allocated in blocks from the pool, so memory is only allocated when the pool needs to grow.
+ * Data passed to multifinder_stream_process() is searched by \p handle (with its patterns, match mode and callback functions),
+ * callback functions receive the user data of the stream instead of the user data of \p handle.
+ * The pool and \p handle must only be used by one thread at a time (use a pool with its own handle for each thread,
+ * created with multifinder_create_with_patternset() to share the patterns).
+ * \param  handle                handle created with multifinder_create (must not be freed before the pool)
+ * \return pool handle or NULL on error
+ * \sa     multifinder_stream_pool_free
+ * \sa     multifinder_stream_open
+ */
+DLL_EXPORT_MULTIFINDER multifinder_stream_pool multifinder_stream_pool_create (multifinder handle);
+
+/*! \brief clean up a pool of stream contexts, including all streams that were not closed
+ * \param  pool                  pool created with multifinder_stream_pool_create
+ * \sa     multifinder_stream_pool_create
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_stream_pool_free (multifinder_stream_pool pool);
+
+/*! \brief get the amount of memory used by a pool of stream contexts
+ * \param  pool                  pool created with multifinder_stream_pool_create
+ * \return number of bytes allocated for stream contexts and their data (including unused blocks kept for reuse)
+ * \sa     multifinder_stream_pool_create
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_pool_get_memory (multifinder_stream_pool pool);
+
+/*! \brief start searching a new input stream
+ * \param  pool                  pool created with multifinder_stream_pool_create
+ * \param  callbackdata          user data passed to the callback functions for this stream
+ * \return stream handle or NULL on error
+ * \sa     multifinder_stream_close
+ * \sa     multifinder_stream_process
+ */
+DLL_EXPORT_MULTIFINDER multifinder_stream multifinder_stream_open (multifinder_stream_pool pool, void* callbackdata);
+
+/*! \brief stop searching an input stream and return its context to the pool (without finalizing the search)
+ * \param  stream                stream handle returned by multifinder_stream_open
+ * \sa     multifinder_stream_open
+ * \sa     multifinder_stream_finalize
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_stream_close (multifinder_stream stream);
+
+/*! \brief start searching an input stream again from the beginning, same as multifinder_reset() for a search handle
+ * \param  stream                stream handle returned by multifinder_stream_open
+ * \sa     multifinder_reset
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_stream_reset (multifinder_stream stream);
+
+/*! \brief find patterns in the next data of an input stream, same as multifinder_process() for a search handle
+ * \param  stream                stream handle returned by multifinder_stream_open
+ * \param  data                  text to search (does not need to be NULL terminated)
+ * \param  datalen               length text to search
+ * \return number of matches found
+ * \sa     multifinder_process
+ * \sa     multifinder_stream_finalize
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_process (multifinder_stream stream, const char* data, size_t datalen);
+
+/*! \brief finish finding patterns at the end of an input stream, same as multifinder_finalize() for a search handle
+ * \param  stream                stream handle returned by multifinder_stream_open
+ * \return number of matches found
+ * \sa     multifinder_finalize
+ * \sa     multifinder_stream_process
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_finalize (multifinder_stream stream);
+
+/*! \brief check if searching an input stream was aborted, same as multifinder_aborted() for a search handle
+ * \param  stream                stream handle returned by multifinder_stream_open
+ * \return returns the non-zero status code a callback function returned if the search was aborted, -1 if compiling the patterns failed or 0 otherwise
+ * \sa     multifinder_aborted
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_stream_aborted (multifinder_stream stream);
+
+/*! \brief get the current position in an input stream, same as multifinder_position() for a search handle
+ * \param  stream                stream handle returned by multifinder_stream_open
+ * \return returns the current position in the input stream
+ * \sa     multifinder_position
+ */
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_position (multifinder_stream stream);
+
+/*! \brief statistics of a search
+ *
+ * Counters are collected unless the library was built with MULTIFINDER_NO_STATS defined (CMake option BUILD_STATS).
+ * Time is only measured after calling multifinder_set_stats_timing.
+ * \sa     multifinder_get_stats
+ * \sa     multifinder_reset_stats
+ */
+typedef struct multifinder_stats_struct {
+  unsigned long long bytesprocessed;    /**< number of bytes passed to multifinder_process */
+  unsigned long long bytesscanned;      /**< number of bytes examined by the automaton or the prefilter (data kept between calls, data near the edges of chunks scanned in parallel and data scanned again after patterns were added is counted more than once) */
+  unsigned long long bytesskipped;      /**< number of bytes skipped by the prefilter (included in bytesscanned) */
+  unsigned long long candidates;        /**< number of positions where one or more patterns end that were checked */
+  unsigned long long comparisons;       /**< number of full pattern comparisons (only needed for case sensitive patterns when case insensitive patterns are also used) */
+  unsigned long long matches;           /**< number of matches reported */
+  unsigned long long flushcalls;        /**< number of times the flush callback function was called with data (in replace mode the output callback function) */
+  unsigned long long flushedbytes;      /**< number of bytes passed to the flush callback function (in replace mode the input bytes copied to the output) */
+  unsigned long long totaltime;         /**< nanoseconds spent in multifinder_process, multifinder_process_parallel and multifinder_finalize (including callback functions) */
+  unsigned long long callbacktime;      /**< nanoseconds spent in callback functions */
+  size_t patternmemory;                 /**< number of bytes used by the patterns (same as multifinder_get_pattern_memory) */
+  size_t automatonmemory;               /**< number of bytes used by the compiled automaton and prefilter (0 if not compiled) */
+  unsigned int automatontype;           /**< type of the compiled automaton (MULTIFIND_AUTOMATON_DENSE or MULTIFIND_AUTOMATON_COMPACT, 0 if not compiled) */
+  size_t prefiltermemory;               /**< number of bytes used by the prefilter (included in automatonmemory, 0 if not compiled or no prefilter is used) */
+  double prefilterfalsepositiverate;    /**< estimated fraction of positions without a pattern that pass the q-gram filter used for large numbers of patterns (0 if it is not used) */
+  size_t buffermemory;                  /**< number of bytes used by the buffer holding data kept between calls to multifinder_process */
+  size_t patterncount;                  /**< number of entries in patternmatches */
+  const unsigned long long* patternmatches;/**< number of matches for each pattern in the order patterns were added (only valid until \p handle is used again) */
+} multifinder_stats;
+
+/*! \brief get statistics of a search
+ * \param  handle                handle created with multifinder_create
+ * \param  stats                 structure to fill with statistics collected since the handle was created or multifinder_reset_stats was called (multifinder_reset does not clear them)
+ * \return zero on success or non-zero if the library was built without statistics (only the memory usage is filled in)
+ * \sa     multifinder_reset_stats
+ * \sa     multifinder_set_stats_timing
+ */
+DLL_EXPORT_MULTIFINDER int multifinder_get_stats (multifinder handle, multifinder_stats* stats);
+
+/*! \brief clear the statistics of a search
+ * \param  handle                handle created with multifinder_create
+ * \sa     multifinder_get_stats
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_reset_stats (multifinder handle);
+
+/*! \brief enable or disable measuring the time spent in the library and in callback functions
+ *
+ * Reading the clock costs more than the other counters, so this is disabled by default.
+ * \param  handle                handle created with multifinder_create
+ * \param  enable                non-zero to measure time or zero to stop measuring
+ * \sa     multifinder_get_stats
+ */
+DLL_EXPORT_MULTIFINDER void multifinder_set_stats_timing (multifinder handle, int enable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,685 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file multifinder.hpp
+ * @brief header only C++ interface to libmultifinder (requires C++17)
+ * @author Brecht Sanders
+ *
+ * This header file defines C++ classes on top of the functions in multifinder.h:
+ * - multifind::patternset and multifind::finder own a pattern set or search handle and release it when destroyed
+ * - callbacks are function objects (like lambdas) called as found(std::string_view match, std::size_t pattern),
+ *   the search handle runs in batch mode and the callback is called from a loop over each batch, so it can be inlined
+ * - multifind::make_keywords() builds the automaton for a fixed list of keywords at compile time,
+ *   scanning with it needs no library calls and no setup at run time
+ *
+ * A callback that returns a value aborts the search by returning non-zero (or true), like the callbacks in multifinder.h.
+ * The namespace is called multifind as multifinder is already the name of the search handle type.
+ * \sa     multifind::finder
+ * \sa     multifind::make_keywords()
+ */
+
+#ifndef INCLUDED_MULTIFINDER_HPP
+#define INCLUDED_MULTIFINDER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "multifinder.h"
+
+namespace multifind {
+
+/*! \cond PRIVATE */
+namespace detail {
+
+//call a callback for a match, returns true if it asks to abort (callbacks returning void never do)
+template <typename F>
+inline bool call_found (F& found, std::string_view match, std::size_t pattern)
+{
+  if constexpr (std::is_void_v<std::invoke_result_t<F&, std::string_view, std::size_t>>) {
+    found(match, pattern);
+    return false;
+  } else {
+    return static_cast<bool>(found(match, pattern));
+  }
+}
+
+//same bytes as multifinder_fold_table
+constexpr unsigned char fold (unsigned char c)
+{
+  return (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+}
+
+//same bytes as the default word bytes of a pattern set
+constexpr bool is_word_byte (unsigned char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+//smallest unsigned type that can hold a state number below n
+template <std::size_t n>
+using state_type = std::conditional_t<(n <= 0x100), std::uint8_t, std::conditional_t<(n <= 0x10000), std::uint16_t, std::uint32_t>>;
+
+}
+/*! \endcond */
+
+/*! \brief set of search patterns that can be shared by multiple finders (copies add an owner to the same pattern set)
+ *
+ * Like in the C interface a pattern set can only be changed while it has only one owner.
+ * \sa     multifinder_patternset
+ */
+class patternset
+{
+public:
+  /*! \brief create a new empty pattern set
+   * \throw  std::bad_alloc if the pattern set can't be created
+   */
+  patternset () : handle_(multifinder_patternset_create())
+  {
+    if (!handle_)
+      throw std::bad_alloc();
+  }
+
+  /*! \brief take over a pattern set handle
+   * \param  handle                pattern set handle (NULL for an empty object)
+   */
+  explicit patternset (multifinder_patternset handle) noexcept : handle_(handle)
+  {
+  }
+
+  patternset (const patternset& other) noexcept : handle_(other.handle_ ? multifinder_patternset_reference(other.handle_) : nullptr)
+  {
+  }
+
+  patternset (patternset&& other) noexcept : handle_(std::exchange(other.handle_, nullptr))
+  {
+  }
+
+  patternset& operator= (patternset other) noexcept
+  {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  ~patternset ()
+  {
+    if (handle_)
+      multifinder_patternset_free(handle_);
+  }
+
+  /*! \brief load a pattern set saved with save_compiled() or multifinder_patternset_save_compiled()
+   * \param  filename              path of file to load
+   * \return pattern set, empty on error
+   * \sa     multifinder_patternset_load_compiled
+   */
+  static patternset load_compiled (const char* filename) noexcept
+  {
+    return patternset(multifinder_patternset_load_compiled(filename, nullptr));
+  }
+
+  /*! \brief check if the object holds a pattern set */
+  explicit operator bool () const noexcept
+  {
+    return handle_ != nullptr;
+  }
+
+  /*! \brief get the pattern set handle for use with the C functions */
+  multifinder_patternset get () const noexcept
+  {
+    return handle_;
+  }
+
+  /*! \brief add a search pattern (may contain NULL bytes)
+   * \return 0 on success or non-zero on error
+   * \sa     multifinder_patternset_add_patterns
+   */
+  int add_pattern (std::string_view pattern, unsigned int flags = MULTIFIND_PATTERN_CASE_SENSITIVE) noexcept
+  {
+    const char* data = pattern.data();
+    std::size_t datalen = pattern.size();
+    return multifinder_patternset_add_patterns(handle_, &data, &datalen, 1, flags, nullptr);
+  }
+
+  /*! \brief remove a search pattern
+   * \return 0 on success, 1 if the pattern wasn't found or -1 on error
+   * \sa     multifinder_patternset_remove_pattern
+   */
+  int remove_pattern (std::string_view pattern, unsigned int flags = MULTIFIND_PATTERN_CASE_SENSITIVE) noexcept
+  {
+    return multifinder_patternset_remove_pattern(handle_, pattern.data(), pattern.size(), flags);
+  }
+
+  /*! \brief set which bytes are part of a word
+   * \sa     multifinder_patternset_set_word_bytes
+   */
+  int set_word_bytes (std::string_view wordbytes) noexcept
+  {
+    return multifinder_patternset_set_word_bytes(handle_, wordbytes.data(), wordbytes.size());
+  }
+
+  /*! \brief get the total number of patterns */
+  std::size_t count_patterns () const noexcept
+  {
+    return multifinder_patternset_count_patterns(handle_);
+  }
+
+  /*! \brief compile the patterns (done automatically when needed)
+   * \sa     multifinder_patternset_compile
+   */
+  int compile () noexcept
+  {
+    return multifinder_patternset_compile(handle_);
+  }
+
+  /*! \brief save the compiled patterns to a file
+   * \sa     multifinder_patternset_save_compiled
+   */
+  int save_compiled (const char* filename) noexcept
+  {
+    return multifinder_patternset_save_compiled(handle_, filename);
+  }
+
+private:
+  multifinder_patternset handle_;
+};
+
+/*! \brief search handle that calls a function object for each match
+ *
+ * The search handle is used in batch mode (see multifinder_set_batch()), the library only calls back once per batch
+ * of matches and the function object is called for each match from a loop that the compiler can inline it into.
+ * The data of a match that started in data passed to an earlier call is copied from the end of that data,
+ * which is kept for this purpose (at most the length of the longest pattern).
+ * An exception thrown by the function object aborts the search and is passed on to the caller.
+ * A finder can be moved but not copied.
+ * \sa     multifinder
+ */
+class finder
+{
+public:
+  /*! \brief create a new search
+   * \param  mode                  match mode
+   * \throw  std::bad_alloc if the search handle can't be created
+   * \sa     MULTIFIND_MODE_*
+   */
+  explicit finder (unsigned int mode = MULTIFIND_MODE_LEFTMOST_FIRST) : context_(new context())
+  {
+    init(multifinder_create_with_mode(mode, nullptr, nullptr, context_.get()));
+  }
+
+  /*! \brief create a new search using an existing pattern set
+   * \param  patterns              pattern set (the search adds itself as an owner)
+   * \param  mode                  match mode
+   * \throw  std::bad_alloc if the search handle can't be created
+   */
+  explicit finder (const patternset& patterns, unsigned int mode = MULTIFIND_MODE_LEFTMOST_FIRST) : context_(new context())
+  {
+    init(multifinder_create_with_patternset_and_mode(patterns.get(), mode, nullptr, nullptr, context_.get()));
+  }
+
+  finder (const finder&) = delete;
+  finder& operator= (const finder&) = delete;
+
+  finder (finder&& other) noexcept : context_(std::move(other.context_)), handle_(std::exchange(other.handle_, nullptr))
+  {
+  }
+
+  finder& operator= (finder&& other) noexcept
+  {
+    std::swap(context_, other.context_);
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  ~finder ()
+  {
+    if (handle_)
+      multifinder_free(handle_);
+  }
+
+  /*! \brief get the search handle for use with the C functions (it must stay in batch mode) */
+  ::multifinder get () const noexcept
+  {
+    return handle_;
+  }
+
+  /*! \brief add a search pattern (may contain NULL bytes)
+   * \return 0 on success or non-zero on error
+   * \sa     multifinder_add_patterns
+   */
+  int add_pattern (std::string_view pattern, unsigned int flags = MULTIFIND_PATTERN_CASE_SENSITIVE) noexcept
+  {
+    const char* data = pattern.data();
+    std::size_t datalen = pattern.size();
+    return multifinder_add_patterns(handle_, &data, &datalen, 1, flags, nullptr);
+  }
+
+  /*! \brief remove a search pattern
+   * \return 0 on success, 1 if the pattern wasn't found or -1 on error
+   * \sa     multifinder_remove_pattern
+   */
+  int remove_pattern (std::string_view pattern, unsigned int flags = MULTIFIND_PATTERN_CASE_SENSITIVE) noexcept
+  {
+    return multifinder_patternset_remove_pattern(multifinder_get_patternset(handle_), pattern.data(), pattern.size(), flags);
+  }
+
+  /*! \brief set which bytes are part of a word
+   * \sa     multifinder_set_word_bytes
+   */
+  int set_word_bytes (std::string_view wordbytes) noexcept
+  {
+    return multifinder_set_word_bytes(handle_, wordbytes.data(), wordbytes.size());
+  }
+
+  /*! \brief get the total number of patterns */
+  std::size_t count_patterns () const noexcept
+  {
+    return multifinder_count_patterns(handle_);
+  }
+
+  /*! \brief save the compiled patterns to a file
+   * \sa     multifinder_save_compiled
+   */
+  int save_compiled (const char* filename) noexcept
+  {
+    return multifinder_save_compiled(handle_, filename);
+  }
+
+  /*! \brief process the next block of data in the input stream
+   * \param  data                  data to search
+   * \param  found                 function object called as found(std::string_view match, std::size_t pattern) for each match
+   * \param  threads               number of threads to use for large blocks of data (0 for all processors)
+   * \return number of matches
+   * \sa     multifinder_process
+   * \sa     multifinder_process_parallel
+   */
+  template <typename F>
+  std::size_t process (std::string_view data, F&& found, unsigned int threads = 1)
+  {
+    std::size_t count;
+    set_callback(found, data);
+    count = (threads == 1 ? multifinder_process(handle_, data.data(), data.size()) : multifinder_process_parallel(handle_, data.data(), data.size(), threads));
+    keep_tail(data);
+    rethrow();
+    return count;
+  }
+
+  /*! \brief finish the input stream, reporting matches that were waiting for more data
+   * \param  found                 function object called as found(std::string_view match, std::size_t pattern) for each match
+   * \return number of matches
+   * \sa     multifinder_finalize
+   */
+  template <typename F>
+  std::size_t finalize (F&& found)
+  {
+    std::size_t count;
+    set_callback(found, std::string_view());
+    count = multifinder_finalize(handle_);
+    rethrow();
+    return count;
+  }
+
+  /*! \brief search a complete block of data (process() followed by finalize())
+   * \param  data                  data to search
+   * \param  found                 function object called as found(std::string_view match, std::size_t pattern) for each match
+   * \param  threads               number of threads to use for large blocks of data (0 for all processors)
+   * \return number of matches
+   */
+  template <typename F>
+  std::size_t scan (std::string_view data, F&& found, unsigned int threads = 1)
+  {
+    std::size_t count = process(data, found, threads);
+    return count + finalize(found);
+  }
+
+  /*! \brief start searching a new input stream
+   * \sa     multifinder_reset
+   */
+  void reset () noexcept
+  {
+    multifinder_reset(handle_);
+    context_->datapos = 0;
+    context_->tail.clear();
+    context_->error = nullptr;
+  }
+
+  /*! \brief get the abort status (non-zero if a callback aborted the search)
+   * \sa     multifinder_aborted
+   */
+  int aborted () const noexcept
+  {
+    return multifinder_aborted(handle_);
+  }
+
+private:
+  //number of matches the library collects before calling back
+  static constexpr std::size_t batch_size = 256;
+
+  //batch and callback data passed to the library (allocated separately so it doesn't move with the finder)
+  struct context {
+    multifinder_match batch[batch_size];
+    int (*deliver)(context* ctx, const multifinder_match* matches, std::size_t count);
+    void* found;
+    const char* data;                           //data being processed
+    std::size_t datapos;                        //position of data in the input stream
+    std::string tail;                           //end of the data processed before (ending at datapos)
+    std::string joined;                         //match that started in tail
+    std::exception_ptr error;                   //exception thrown by the callback
+    context () : deliver(nullptr), found(nullptr), data(nullptr), datapos(0)
+    {
+    }
+  };
+
+  void init (::multifinder handle)
+  {
+    if ((handle_ = handle) == nullptr)
+      throw std::bad_alloc();
+    multifinder_set_batch(handle_, context_->batch, batch_size, deliver_batch);
+  }
+
+  template <typename F>
+  void set_callback (F& found, std::string_view data) noexcept
+  {
+    context_->deliver = &deliver<F>;
+    context_->found = const_cast<void*>(static_cast<const void*>(std::addressof(found)));
+    context_->data = data.data();
+  }
+
+  //keep the end of the data, a match reported later can start in it
+  void keep_tail (std::string_view data)
+  {
+    std::string& tail = context_->tail;
+    std::size_t longest = multifinder_get_longest_pattern(handle_);
+    if (data.size() >= longest) {
+      tail.assign(data.data() + data.size() - longest, longest);
+    } else {
+      tail.append(data.data(), data.size());
+      if (tail.size() > longest)
+        tail.erase(0, tail.size() - longest);
+    }
+    context_->datapos += data.size();
+  }
+
+  void rethrow ()
+  {
+    if (context_->error)
+      std::rethrow_exception(std::exchange(context_->error, nullptr));
+  }
+
+  static int deliver_batch (const multifinder_match* matches, size_t count, void* callbackdata)
+  {
+    context* ctx = static_cast<context*>(callbackdata);
+    return (*ctx->deliver)(ctx, matches, count);
+  }
+
+  template <typename F>
+  static int deliver (context* ctx, const multifinder_match* matches, std::size_t count)
+  {
+    F& found = *static_cast<std::remove_reference_t<F>*>(ctx->found);
+    std::size_t i;
+    try {
+      for (i = 0; i < count; i++) {
+        std::string_view match;
+        if (matches[i].pos >= ctx->datapos) {
+          match = std::string_view(ctx->data + (matches[i].pos - ctx->datapos), matches[i].length);
+        } else {
+          //the match starts in data passed before
+          std::size_t start = ctx->tail.size() - (ctx->datapos - matches[i].pos);
+          std::size_t fromtail = (matches[i].length < ctx->tail.size() - start ? matches[i].length : ctx->tail.size() - start);
+          ctx->joined.assign(ctx->tail, start, fromtail);
+          ctx->joined.append(ctx->data, matches[i].length - fromtail);
+          match = ctx->joined;
+        }
+        if (detail::call_found(found, match, matches[i].pattern))
+          return 1;
+      }
+    } catch (...) {
+      ctx->error = std::current_exception();
+      return 1;
+    }
+    return 0;
+  }
+
+  std::unique_ptr<context> context_;
+  ::multifinder handle_;
+};
+
+/*! \brief automaton for a fixed list of keywords, built at compile time by make_keywords()
+ *
+ * The automaton is a table with the next state for each state and byte, like the dense automaton of the library.
+ * It finds the same matches as a search handle with the same match mode and the same flags for all keywords,
+ * using the default word bytes, but only searches a complete block of data.
+ * \tparam States  maximum number of states (one more than the total length of the keywords)
+ * \tparam Count   number of keywords
+ * \sa     make_keywords()
+ */
+template <std::size_t States, std::size_t Count>
+class keyword_matcher
+{
+public:
+  /*! \brief build the automaton (use make_keywords() instead)
+   * \param  mode                  match mode
+   * \param  flags                 flags used for all keywords
+   * \param  keywords              array of \p Count keywords (not empty)
+   */
+  constexpr keyword_matcher (unsigned int mode, unsigned int flags, const std::string_view* keywords) : mode_(mode), flags_(flags)
+  {
+    std::array<bool, States> haschildren {};
+    std::array<state_type, States> fail {};
+    std::array<state_type, States> queue {};
+    std::size_t count = 1;
+    std::uint32_t unique = 0;
+    std::size_t head = 0;
+    std::size_t tail = 0;
+    //build the trie, duplicate keywords are skipped and don't get an index (like duplicate patterns in the library)
+    for (std::size_t k = 0; k < Count; k++) {
+      std::size_t state = 0;
+      for (std::size_t i = 0; i < keywords[k].size(); i++) {
+        unsigned char c = static_cast<unsigned char>(keywords[k][i]);
+        std::size_t index = state * 256 + (flags & MULTIFIND_PATTERN_CASE_INSENSITIVE ? detail::fold(c) : c);
+        if (next_[index] == 0) {
+          next_[index] = static_cast<state_type>(count);
+          depth_[count] = static_cast<state_type>(depth_[state] + 1);
+          haschildren[state] = true;
+          count++;
+        }
+        state = next_[index];
+      }
+      if (keyword_[state] == 0)
+        keyword_[state] = ++unique;
+    }
+    //add the failure transitions in breadth first order, so the row of the failure state is complete before it is copied
+    for (std::size_t c = 0; c < 256; c++)
+      if (next_[c] != 0)
+        queue[tail++] = next_[c];
+    while (head < tail) {
+      std::size_t state = queue[head++];
+      std::size_t target = fail[state];
+      outlink_[state] = (keyword_[target] != 0 ? static_cast<state_type>(target) : outlink_[target]);
+      extdepth_[state] = (haschildren[state] ? depth_[state] : extdepth_[target]);
+      for (std::size_t c = 0; c < 256; c++) {
+        std::size_t child = next_[state * 256 + c];
+        if (child != 0) {
+          fail[child] = next_[target * 256 + c];
+          queue[tail++] = static_cast<state_type>(child);
+        } else {
+          next_[state * 256 + c] = next_[target * 256 + c];
+        }
+      }
+    }
+    //keywords were added in lower case, upper case letters go to the same states
+    if (flags & MULTIFIND_PATTERN_CASE_INSENSITIVE)
+      for (std::size_t state = 0; state < count; state++)
+        for (std::size_t c = 'A'; c <= 'Z'; c++)
+          next_[state * 256 + c] = next_[state * 256 + c - 'A' + 'a'];
+  }
+
+  /*! \brief search a complete block of data
+   * \param  data                  data to search
+   * \param  found                 function object called as found(std::string_view match, std::size_t pattern) for each match, with the index of the keyword (not counting duplicate keywords)
+   * \return number of matches
+   */
+  template <typename F>
+  std::size_t scan (std::string_view data, F&& found) const
+  {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    std::size_t datalen = data.size();
+    std::size_t count = 0;
+    std::size_t state = 0;
+    std::size_t pos = 0;
+    if (mode_ == MULTIFIND_MODE_OVERLAPPING) {
+      //report all keywords ending here, following the failure chain from the longest to the shortest
+      while (pos < datalen) {
+        std::size_t index;
+        state = next_[state * 256 + p[pos++]];
+        for (index = (keyword_[state] != 0 ? state : outlink_[state]); index != 0; index = outlink_[index]) {
+          std::size_t matchpos = pos - depth_[index];
+          if (check_anchors(p, datalen, matchpos, depth_[index])) {
+            count++;
+            if (detail::call_found(found, data.substr(matchpos, depth_[index]), keyword_[index] - 1))
+              return count;
+          }
+        }
+      }
+      return count;
+    }
+    //the match that starts first (and in case of a tie the first or longest keyword) is reported once no better match can follow, like scan() in the library
+    std::size_t matchstate = 0;
+    std::size_t matchpos = 0;
+    for (;;) {
+      while (pos < datalen) {
+        state = next_[state * 256 + p[pos++]];
+        if (keyword_[state] != 0 || outlink_[state] != 0)
+          find_match(p, datalen, state, pos, matchstate, matchpos);
+        if (matchstate != 0 && pos - extdepth_[state] > matchpos)
+          break;
+      }
+      if (matchstate == 0)
+        break;
+      count++;
+      if (detail::call_found(found, data.substr(matchpos, depth_[matchstate]), keyword_[matchstate] - 1))
+        return count;
+      //continue right after the match
+      pos = matchpos + depth_[matchstate];
+      state = 0;
+      matchstate = 0;
+    }
+    return count;
+  }
+
+  /*! \brief get the number of states in the automaton */
+  constexpr std::size_t count_states () const
+  {
+    std::size_t count = 1;
+    while (count < States && depth_[count] != 0)
+      count++;
+    return count;
+  }
+
+private:
+  using state_type = detail::state_type<States>;
+
+  //check the bytes around a match for keywords that must start or end at a word or line boundary
+  constexpr bool check_anchors (const unsigned char* p, std::size_t datalen, std::size_t pos, std::size_t len) const
+  {
+    if (pos > 0) {
+      unsigned char c = p[pos - 1];
+      if (((flags_ & MULTIFIND_PATTERN_WORD_BEFORE) && detail::is_word_byte(c)) || ((flags_ & MULTIFIND_PATTERN_LINE_START) && c != '\n'))
+        return false;
+    }
+    if (pos + len < datalen) {
+      unsigned char c = p[pos + len];
+      if (((flags_ & MULTIFIND_PATTERN_WORD_AFTER) && detail::is_word_byte(c)) || ((flags_ & MULTIFIND_PATTERN_LINE_END) && c != '\n' && c != '\r'))
+        return false;
+    }
+    return true;
+  }
+
+  //look for a match ending just before pos that takes precedence over the pending match (matchstate is 0 if none is pending)
+  constexpr void find_match (const unsigned char* p, std::size_t datalen, std::size_t state, std::size_t pos, std::size_t& matchstate, std::size_t& matchpos) const
+  {
+    std::size_t index;
+    for (index = (keyword_[state] != 0 ? state : outlink_[state]); index != 0; index = outlink_[index]) {
+      std::size_t start = pos - depth_[index];
+      //matches further down the failure chain are shorter and start later
+      if (matchstate != 0 && start > matchpos)
+        return;
+      //a match found later that starts at the same position is longer
+      if (matchstate != 0 && start == matchpos && keyword_[index] > keyword_[matchstate] && mode_ == MULTIFIND_MODE_LEFTMOST_FIRST)
+        continue;
+      if (check_anchors(p, datalen, start, depth_[index])) {
+        matchstate = index;
+        matchpos = start;
+      }
+    }
+  }
+
+  std::array<state_type, States * 256> next_ {};  //next state for each state and byte
+  std::array<std::uint32_t, States> keyword_ {};  //index of the unique keyword ending in each state plus one (0 if none)
+  std::array<state_type, States> outlink_ {};     //next state in the failure chain where a keyword ends (0 if none)
+  std::array<state_type, States> depth_ {};       //length of the data matched by each state
+  std::array<state_type, States> extdepth_ {};    //depth of the deepest state in the failure chain (including this one) that can still be extended
+  unsigned int mode_;
+  unsigned int flags_;
+};
+
+/*! \brief build the automaton for a fixed list of keywords at compile time
+ *
+ * Use as <tt>static constexpr auto keywords = multifind::make_keywords(MULTIFIND_MODE_LEFTMOST_FIRST, MULTIFIND_PATTERN_WHOLE_WORD, "foo", "bar");</tt>
+ * The size of the automaton is known from the lengths of the string literals. Its table has 256 entries per state,
+ * so this is meant for short lists of keywords, longer lists may also exceed the limits compilers put on constant evaluation.
+ * \param  mode                  match mode
+ * \param  flags                 flags used for all keywords (MULTIFIND_PATTERN_CASE_INSENSITIVE and the word and line flags)
+ * \param  keywords              string literals with the keywords (the terminating NULL byte is not part of the keyword)
+ * \return automaton for the keywords
+ * \sa     keyword_matcher
+ * \sa     MULTIFIND_MODE_*
+ * \sa     MULTIFIND_PATTERN_*
+ */
+template <std::size_t... L>
+constexpr keyword_matcher<(1 + ... + (L - 1)), sizeof...(L)> make_keywords (unsigned int mode, unsigned int flags, const char (&... keywords)[L])
+{
+  static_assert(sizeof...(L) > 0, "no keywords");
+  static_assert(((L > 1) && ...), "keywords can't be empty");
+  const std::string_view list[] = {std::string_view(keywords, L - 1)...};
+  return keyword_matcher<(1 + ... + (L - 1)), sizeof...(L)>(mode, flags, list);
+}
+
+/*! \brief build the automaton for a fixed list of case sensitive keywords at compile time, reporting the leftmost first match
+ * \param  keywords              string literals with the keywords
+ * \return automaton for the keywords
+ */
+template <std::size_t... L>
+constexpr keyword_matcher<(1 + ... + (L - 1)), sizeof...(L)> make_keywords (const char (&... keywords)[L])
+{
+  return make_keywords(MULTIFIND_MODE_LEFTMOST_FIRST, MULTIFIND_PATTERN_CASE_SENSITIVE, keywords...);
+}
+
+}
+
+#endif //INCLUDED_MULTIFINDER_HPP
@@ -23,32 +23,12 @@ SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 #include "multifinder.h"
+#include "multifinder_internal.h"
 
-#if defined(_MSC_VER) || (defined(__MINGW32__) && !defined(__MINGW64__))
-#define strncasecmp _strnicmp
-#endif
-
-struct multifinder_pattern_list {
-  char* data;                                           //pattern
-  size_t datalen;                                       //length of pattern
-  int (*strncmp_fn)(const char*, const char*, size_t);  //compare function
-  void* callbackdata;                                   //user callback data
-  struct multifinder_pattern_list* next;                //next entry in linked list
-};
-
-struct multifinder_struct {
-  struct multifinder_pattern_list* patterns;    //user callback function called on pattern match
-  multifinder_found_callback_fn foundfunction;  //user callback function called for each pattern match
-  multifinder_flush_callback_fn flushfunction;  //user callback function called for data without pattern match
-  void* callbackdata;                           //user callback data
-  //size_t shortestpattern;                       //length of shortest pattern
-  size_t longestpattern;                        //length of longest pattern
-  size_t streampos;                             //position in input stream (only updated at end of multifinder_process())
-  size_t flushedpos;                            //number of input stream bytes that have been sent processed (by multifinder_found_callback_fn or multifinder_found_callback_fn)
-  int abortstatus;                              //when non-zero a callback functions requested to abort
-  char* buf;                                    //buffer containing data that comes before data currently being processed
-  size_t buflen;                                //current length of buf
-};
+//stop using the prefilter if on average it skips less than this many bytes per candidate
+#define PREFILTER_MIN_SKIP 8
+//number of prefilter candidates after which its effectiveness is checked
+#define PREFILTER_CHECK_INTERVAL 64
 
 DLL_EXPORT_MULTIFINDER void multifinder_get_version (int* pmajor, int* pminor, int* pmicro)
 {
@@ -65,39 +45,101 @@ DLL_EXPORT_MULTIFINDER const char* multifinder_get_version_string ()
   return MULTIFINDER_VERSION_STRING;
 }
 
-DLL_EXPORT_MULTIFINDER multifinder multifinder_create (multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+static multifinder create_handle (multifinder_patternset patternset, unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
 {
   struct multifinder_struct* result;
+  if (mode > MULTIFIND_MODE_OVERLAPPING)
+    return NULL;
   if ((result = (struct multifinder_struct*)malloc(sizeof(struct multifinder_struct))) != NULL) {
-    result->patterns = NULL;
+    result->patternset = patternset;
+    result->automaton = NULL;
+    result->generation = 0;
+    result->live = NULL;
+    result->liveversion = 0;
     result->foundfunction = foundfunction;
     result->flushfunction = flushfunction;
     result->callbackdata = callbackdata;
-    //result->shortestpattern = 0;
-    result->longestpattern = 0;
+    result->mode = mode;
     result->streampos = 0;
     result->flushedpos = 0;
     result->abortstatus = 0;
+    result->state = 0;
+    result->matchpending = 0;
+    result->lookahead = 0;
+    result->context = -1;
+    result->matchpos = 0;
+    result->matchpattern = 0;
+    result->useprefilter = 0;
+    result->prefiltercandidates = 0;
+    result->prefilterskipped = 0;
     result->buf = NULL;
     result->buflen = 0;
+    result->bufsize = 0;
+    result->batch = NULL;
+    result->batchsize = 0;
+    result->batchcount = 0;
+    result->batchfunction = NULL;
+    result->outputfunction = NULL;
+    result->replacements = NULL;
+    result->replacementcount = 0;
+    result->segments = NULL;
+    result->segmentsize = 0;
+    result->segmentcount = 0;
+    result->outbuffer = NULL;
+    result->outbuffersize = 0;
+    result->outbufferlen = 0;
+    result->carry = NULL;
+    result->carrysize = 0;
+    result->carrylen = 0;
+    memset(&result->stats, 0, sizeof(multifinder_stats));
+    result->statsstreampos = 0;
+    result->patternmatches = NULL;
+    result->patternmatchescount = 0;
+    result->timing = 0;
   }
   return result;
 }
 
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create (multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+{
+  return multifinder_create_with_mode(MULTIFIND_MODE_LEFTMOST_FIRST, foundfunction, flushfunction, callbackdata);
+}
+
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_with_mode (unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+{
+  multifinder_patternset patternset;
+  multifinder result;
+  if ((patternset = multifinder_patternset_create()) == NULL)
+    return NULL;
+  if ((result = create_handle(patternset, mode, foundfunction, flushfunction, callbackdata)) == NULL)
+    multifinder_patternset_free(patternset);
+  return result;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_with_patternset (multifinder_patternset patternset, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+{
+  return multifinder_create_with_patternset_and_mode(patternset, MULTIFIND_MODE_LEFTMOST_FIRST, foundfunction, flushfunction, callbackdata);
+}
+
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_with_patternset_and_mode (multifinder_patternset patternset, unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+{
+  multifinder result;
+  if (!patternset || multifinder_patternset_compile(patternset) != 0)
+    return NULL;
+  if ((result = create_handle(patternset, mode, foundfunction, flushfunction, callbackdata)) != NULL)
+    multifinder_patternset_reference(patternset);
+  return result;
+}
+
 DLL_EXPORT_MULTIFINDER void multifinder_free (multifinder handle)
 {
   if (handle) {
-    struct multifinder_pattern_list* current;
-    struct multifinder_pattern_list* next;
-    current = handle->patterns;
-    while (current) {
-      next = current->next;
-      free(current->data);
-      free(current);
-      current = next;
-    }
+    multifinder_patternset_free(handle->patternset);
+    multifinder_live_free(handle->live);
     if(handle->buf)
       free(handle->buf);
+    free(handle->patternmatches);
+    free(handle->carry);
     free(handle);
   }
 }
@@ -105,217 +147,689 @@ DLL_EXPORT_MULTIFINDER void multifinder_free (multifinder handle)
 DLL_EXPORT_MULTIFINDER void multifinder_reset (multifinder handle)
 {
   if (handle) {
+    //statistics are kept
+    handle->stats.bytesprocessed += handle->streampos - handle->statsstreampos;
+    handle->statsstreampos = 0;
     handle->streampos = 0;
     handle->flushedpos = 0;
     handle->abortstatus = 0;
-    if(handle->buf)
-      free(handle->buf);
-    handle->buf = NULL;
+    //switch to the latest snapshot of a live pattern set before the new stream starts
+    handle->matchpending = 0;
+    if (handle->live)
+      multifinder_live_update_handle(handle);
+    //the automaton is released by the pattern set when patterns are added
+    if (handle->generation != handle->patternset->generation)
+      handle->automaton = NULL;
+    handle->state = (handle->automaton ? handle->automaton->root : 0);
+    handle->lookahead = 0;
+    handle->context = -1;
+    handle->useprefilter = (handle->automaton && handle->automaton->prefilter);
+    handle->prefiltercandidates = 0;
+    handle->prefilterskipped = 0;
     handle->buflen = 0;
+    handle->batchcount = 0;
+    handle->segmentcount = 0;
+    handle->outbufferlen = 0;
+    handle->carrylen = 0;
   }
 }
 
 DLL_EXPORT_MULTIFINDER void multifinder_add_pattern (multifinder handle, const char* pattern, unsigned int flags, void* patterncallbackdata)
 {
-  if (pattern && *pattern) {
-    char* s;
-    size_t len = strlen(pattern);
-    if ((s = (char*)malloc(len)) != NULL) {
-      memcpy(s, pattern, len);
-      multifinder_add_allocated_pattern(handle, s, len, flags, patterncallbackdata);
-    }
-  }
+  multifinder_patternset_add_pattern(handle->patternset, pattern, flags, patterncallbackdata);
 }
 
 DLL_EXPORT_MULTIFINDER void multifinder_add_allocated_pattern (multifinder handle, char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata)
 {
-  struct multifinder_pattern_list* entry;
-  struct multifinder_pattern_list** last;
-  //create new entry
-  entry = (struct multifinder_pattern_list*)malloc(sizeof(struct multifinder_pattern_list));
-  entry->data = pattern;
-  entry->datalen = patternlen;
-  entry->strncmp_fn = (flags & MULTIFIND_PATTERN_CASE_INSENSITIVE ? &strncasecmp : &strncmp);
-  entry->callbackdata = patterncallbackdata;
-  entry->next = NULL;
-  //add after last entry
-  last = &(handle->patterns);
-  while (*last) {
-    //abort if the same pattern was already added
-    if ((*last)->datalen == patternlen && (*last)->strncmp_fn == entry->strncmp_fn && strncmp((*last)->data, pattern, patternlen) == 0) {
-      free(entry);
-      return;
+  multifinder_patternset_add_allocated_pattern(handle->patternset, pattern, patternlen, flags, patterncallbackdata);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_add_patterns (multifinder handle, const char* const* patterns, const size_t* patternlens, size_t count, unsigned int flags, void* const* patterncallbackdata)
+{
+  return multifinder_patternset_add_patterns(handle->patternset, patterns, patternlens, count, flags, patterncallbackdata);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_add_patterns_from_file (multifinder handle, const char* filename, unsigned int flags)
+{
+  return multifinder_patternset_add_patterns_from_file(handle->patternset, filename, flags);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_remove_pattern (multifinder handle, const char* pattern, unsigned int flags)
+{
+  if (!pattern || !*pattern)
+    return 0;
+  return multifinder_patternset_remove_pattern(handle->patternset, pattern, strlen(pattern), flags);
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_count_patterns (multifinder handle)
+{
+  return multifinder_patternset_count_patterns(handle->patternset);
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_get_longest_pattern (multifinder handle)
+{
+  return multifinder_patternset_get_longest_pattern(handle->patternset);
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_get_pattern_memory (multifinder handle)
+{
+  return multifinder_patternset_get_pattern_memory(handle->patternset);
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_get_patternset (multifinder handle)
+{
+  return handle->patternset;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_set_automaton (multifinder handle, unsigned int type, size_t memorybudget)
+{
+  return multifinder_patternset_set_automaton(handle->patternset, type, memorybudget);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_set_word_bytes (multifinder handle, const char* wordbytes, size_t wordbyteslen)
+{
+  return multifinder_patternset_set_word_bytes(handle->patternset, wordbytes, wordbyteslen);
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_set_batch (multifinder handle, multifinder_match* matches, size_t maxmatches, multifinder_batch_callback_fn batchfunction)
+{
+  if (!matches || maxmatches == 0 || !batchfunction) {
+    matches = NULL;
+    maxmatches = 0;
+    batchfunction = NULL;
+  } else {
+    multifinder_set_replace(handle, NULL, 0, NULL, 0, NULL);
+  }
+  handle->batch = matches;
+  handle->batchsize = maxmatches;
+  handle->batchcount = 0;
+  handle->batchfunction = batchfunction;
+}
+
+void multifinder_ring_store (multifinder handle, size_t pos, const char* data, size_t datalen)
+{
+  size_t offset = pos & (handle->bufsize - 1);
+  size_t len;
+  //avoid the overhead of calling memcpy() for the few bytes typically added at once when processing small chunks
+  if (datalen <= 8) {
+    size_t mask = handle->bufsize - 1;
+    while (datalen-- > 0) {
+      handle->buf[offset] = handle->buf[offset + handle->bufsize] = *data++;
+      offset = (offset + 1) & mask;
     }
-    last = &((*last)->next);
+    return;
+  }
+  len = (datalen < handle->bufsize - offset ? datalen : handle->bufsize - offset);
+  memcpy(handle->buf + offset, data, len);
+  memcpy(handle->buf + handle->bufsize + offset, data, len);
+  if (datalen > len) {
+    memcpy(handle->buf, data + len, datalen - len);
+    memcpy(handle->buf + handle->bufsize, data + len, datalen - len);
   }
-  *last = entry;
-  //update values
-  //if (handle->shortestpattern == 0 || patternlen < handle->shortestpattern)
-  //  handle->shortestpattern = patternlen;
-  if (patternlen > handle->longestpattern)
-    handle->longestpattern = patternlen;
 }
 
-DLL_EXPORT_MULTIFINDER size_t multifinder_count_patterns (multifinder handle)
+//switch to the compiled pattern set (compiling it if needed), data kept in the buffer must be scanned again afterwards
+static int compile_patterns (multifinder handle)
 {
-  size_t count = 0;
-  struct multifinder_pattern_list* p = handle->patterns;
-  while (p) {
-    count++;
-    p = p->next;
+  size_t size;
+  handle->automaton = NULL;
+  if (multifinder_patternset_compile(handle->patternset) != 0)
+    return 0;
+  //make sure the ring buffer can hold the longest pattern plus the part of a match that is in the supplied data
+  size = 16;
+  while (size < handle->patternset->longestpattern * 2)
+    size *= 2;
+  if (handle->bufsize < size) {
+    char* oldbuf = handle->buf;
+    size_t oldsize = handle->bufsize;
+    if ((handle->buf = (char*)malloc(size * 2)) == NULL) {
+      handle->buf = oldbuf;
+      return 0;
+    }
+    handle->bufsize = size;
+    //move kept data to its position in the new ring buffer
+    if (handle->buflen > 0)
+      multifinder_ring_store(handle, handle->streampos - handle->buflen, oldbuf + ((handle->streampos - handle->buflen) & (oldsize - 1)), handle->buflen);
+    free(oldbuf);
   }
-  return count;
+  handle->automaton = (const struct multifinder_automaton*)MULTIFINDER_ATOMIC_LOAD_POINTER(&handle->patternset->automaton);
+  handle->generation = handle->patternset->generation;
+#ifndef MULTIFINDER_NO_STATS
+  //pattern indices never change (removed patterns are only marked), so existing counters keep their meaning
+  if (handle->patternmatchescount < handle->automaton->patterncount) {
+    unsigned long long* newpatternmatches;
+    if ((newpatternmatches = (unsigned long long*)realloc(handle->patternmatches, handle->automaton->patterncount * sizeof(unsigned long long))) != NULL) {
+      memset(newpatternmatches + handle->patternmatchescount, 0, (handle->automaton->patterncount - handle->patternmatchescount) * sizeof(unsigned long long));
+      handle->patternmatches = newpatternmatches;
+      handle->patternmatchescount = handle->automaton->patterncount;
+    }
+  }
+#endif
+  handle->state = handle->automaton->root;
+  handle->matchpending = 0;
+  handle->lookahead = 0;
+  handle->useprefilter = (handle->automaton->prefilter != NULL);
+  handle->prefiltercandidates = 0;
+  handle->prefilterskipped = 0;
+  return 1;
+}
+
+//get pointer to contiguous stream data, which may span the buffer and the supplied data
+static const char* get_data (multifinder handle, size_t pos, size_t len, const char* data)
+{
+  if (pos >= handle->streampos)
+    return data + (pos - handle->streampos);
+  //store the part in the supplied data after the buffered data (it is kept there if needed later)
+  if (pos + len > handle->streampos)
+    multifinder_ring_store(handle, handle->streampos, data, pos + len - handle->streampos);
+  return RING_DATA(handle, pos);
 }
 
-size_t flush_data (multifinder handle, size_t flushpos, const char* data)
+void multifinder_flush_data (multifinder handle, size_t flushpos, const char* data)
 {
   if (flushpos > handle->flushedpos) {
-    size_t flushlen = flushpos - handle->flushedpos;
-    if (!handle->flushfunction) {
-      handle->flushedpos = flushpos;
-    } else {
-      size_t flushremaining = flushlen;
-      //flush buffer first if needed
+    if (handle->outputfunction) {
+      MULTIFINDER_STAT(handle->stats.flushedbytes += flushpos - handle->flushedpos);
+      //data from the buffer must be copied
       if (handle->flushedpos < handle->streampos) {
-        size_t bufstartpos = (handle->flushedpos > (handle->streampos - handle->buflen) ? handle->flushedpos - (handle->streampos - handle->buflen) : 0);
-        size_t bufflushlen = (bufstartpos + flushremaining <= handle->buflen ? flushremaining : handle->buflen - bufstartpos);
-        if (bufflushlen > 0) {
-          (*(handle->flushfunction))(handle->buf + bufstartpos, bufflushlen, handle->callbackdata);
-          handle->flushedpos += bufflushlen;
-          flushremaining -= bufflushlen;
+        size_t bufflushlen = (flushpos < handle->streampos ? flushpos : handle->streampos) - handle->flushedpos;
+        if (!multifinder_output(handle, RING_DATA(handle, handle->flushedpos), bufflushlen, 1)) {
+          handle->flushedpos = flushpos;
+          return;
         }
+        handle->flushedpos += bufflushlen;
+      }
+      if (flushpos > handle->flushedpos)
+        multifinder_output(handle, data + (handle->flushedpos - handle->streampos), flushpos - handle->flushedpos, 0);
+    } else if (handle->flushfunction && !handle->batch) {
+      MULTIFINDER_STAT(unsigned long long starttime = (handle->timing ? multifinder_get_time() : 0));
+      MULTIFINDER_STAT(handle->stats.flushedbytes += flushpos - handle->flushedpos);
+      //flush buffer first if needed
+      if (handle->flushedpos < handle->streampos) {
+        size_t bufflushlen = (flushpos < handle->streampos ? flushpos : handle->streampos) - handle->flushedpos;
+        (*(handle->flushfunction))(RING_DATA(handle, handle->flushedpos), bufflushlen, handle->callbackdata);
+        MULTIFINDER_STAT(handle->stats.flushcalls++);
+        handle->flushedpos += bufflushlen;
       }
       //flush data up to position
-      if (flushremaining > 0 && flushpos > handle->streampos) {
-        size_t datastartpos = (handle->flushedpos > handle->streampos ? handle->flushedpos - handle->streampos : 0);
-        (*(handle->flushfunction))(data + datastartpos, flushremaining, handle->callbackdata);
-        handle->flushedpos += flushremaining;
+      if (flushpos > handle->flushedpos) {
+        (*(handle->flushfunction))(data + (handle->flushedpos - handle->streampos), flushpos - handle->flushedpos, handle->callbackdata);
+        MULTIFINDER_STAT(handle->stats.flushcalls++);
       }
+      MULTIFINDER_STAT(if (handle->timing) handle->stats.callbacktime += multifinder_get_time() - starttime);
     }
+    handle->flushedpos = flushpos;
   }
-  return flushpos;
 }
 
-DLL_EXPORT_MULTIFINDER size_t multifinder_process (multifinder handle, const char* data, size_t datalen)
+//get the byte before stream position pos (which can't be before the data kept in the buffer), returns -1 at the start of the stream
+static int byte_before (multifinder handle, size_t pos, const char* data)
+{
+  if (pos > handle->streampos)
+    return (unsigned char)data[pos - handle->streampos - 1];
+  if (pos > handle->streampos - handle->buflen)
+    return (unsigned char)*RING_DATA(handle, pos - 1);
+  return handle->context;
+}
+
+//check the bytes around a match of a pattern that must start or end at a word or line boundary, end is the end of the data that can be looked at (the end of the stream if a match ends there)
+static int check_anchors (multifinder handle, const struct multifinder_pattern* pattern, size_t pos, const char* data, size_t end)
 {
+  int c;
+  if (pattern->flags & MULTIFINDER_PATTERN_ANCHORS_BEFORE) {
+    c = byte_before(handle, pos, data);
+    if (c >= 0 && (((pattern->flags & MULTIFIND_PATTERN_WORD_BEFORE) && handle->automaton->wordbytes[c]) || ((pattern->flags & MULTIFIND_PATTERN_LINE_START) && c != '\n')))
+      return 0;
+  }
+  if (pattern->flags & MULTIFINDER_PATTERN_ANCHORS_AFTER) {
+    pos += pattern->datalen;
+    if (pos < end) {
+      c = (unsigned char)(pos >= handle->streampos ? data[pos - handle->streampos] : *RING_DATA(handle, pos));
+      if (((pattern->flags & MULTIFIND_PATTERN_WORD_AFTER) && handle->automaton->wordbytes[c]) || ((pattern->flags & MULTIFIND_PATTERN_LINE_END) && c != '\n' && c != '\r'))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+//check if a match found by the automaton is also a match for the pattern (for case folded data and patterns with word or line flags)
+static int verify_match (multifinder handle, const struct multifinder_pattern* pattern, size_t pos, const char* data, size_t end)
+{
+  if ((pattern->flags & (MULTIFINDER_PATTERN_ANCHORS_BEFORE | MULTIFINDER_PATTERN_ANCHORS_AFTER)) && !check_anchors(handle, pattern, pos, data, end))
+    return 0;
+  if (!handle->automaton->folded || !(pattern->flags & MULTIFINDER_PATTERN_FOLD_SENSITIVE))
+    return 1;
+  MULTIFINDER_STAT(handle->stats.comparisons++);
+  return (memcmp(get_data(handle, pos, pattern->datalen, data), handle->automaton->patterndata + pattern->offset, pattern->datalen) == 0);
+}
+
+//look for a match ending just before pos that takes precedence over the pending match
+static void find_match (multifinder handle, uint32_t state, size_t pos, const char* data, size_t end)
+{
+  const struct multifinder_automaton* automaton = handle->automaton;
+  uint32_t index = state >> automaton->stride2;
+  MULTIFINDER_STAT(handle->stats.candidates++);
+  if (automaton->states[index].outputcount == 0)
+    index = automaton->states[index].outlink;
+  while (index != MULTIFINDER_NO_STATE) {
+    const struct multifinder_automaton_state* info = automaton->states + index;
+    size_t matchpos = pos - info->depth;
+    uint32_t i;
+    //matches further down the failure chain are shorter and start later
+    if (handle->matchpending && matchpos > handle->matchpos)
+      return;
+    for (i = 0; i < info->outputcount; i++) {
+      uint32_t patternindex = automaton->outputs[info->outputs + i];
+      //a match found later that starts at the same position is longer
+      if (handle->matchpending && matchpos == handle->matchpos && patternindex > handle->matchpattern && handle->mode == MULTIFIND_MODE_LEFTMOST_FIRST)
+        break;
+      if (verify_match(handle, automaton->patterns + patternindex, matchpos, data, end)) {
+        handle->matchpending = 1;
+        handle->matchpos = matchpos;
+        handle->matchpattern = patternindex;
+        break;
+      }
+    }
+    index = info->outlink;
+  }
+}
+
+int multifinder_deliver_batch (multifinder handle)
+{
+  size_t count = handle->batchcount;
+  if (count > 0) {
+    MULTIFINDER_STAT(unsigned long long starttime = (handle->timing ? multifinder_get_time() : 0));
+    handle->batchcount = 0;
+    handle->abortstatus = (*handle->batchfunction)(handle->batch, count, handle->callbackdata);
+    MULTIFINDER_STAT(if (handle->timing) handle->stats.callbacktime += multifinder_get_time() - starttime);
+    if (handle->abortstatus != 0)
+      return 0;
+  }
+  return 1;
+}
+
+int multifinder_report (multifinder handle, size_t pos, uint32_t patternindex, const char* data)
+{
+  const struct multifinder_pattern* pattern = handle->automaton->patterns + patternindex;
+  void* patterncallbackdata = (handle->automaton->callbackdata ? handle->automaton->callbackdata[patternindex] : NULL);
+  size_t end = pos + pattern->datalen;
+  MULTIFINDER_STAT(handle->stats.matches++);
+  MULTIFINDER_STAT(if (patternindex < handle->patternmatchescount) handle->patternmatches[patternindex]++);
+  //in batch mode only store the match, data without match is implied
+  if (handle->batch) {
+    multifinder_match* match = handle->batch + handle->batchcount;
+    match->pos = pos;
+    match->length = pattern->datalen;
+    match->pattern = patternindex;
+    match->patterncallbackdata = patterncallbackdata;
+    if (end > handle->flushedpos)
+      handle->flushedpos = end;
+    if (++handle->batchcount == handle->batchsize)
+      return multifinder_deliver_batch(handle);
+    return 1;
+  }
+  //in replace mode add the data before the match and the replacement to the output
+  if (handle->outputfunction) {
+    const multifinder_segment* replacement = (handle->replacements ? (patternindex < handle->replacementcount ? handle->replacements + patternindex : NULL) : (const multifinder_segment*)patterncallbackdata);
+    multifinder_flush_data(handle, pos, data);
+    if (handle->abortstatus != 0)
+      return 0;
+    //without replacement the match itself is kept
+    if (!(replacement ? multifinder_output(handle, replacement->data, replacement->datalen, 0) : multifinder_output(handle, get_data(handle, pos, pattern->datalen, data), pattern->datalen, pos < handle->streampos)))
+      return 0;
+    handle->flushedpos = end;
+    return 1;
+  }
+  //flush data (overlapping matches can't be split from the data, so then all data is flushed)
+  multifinder_flush_data(handle, (handle->mode == MULTIFIND_MODE_OVERLAPPING ? end : pos), data);
+  //call callback
+  if (handle->foundfunction) {
+    MULTIFINDER_STAT(unsigned long long starttime = (handle->timing ? multifinder_get_time() : 0));
+    handle->abortstatus = (*handle->foundfunction)(get_data(handle, pos, pattern->datalen, data), pattern->datalen, patterncallbackdata, handle->callbackdata);
+    MULTIFINDER_STAT(if (handle->timing) handle->stats.callbacktime += multifinder_get_time() - starttime);
+    if (handle->abortstatus != 0)
+      return 0;
+  }
+  if (end > handle->flushedpos)
+    handle->flushedpos = end;
+  return 1;
+}
+
+//get the next state of a compact automaton, following failure links until a state with a transition for the byte class is found
+static uint32_t compact_next (const struct multifinder_automaton* automaton, uint32_t state, unsigned int c)
+{
+  while (state != automaton->root) {
+    uint32_t base = automaton->base[state];
+    if (base & MULTIFINDER_COMPACT_SINGLE) {
+      if (automaton->labels[state] == c)
+        return base & ~MULTIFINDER_COMPACT_SINGLE;
+    } else if (automaton->slots[base + c].check == state) {
+      return automaton->slots[base + c].next;
+    }
+    state = automaton->fail[state];
+  }
+  return automaton->rootnext[c];
+}
+
+//run a compact automaton on data until a state with matches is reached, returns where the automaton stopped
+static const unsigned char* scan_compact (const struct multifinder_automaton* automaton, const unsigned char* p, const unsigned char* end, uint32_t* pstate)
+{
+  const unsigned char* classmap = automaton->classmap;
+  uint32_t matchlimit = automaton->matchlimit;
+  uint32_t state = *pstate;
+  while (p < end) {
+    state = compact_next(automaton, state, classmap[*p++]);
+    if (state < matchlimit)
+      break;
+  }
+  *pstate = state;
+  return p;
+}
+
+//run the automaton on data, using the prefilter to skip data while in the start state, returns where the automaton stopped
+static const unsigned char* scan_prefiltered (multifinder handle, const unsigned char* p, const unsigned char* end, uint32_t* pstate)
+{
+  const struct multifinder_automaton* automaton = handle->automaton;
+  const struct multifinder_prefilter* prefilter = automaton->prefilter;
+  const uint32_t* trans = automaton->trans;
+  const unsigned char* classmap = automaton->classmap;
+  uint32_t matchlimit = automaton->matchlimit;
+  uint32_t root = automaton->root;
+  uint32_t state = *pstate;
+  const unsigned char* start = p;
+  const unsigned char* candidate = NULL;
+  while (p < end) {
+    if (state == root && handle->useprefilter && (size_t)(end - p) >= prefilter->length) {
+      candidate = (*prefilter->find)(prefilter, p, end);
+      handle->prefilterskipped += candidate - p;
+      MULTIFINDER_STAT(handle->stats.bytesskipped += candidate - p);
+      if ((p = candidate) == end)
+        break;
+      //stop using the prefilter if it doesn't skip enough data
+      if (++handle->prefiltercandidates == PREFILTER_CHECK_INTERVAL) {
+        if (handle->prefilterskipped < PREFILTER_CHECK_INTERVAL * PREFILTER_MIN_SKIP)
+          handle->useprefilter = 0;
+        handle->prefiltercandidates = 0;
+        handle->prefilterskipped = 0;
+      }
+    }
+    state = (trans ? trans[state + classmap[*p]] : compact_next(automaton, state, classmap[*p]));
+    p++;
+    if (state < matchlimit)
+      break;
+    //once no pattern can start at the candidate any more look for the next candidate from where the partial match starts
+    if (candidate && prefilter->restart && state != root && handle->useprefilter) {
+      uint32_t depth = automaton->states[state >> automaton->stride2].depth;
+      if ((size_t)(p - candidate) > depth && (size_t)(p - start) >= depth) {
+        p -= depth;
+        candidate = p;
+        state = root;
+      }
+    }
+  }
+  *pstate = state;
+  return p;
+}
+
+//run the automaton from stream position pos (which may be in the buffer) to the end of the supplied data
+static size_t scan (multifinder handle, size_t pos, const char* data, size_t datalen, int final)
+{
+  const struct multifinder_automaton* automaton = handle->automaton;
+  const uint32_t* trans = automaton->trans;
+  const unsigned char* classmap = automaton->classmap;
+  uint32_t matchlimit = automaton->matchlimit;
+  uint32_t state = handle->state;
+  size_t end = handle->streampos + datalen;
   size_t count = 0;
-  if (handle->abortstatus == 0) {
-    struct multifinder_pattern_list* pattern;
-    size_t i;
-    //scan buffer padded with length of longest pattern - 1 bytes of new data
-    if (handle->buf && handle->buflen > 0) {
-      //pad buffer with length of longest pattern - 1 bytes of new data
-      memcpy(handle->buf + handle->buflen, data, handle->longestpattern - 1);
-      //scan each position in the extended buffer
-      for (i = 0; i < handle->buflen; i++) {
-        //check for match with each pattern
-        pattern = handle->patterns;
-        while (pattern) {
-          if ((*(pattern->strncmp_fn))(handle->buf + i, pattern->data, pattern->datalen) == 0) {
-            //match found
-            count++;
-            //flush data
-            flush_data(handle, handle->streampos - handle->buflen + i, data);
-            //call callback
-            if (handle->foundfunction && (handle->abortstatus = (*handle->foundfunction)(handle->buf + i, pattern->datalen, pattern->callbackdata, handle->callbackdata)) != 0) {
-              //abort when requested by callback function
-              handle->streampos += datalen;
-              return count;
+  //matches ending where the previous data ended are checked first
+  int resume = handle->lookahead;
+  handle->lookahead = 0;
+  for (;;) {
+    while (pos < end || resume) {
+      if (resume) {
+        //nothing is scanned, only the matches ending here are checked
+        resume = 0;
+      } else {
+        const unsigned char* p;
+        const unsigned char* segend;
+        //data before the stream position is in the buffer
+        if (pos < handle->streampos) {
+          p = (const unsigned char*)RING_DATA(handle, pos);
+          segend = p + (handle->streampos - pos);
+        } else {
+          p = (const unsigned char*)data + (pos - handle->streampos);
+          segend = p + (end - pos);
+        }
+        if (!handle->matchpending) {
+          //no match pending, only states with matches need attention
+          const unsigned char* q = p;
+          if (handle->useprefilter) {
+            q = scan_prefiltered(handle, q, segend, &state);
+          } else if (!trans) {
+            q = scan_compact(automaton, q, segend, &state);
+          } else {
+            while (q < segend) {
+              state = trans[state + classmap[*q++]];
+              if (state < matchlimit)
+                break;
             }
-            handle->flushedpos += pattern->datalen;
-            i += pattern->datalen - 1;
+          }
+          pos += q - p;
+          MULTIFINDER_STAT(handle->stats.bytesscanned += q - p);
+          if (state >= matchlimit)
+            continue;
+        } else {
+          state = (trans ? trans[state + classmap[*p]] : compact_next(automaton, state, classmap[*p]));
+          pos++;
+          MULTIFINDER_STAT(handle->stats.bytesscanned++);
+        }
+      }
+      if (state < matchlimit) {
+        //matches of patterns that depend on the next byte can only be checked once it is known
+        if (pos == end && !final && (automaton->anchors & MULTIFINDER_PATTERN_ANCHORS_AFTER)) {
+          //a pending match that starts before all of them can still be reported
+          if (!handle->matchpending || pos - automaton->states[state >> automaton->stride2].depth <= handle->matchpos) {
+            handle->lookahead = 1;
             break;
           }
-          pattern = pattern->next;
+        } else {
+          find_match(handle, state, pos, data, end);
         }
       }
+      //report pending match as soon as no match can follow that starts at the same position or before it
+      if (handle->matchpending && pos - automaton->states[state >> automaton->stride2].extdepth > handle->matchpos) {
+        count++;
+        handle->matchpending = 0;
+        if (!multifinder_report(handle, handle->matchpos, handle->matchpattern, data))
+          return count;
+        //continue right after the match
+        pos = handle->flushedpos;
+        state = automaton->root;
+      }
     }
-    //scan rest of supplied data
-    for (i = 0; i + handle->longestpattern <= datalen; i++) {
-      pattern = handle->patterns;
-      while (pattern) {
-        if ((*(pattern->strncmp_fn))(data + i, pattern->data, pattern->datalen) == 0) {
-          //match found
+    //at the end of the stream no other match can follow
+    if (!final || !handle->matchpending)
+      break;
+    count++;
+    handle->matchpending = 0;
+    if (!multifinder_report(handle, handle->matchpos, handle->matchpattern, data))
+      return count;
+    pos = handle->flushedpos;
+    state = automaton->root;
+  }
+  handle->state = state;
+  return count;
+}
+
+//run the automaton from stream position pos (which may be in the buffer) to the end of the supplied data, reporting all matches where they end
+static size_t scan_overlapping (multifinder handle, size_t pos, const char* data, size_t datalen, int final)
+{
+  const struct multifinder_automaton* automaton = handle->automaton;
+  const uint32_t* trans = automaton->trans;
+  const unsigned char* classmap = automaton->classmap;
+  uint32_t matchlimit = automaton->matchlimit;
+  uint32_t state = handle->state;
+  size_t end = handle->streampos + datalen;
+  size_t count = 0;
+  //matches ending where the previous data ended are checked first
+  int resume = handle->lookahead;
+  handle->lookahead = 0;
+  while (pos < end || resume) {
+    uint32_t index;
+    if (resume) {
+      //nothing is scanned, only the matches ending here are checked
+      resume = 0;
+    } else {
+      const unsigned char* p;
+      const unsigned char* q;
+      const unsigned char* segend;
+      //data before the stream position is in the buffer
+      if (pos < handle->streampos) {
+        p = (const unsigned char*)RING_DATA(handle, pos);
+        segend = p + (handle->streampos - pos);
+      } else {
+        p = (const unsigned char*)data + (pos - handle->streampos);
+        segend = p + (end - pos);
+      }
+      q = p;
+      if (handle->useprefilter) {
+        q = scan_prefiltered(handle, q, segend, &state);
+      } else if (!trans) {
+        q = scan_compact(automaton, q, segend, &state);
+      } else {
+        while (q < segend) {
+          state = trans[state + classmap[*q++]];
+          if (state < matchlimit)
+            break;
+        }
+      }
+      pos += q - p;
+      MULTIFINDER_STAT(handle->stats.bytesscanned += q - p);
+    }
+    //matches ending here were already reported if the buffer is scanned again after patterns were added
+    if (state >= matchlimit || pos <= handle->flushedpos)
+      continue;
+    //matches of patterns that depend on the next byte can only be checked once it is known
+    if (pos == end && !final && (automaton->anchors & MULTIFINDER_PATTERN_ANCHORS_AFTER)) {
+      handle->lookahead = 1;
+      break;
+    }
+    //report all patterns ending here, following the failure chain from the longest to the shortest
+    MULTIFINDER_STAT(handle->stats.candidates++);
+    index = state >> automaton->stride2;
+    if (automaton->states[index].outputcount == 0)
+      index = automaton->states[index].outlink;
+    while (index != MULTIFINDER_NO_STATE) {
+      const struct multifinder_automaton_state* info = automaton->states + index;
+      size_t matchpos = pos - info->depth;
+      uint32_t i;
+      for (i = 0; i < info->outputcount; i++) {
+        uint32_t patternindex = automaton->outputs[info->outputs + i];
+        if (verify_match(handle, automaton->patterns + patternindex, matchpos, data, end)) {
           count++;
-          //flush data
-          flush_data(handle, handle->streampos + i, data);
-          //call callback
-          if (handle->foundfunction && (handle->abortstatus = (*handle->foundfunction)(data + i, pattern->datalen, pattern->callbackdata, handle->callbackdata)) != 0) {
-            //abort when requested by callback function
-            handle->streampos += datalen;
+          if (!multifinder_report(handle, matchpos, patternindex, data)) {
+            handle->state = state;
             return count;
           }
-          handle->flushedpos += pattern->datalen;
-          i += pattern->datalen - 1;
-          break;
         }
-        pattern = pattern->next;
       }
+      index = info->outlink;
     }
-    //if buffer is not allocated yet allocate it with the size of the longest pattern
-    size_t bufsize = handle->longestpattern - 1;
-    if (!handle->buf)
-      handle->buf = (char*)malloc(bufsize * 2);
-    //keep data in buffer for the next time
-    if (handle->buflen + datalen <= bufsize) {
-      //existing + supplied data is shorter than longest pattern => append all supplied data to buffer
-      memcpy(handle->buf + handle->buflen, data, datalen);
-      handle->buflen += datalen;
-    } else {
-      //existing + supplied data is longer than longest pattern => keep what is needed of buffer and append data needed
-      if (datalen >= bufsize) {
-        //supplied data is longer than longest pattern
-        //flush data
-        flush_data(handle, handle->streampos + datalen - bufsize, data);
-        //copy from end of supplied data
-        memcpy(handle->buf, data + datalen - bufsize, bufsize);
-      } else {
-        //supplied data is shorter than longest pattern
-        size_t bufreuselen = bufsize - datalen;
-        //flush data
-        if (handle->flushedpos < handle->streampos - bufreuselen)
-          flush_data(handle, handle->streampos - bufreuselen, data);
-        //keep needed part of buffer add supplied data
-        memmove(handle->buf, handle->buf + handle->buflen - bufreuselen, bufreuselen);
-        memcpy(handle->buf + bufreuselen, data, datalen);
+  }
+  handle->state = state;
+  return count;
+}
+
+//flush data that can no longer be part of a match and keep the rest in the buffer
+static void keep_data (multifinder handle, const char* data, size_t datalen)
+{
+  size_t keeplen = handle->automaton->states[handle->state >> handle->automaton->stride2].depth;
+  //remember the byte before the kept data for patterns that depend on the byte before a match
+  handle->context = byte_before(handle, handle->streampos + datalen - keeplen, data);
+  multifinder_flush_data(handle, handle->streampos + datalen - keeplen, data);
+  //data that is already in the ring buffer stays where it is, only new data is added
+  if (keeplen > 0) {
+    size_t len = (keeplen < datalen ? keeplen : datalen);
+    multifinder_ring_store(handle, handle->streampos + datalen - len, data + datalen - len, len);
+  }
+  handle->buflen = keeplen;
+}
+
+size_t multifinder_process_data (multifinder handle, const char* data, size_t datalen)
+{
+  size_t count = 0;
+  if (handle->live && handle->abortstatus == 0)
+    multifinder_live_update_handle(handle);
+  if (handle->abortstatus == 0) {
+    size_t pos = handle->streampos;
+    //compile patterns if needed and scan the data kept in the buffer again
+    if (!handle->automaton || handle->generation != handle->patternset->generation) {
+      if (!compile_patterns(handle)) {
+        handle->abortstatus = -1;
+        handle->streampos += datalen;
+        return 0;
       }
-      handle->buflen = bufsize;
+      pos = handle->streampos - handle->buflen;
     }
+    if (handle->mode == MULTIFIND_MODE_OVERLAPPING)
+      count = scan_overlapping(handle, pos, data, datalen, 0);
+    else
+      count = scan(handle, pos, data, datalen, 0);
+    if (handle->abortstatus == 0)
+      keep_data(handle, data, datalen);
   }
   handle->streampos += datalen;
   return count;
 }
 
+DLL_EXPORT_MULTIFINDER size_t multifinder_process (multifinder handle, const char* data, size_t datalen)
+{
+  size_t count;
+  MULTIFINDER_STAT(unsigned long long starttime = (handle->timing ? multifinder_get_time() : 0));
+  count = multifinder_process_data(handle, data, datalen);
+  //deliver what refers to the supplied data while it is still valid
+  if (handle->batch && handle->abortstatus == 0)
+    multifinder_deliver_batch(handle);
+  else if (handle->outputfunction && handle->abortstatus == 0)
+    multifinder_deliver_output(handle);
+  MULTIFINDER_STAT(if (handle->timing) handle->stats.totaltime += multifinder_get_time() - starttime);
+  return count;
+}
+
 DLL_EXPORT_MULTIFINDER size_t multifinder_finalize (multifinder handle)
 {
-  struct multifinder_pattern_list* pattern;
   size_t count = 0;
-  size_t i = 0;
-  while (i < handle->buflen) {
-    pattern = handle->patterns;
-    while (pattern) {
-      if (i <= handle->buflen - pattern->datalen) {
-        if ((*(pattern->strncmp_fn))(handle->buf + i, pattern->data, pattern->datalen) == 0) {
-          //match found
-          count++;
-          //flush data
-          flush_data(handle, handle->streampos - handle->buflen + i, NULL);
-          //call callback
-          if (handle->foundfunction && (*handle->foundfunction)(handle->buf + i, pattern->datalen, pattern->callbackdata, handle->callbackdata) != 0) {
-            return count;
-          }
-          handle->flushedpos += pattern->datalen;
-          i += count;
-          continue;
-        }
+  MULTIFINDER_STAT(unsigned long long starttime = (handle->timing ? multifinder_get_time() : 0));
+  if (handle->live && handle->abortstatus == 0)
+    multifinder_live_update_handle(handle);
+  if (handle->abortstatus == 0) {
+    size_t pos = handle->streampos;
+    //compile patterns if needed and scan the data kept in the buffer again
+    if (!handle->automaton || handle->generation != handle->patternset->generation) {
+      if (!compile_patterns(handle)) {
+        handle->abortstatus = -1;
+        return 0;
       }
-      pattern = pattern->next;
+      pos = handle->streampos - handle->buflen;
+    }
+    if (handle->mode == MULTIFIND_MODE_OVERLAPPING)
+      count = scan_overlapping(handle, pos, NULL, 0, 1);
+    else
+      count = scan(handle, pos, NULL, 0, 1);
+    if (handle->batch && handle->abortstatus == 0)
+      multifinder_deliver_batch(handle);
+    if (handle->abortstatus == 0) {
+      multifinder_flush_data(handle, handle->streampos, NULL);
+      if (handle->outputfunction && handle->abortstatus == 0)
+        multifinder_deliver_output(handle);
+      else if (handle->flushfunction && !handle->batch)
+        (*(handle->flushfunction))(NULL, 0, handle->callbackdata);
+      handle->context = byte_before(handle, handle->streampos, NULL);
+      handle->state = handle->automaton->root;
+      handle->buflen = 0;
     }
-    i++;
   }
-  flush_data(handle, handle->streampos, NULL);
-  if (handle->flushfunction)
-    (*(handle->flushfunction))(NULL, 0, handle->callbackdata);
+  MULTIFINDER_STAT(if (handle->timing) handle->stats.totaltime += multifinder_get_time() - starttime);
   return count;
 }
 
@@ -328,3 +842,44 @@ DLL_EXPORT_MULTIFINDER size_t multifinder_position (multifinder handle)
 {
   return handle->flushedpos;
 }
+
+void multifinder_add_scan_stats (multifinder handle, const multifinder_stats* stats)
+{
+  handle->stats.bytesscanned += stats->bytesscanned;
+  handle->stats.bytesskipped += stats->bytesskipped;
+  handle->stats.candidates += stats->candidates;
+  handle->stats.comparisons += stats->comparisons;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_get_stats (multifinder handle, multifinder_stats* stats)
+{
+  const struct multifinder_automaton* automaton = (const struct multifinder_automaton*)MULTIFINDER_ATOMIC_LOAD_POINTER(&handle->patternset->automaton);
+  *stats = handle->stats;
+  stats->bytesprocessed += handle->streampos - handle->statsstreampos;
+  stats->patternmemory = multifinder_patternset_get_pattern_memory(handle->patternset);
+  stats->automatonmemory = (automaton ? multifinder_automaton_memory(automaton) : 0);
+  stats->automatontype = (automaton ? automaton->type : 0);
+  stats->prefiltermemory = (automaton && automaton->prefilter ? multifinder_prefilter_memory(automaton->prefilter) : 0);
+  stats->prefilterfalsepositiverate = (automaton && automaton->prefilter ? automaton->prefilter->falsepositiverate : 0);
+  stats->buffermemory = handle->bufsize * 2;
+  stats->patterncount = handle->patternmatchescount;
+  stats->patternmatches = handle->patternmatches;
+#ifdef MULTIFINDER_NO_STATS
+  return -1;
+#else
+  return 0;
+#endif
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_reset_stats (multifinder handle)
+{
+  memset(&handle->stats, 0, sizeof(multifinder_stats));
+  handle->statsstreampos = handle->streampos;
+  if (handle->patternmatches)
+    memset(handle->patternmatches, 0, handle->patternmatchescount * sizeof(unsigned long long));
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_set_stats_timing (multifinder handle, int enable)
+{
+  handle->timing = enable;
+}
@@ -0,0 +1,573 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Aho-Corasick automaton compiled from the list of search patterns.
+
+  The patterns are first stored in a trie, which is built breadth first from
+  the patterns sorted by their bytes, so the children of each node are
+  numbered consecutively and sorted by byte class. Failure links are then
+  computed breadth first. Bytes that are not distinguished by any pattern
+  share the same byte class.
+  From the trie one of two kinds of automata is built:
+  - a dense automaton, in which the failure links are used to fill in all
+    missing transitions, which results in a deterministic automaton that needs
+    exactly one table lookup per input byte, regardless of the number of
+    patterns
+  - a compact automaton, which only stores the transitions of the trie itself
+    in a double array (the transitions of a state are at a fixed base position
+    plus the byte class and each slot records the state it belongs to) and
+    follows failure links while scanning, states with a single child keep
+    their transition in the state itself so the tails of patterns don't take
+    up slots
+  In both, states in which patterns end are numbered first, so the scanner
+  only needs to compare the state number to know if it needs to look for
+  matches.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "multifinder_internal.h"
+
+//without a memory budget automata with a larger dense transition table are compiled as compact automata
+#define AUTOMATON_DENSE_MAX_MEMORY ((size_t)256 * 1024 * 1024)
+//ranges of patterns with less entries than this are sorted by insertion instead of by counting
+#define TRIE_INSERTION_SORT 16
+//number of times a free slot of the double array is tried before it is given up on
+#define SLOT_MAX_TRIES 16
+
+struct trie_builder {
+  uint32_t* firstchild;                         //first child of each node (the children of a node are numbered consecutively in order of byte class)
+  uint16_t* childcount;                         //number of children of each node
+  unsigned char* label;                         //byte class of the transition leading to each node
+  uint32_t* depth;                              //depth of each node
+  uint32_t* rangestart;                         //first entry in the sorted list of patterns that start with the input leading to each node
+  uint32_t* rangeend;                           //end of the entries in the sorted list of patterns that start with the input leading to each node
+  uint32_t count;                               //number of nodes
+  uint32_t size;                                //number of allocated nodes
+};
+
+static uint32_t trie_add_node (struct trie_builder* trie, uint32_t depth, unsigned char label, uint32_t rangestart, uint32_t rangeend)
+{
+  if (trie->count == trie->size) {
+    uint32_t newsize = (trie->size ? trie->size * 2 : 256);
+    void* p;
+    //state numbers must leave room for MULTIFINDER_COMPACT_SINGLE
+    if (newsize <= trie->size || newsize > MULTIFINDER_COMPACT_SINGLE)
+      return 0;
+    if ((p = realloc(trie->firstchild, newsize * sizeof(uint32_t))) == NULL)
+      return 0;
+    trie->firstchild = (uint32_t*)p;
+    if ((p = realloc(trie->childcount, newsize * sizeof(uint16_t))) == NULL)
+      return 0;
+    trie->childcount = (uint16_t*)p;
+    if ((p = realloc(trie->label, newsize)) == NULL)
+      return 0;
+    trie->label = (unsigned char*)p;
+    if ((p = realloc(trie->depth, newsize * sizeof(uint32_t))) == NULL)
+      return 0;
+    trie->depth = (uint32_t*)p;
+    if ((p = realloc(trie->rangestart, newsize * sizeof(uint32_t))) == NULL)
+      return 0;
+    trie->rangestart = (uint32_t*)p;
+    if ((p = realloc(trie->rangeend, newsize * sizeof(uint32_t))) == NULL)
+      return 0;
+    trie->rangeend = (uint32_t*)p;
+    trie->size = newsize;
+  }
+  trie->firstchild[trie->count] = 0;
+  trie->childcount[trie->count] = 0;
+  trie->label[trie->count] = label;
+  trie->depth[trie->count] = depth;
+  trie->rangestart[trie->count] = rangestart;
+  trie->rangeend[trie->count] = rangeend;
+  return trie->count++;
+}
+
+//get the child of a node for a byte class (0 if there is none, as no transition leads back to the root)
+static uint32_t trie_child (const struct trie_builder* trie, uint32_t node, unsigned int c)
+{
+  uint32_t lo = trie->firstchild[node];
+  uint32_t hi = lo + trie->childcount[node];
+  uint32_t end = hi;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (trie->label[mid] < c)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (lo < end && trie->label[lo] == c ? lo : 0);
+}
+
+//sort key of a pattern at a depth in the trie: 0 if the pattern ends there, otherwise its byte class plus one
+static unsigned int pattern_key (const struct multifinder_automaton* automaton, uint32_t index, uint32_t depth)
+{
+  const struct multifinder_pattern* pattern = automaton->patterns + index;
+  if (pattern->datalen == depth)
+    return 0;
+  return automaton->classmap[(unsigned char)automaton->patterndata[pattern->offset + depth]] + 1U;
+}
+
+//sort a range of pattern indices by their key at a depth in the trie (stable, so patterns ending in the same node stay in order of precedence)
+static void sort_patterns (const struct multifinder_automaton* automaton, uint32_t* order, uint32_t* buffer, uint32_t count, uint32_t depth)
+{
+  uint32_t i;
+  if (count < TRIE_INSERTION_SORT) {
+    for (i = 1; i < count; i++) {
+      uint32_t index = order[i];
+      unsigned int key = pattern_key(automaton, index, depth);
+      uint32_t j = i;
+      while (j > 0 && pattern_key(automaton, order[j - 1], depth) > key) {
+        order[j] = order[j - 1];
+        j--;
+      }
+      order[j] = index;
+    }
+  } else {
+    uint32_t start[258];
+    unsigned int key;
+    memset(start, 0, sizeof(start));
+    for (i = 0; i < count; i++)
+      start[pattern_key(automaton, order[i], depth) + 1]++;
+    for (key = 1; key < 258; key++)
+      start[key] += start[key - 1];
+    for (i = 0; i < count; i++)
+      buffer[start[pattern_key(automaton, order[i], depth)]++] = order[i];
+    memcpy(order, buffer, count * sizeof(uint32_t));
+  }
+}
+
+struct slot_builder {
+  struct multifinder_compact_slot* slots;       //double array
+  uint32_t* nextfree;                           //next unused slot that can still be tried (or MULTIFINDER_NO_STATE)
+  uint32_t* prevfree;                           //previous unused slot that can still be tried (or MULTIFINDER_NO_STATE)
+  unsigned char* tries;                         //number of times each unused slot was tried
+  uint32_t firstfree;                           //first unused slot that can still be tried (or MULTIFINDER_NO_STATE)
+  uint32_t lastfree;                            //last unused slot that can still be tried (or MULTIFINDER_NO_STATE)
+  uint32_t size;                                //number of allocated slots
+};
+
+//add unused slots so there are at least minsize, returns zero on error
+static int slots_grow (struct slot_builder* builder, uint64_t minsize)
+{
+  uint64_t newsize = (builder->size ? builder->size : 1024);
+  uint32_t i;
+  void* p;
+  while (newsize < minsize)
+    newsize *= 2;
+  if (newsize > MULTIFINDER_COMPACT_SINGLE)
+    return 0;
+  if ((p = realloc(builder->slots, (size_t)newsize * sizeof(struct multifinder_compact_slot))) == NULL)
+    return 0;
+  builder->slots = (struct multifinder_compact_slot*)p;
+  if ((p = realloc(builder->nextfree, (size_t)newsize * sizeof(uint32_t))) == NULL)
+    return 0;
+  builder->nextfree = (uint32_t*)p;
+  if ((p = realloc(builder->prevfree, (size_t)newsize * sizeof(uint32_t))) == NULL)
+    return 0;
+  builder->prevfree = (uint32_t*)p;
+  if ((p = realloc(builder->tries, (size_t)newsize)) == NULL)
+    return 0;
+  builder->tries = (unsigned char*)p;
+  //link the new slots at the end of the list of unused slots
+  for (i = builder->size; i < (uint32_t)newsize; i++) {
+    builder->slots[i].check = MULTIFINDER_NO_STATE;
+    builder->slots[i].next = MULTIFINDER_NO_STATE;
+    builder->tries[i] = 0;
+    builder->prevfree[i] = builder->lastfree;
+    builder->nextfree[i] = MULTIFINDER_NO_STATE;
+    if (builder->lastfree == MULTIFINDER_NO_STATE)
+      builder->firstfree = i;
+    else
+      builder->nextfree[builder->lastfree] = i;
+    builder->lastfree = i;
+  }
+  builder->size = (uint32_t)newsize;
+  return 1;
+}
+
+//remove a slot from the list of unused slots
+static void slots_unlink (struct slot_builder* builder, uint32_t slot)
+{
+  if (builder->prevfree[slot] == MULTIFINDER_NO_STATE)
+    builder->firstfree = builder->nextfree[slot];
+  else
+    builder->nextfree[builder->prevfree[slot]] = builder->nextfree[slot];
+  if (builder->nextfree[slot] == MULTIFINDER_NO_STATE)
+    builder->lastfree = builder->prevfree[slot];
+  else
+    builder->prevfree[builder->nextfree[slot]] = builder->prevfree[slot];
+}
+
+//find a base position where all transitions of a trie node fit in unused slots and store them there, returns MULTIFINDER_NO_STATE on error
+static uint32_t slots_place (struct slot_builder* builder, const struct trie_builder* trie, uint32_t node, const uint32_t* newid)
+{
+  uint32_t first = trie->firstchild[node];
+  uint32_t count = trie->childcount[node];
+  unsigned int lowest = trie->label[first];
+  unsigned int highest = trie->label[first + count - 1];
+  uint32_t pos = builder->firstfree;
+  uint32_t base;
+  uint32_t i;
+  for (;;) {
+    uint32_t nextpos;
+    if (pos == MULTIFINDER_NO_STATE) {
+      pos = builder->size;
+      if (!slots_grow(builder, (uint64_t)builder->size + 1))
+        return MULTIFINDER_NO_STATE;
+    }
+    if (pos >= lowest) {
+      base = pos - lowest;
+      if ((uint64_t)base + highest >= builder->size && !slots_grow(builder, (uint64_t)base + highest + 1))
+        return MULTIFINDER_NO_STATE;
+      for (i = 1; i < count; i++)
+        if (builder->slots[base + trie->label[first + i]].check != MULTIFINDER_NO_STATE)
+          break;
+      if (i == count)
+        break;
+    }
+    //slots that keep not fitting are given up on (and stay unused) to bound the time spent
+    nextpos = builder->nextfree[pos];
+    if (++builder->tries[pos] >= SLOT_MAX_TRIES)
+      slots_unlink(builder, pos);
+    pos = nextpos;
+  }
+  for (i = 0; i < count; i++) {
+    uint32_t slot = base + trie->label[first + i];
+    builder->slots[slot].check = newid[node];
+    builder->slots[slot].next = newid[first + i];
+    if (builder->tries[slot] < SLOT_MAX_TRIES)
+      slots_unlink(builder, slot);
+  }
+  return base;
+}
+
+struct multifinder_automaton* multifinder_automaton_create (const struct multifinder_patternset_struct* patternset)
+{
+  struct multifinder_automaton* automaton;
+  const struct multifinder_pattern* pattern;
+  struct trie_builder trie = {NULL, NULL, NULL, NULL, NULL, NULL, 0, 0};
+  struct slot_builder slots = {NULL, NULL, NULL, NULL, MULTIFINDER_NO_STATE, MULTIFINDER_NO_STATE, 0};
+  unsigned char used[256];
+  unsigned char byteclass[256];
+  unsigned int classcount;
+  uint32_t* order = NULL;
+  uint32_t* buffer = NULL;
+  uint32_t* patternstate = NULL;
+  uint32_t* fail = NULL;
+  uint32_t* outlink = NULL;
+  uint32_t* extdepth = NULL;
+  uint32_t* outputstart = NULL;
+  uint32_t* newid = NULL;
+  uint32_t state;
+  uint32_t matchcount;
+  uint32_t activecount;
+  size_t commonmemory;
+  size_t i;
+  size_t j;
+  int ok = 0;
+  if ((automaton = (struct multifinder_automaton*)malloc(sizeof(struct multifinder_automaton))) == NULL)
+    return NULL;
+  automaton->type = MULTIFIND_AUTOMATON_DENSE;
+  automaton->trans = NULL;
+  automaton->base = NULL;
+  automaton->fail = NULL;
+  automaton->labels = NULL;
+  automaton->slots = NULL;
+  automaton->slotcount = 0;
+  automaton->rootnext = NULL;
+  automaton->states = NULL;
+  automaton->outputs = NULL;
+  automaton->patterns = patternset->patterns;
+  automaton->patterndata = patternset->patterndata;
+  automaton->callbackdata = patternset->callbackdata;
+  automaton->patterncount = patternset->patterncount;
+  automaton->shortestpattern = 0;
+  automaton->longestpattern = 0;
+  automaton->folded = 0;
+  automaton->anchors = 0;
+  memcpy(automaton->wordbytes, patternset->wordbytes, sizeof(automaton->wordbytes));
+  automaton->mapped = 0;
+  automaton->prefilter = NULL;
+  //determine if case folding is needed, which word and line flags are used and the length of the patterns (removed patterns are left out of the automaton)
+  activecount = 0;
+  for (i = 0; i < automaton->patterncount; i++) {
+    pattern = automaton->patterns + i;
+    if (pattern->flags & MULTIFINDER_PATTERN_REMOVED)
+      continue;
+    if (pattern->flags & MULTIFIND_PATTERN_CASE_INSENSITIVE)
+      automaton->folded = 1;
+    automaton->anchors |= pattern->flags & (MULTIFINDER_PATTERN_ANCHORS_BEFORE | MULTIFINDER_PATTERN_ANCHORS_AFTER);
+    if (automaton->shortestpattern == 0 || pattern->datalen < automaton->shortestpattern)
+      automaton->shortestpattern = pattern->datalen;
+    if (pattern->datalen > automaton->longestpattern)
+      automaton->longestpattern = pattern->datalen;
+    activecount++;
+  }
+  if (automaton->patterncount >= MULTIFINDER_NO_STATE || automaton->longestpattern >= MULTIFINDER_NO_STATE)
+    goto done;
+  //determine byte classes, bytes not used in any pattern all share class 0
+  memset(used, 0, sizeof(used));
+  for (i = 0; i < automaton->patterncount; i++) {
+    pattern = automaton->patterns + i;
+    if (pattern->flags & MULTIFINDER_PATTERN_REMOVED)
+      continue;
+    for (j = 0; j < pattern->datalen; j++) {
+      unsigned char c = (unsigned char)automaton->patterndata[pattern->offset + j];
+      used[automaton->folded ? multifinder_fold_table[c] : c] = 1;
+    }
+  }
+  classcount = 0;
+  for (i = 0; i < 256; i++)
+    if (!used[i])
+      classcount = 1;
+  for (i = 0; i < 256; i++)
+    byteclass[i] = (used[i] ? classcount++ : 0);
+  for (i = 0; i < 256; i++)
+    automaton->classmap[i] = byteclass[automaton->folded ? multifinder_fold_table[i] : i];
+  automaton->classcount = classcount;
+  automaton->stride2 = 0;
+  while ((1U << automaton->stride2) < classcount)
+    automaton->stride2++;
+  //build trie breadth first, each node splits the range of sorted patterns of its parent by the byte class at its depth
+  if ((order = (uint32_t*)malloc((automaton->patterncount + 1) * sizeof(uint32_t))) == NULL || (buffer = (uint32_t*)malloc((automaton->patterncount + 1) * sizeof(uint32_t))) == NULL || (patternstate = (uint32_t*)malloc((automaton->patterncount + 1) * sizeof(uint32_t))) == NULL)
+    goto done;
+  j = 0;
+  for (i = 0; i < automaton->patterncount; i++)
+    if (!(automaton->patterns[i].flags & MULTIFINDER_PATTERN_REMOVED))
+      order[j++] = (uint32_t)i;
+  if (trie_add_node(&trie, 0, 0, 0, activecount) != 0 || trie.count == 0)
+    goto done;
+  for (state = 0; state < trie.count; state++) {
+    uint32_t depth = trie.depth[state];
+    uint32_t pos = trie.rangestart[state];
+    uint32_t end = trie.rangeend[state];
+    sort_patterns(automaton, order + pos, buffer, end - pos, depth);
+    while (pos < end && automaton->patterns[order[pos]].datalen == depth)
+      patternstate[order[pos++]] = state;
+    trie.firstchild[state] = trie.count;
+    while (pos < end) {
+      unsigned int key = pattern_key(automaton, order[pos], depth);
+      uint32_t next = pos + 1;
+      while (next < end && pattern_key(automaton, order[next], depth) == key)
+        next++;
+      if (trie_add_node(&trie, depth + 1, (unsigned char)(key - 1), pos, next) == 0)
+        goto done;
+      trie.childcount[state]++;
+      pos = next;
+    }
+  }
+  free(order);
+  order = NULL;
+  free(buffer);
+  buffer = NULL;
+  free(trie.rangestart);
+  trie.rangestart = NULL;
+  free(trie.rangeend);
+  trie.rangeend = NULL;
+  //compute failure links breadth first
+  if ((fail = (uint32_t*)malloc(trie.count * sizeof(uint32_t))) == NULL || (outlink = (uint32_t*)malloc(trie.count * sizeof(uint32_t))) == NULL || (extdepth = (uint32_t*)malloc(trie.count * sizeof(uint32_t))) == NULL || (outputstart = (uint32_t*)calloc(trie.count + 1, sizeof(uint32_t))) == NULL)
+    goto done;
+  for (i = 0; i < automaton->patterncount; i++)
+    if (!(automaton->patterns[i].flags & MULTIFINDER_PATTERN_REMOVED))
+      outputstart[patternstate[i] + 1]++;
+  for (i = 0; i < trie.count; i++)
+    outputstart[i + 1] += outputstart[i];
+  fail[0] = 0;
+  outlink[0] = MULTIFINDER_NO_STATE;
+  extdepth[0] = 0;
+  for (state = 0; state < trie.count; state++) {
+    uint32_t child = trie.firstchild[state];
+    uint32_t childend = child + trie.childcount[state];
+    for (; child < childend; child++) {
+      uint32_t target = 0;
+      if (state != 0) {
+        uint32_t current = fail[state];
+        while ((target = trie_child(&trie, current, trie.label[child])) == 0 && current != 0)
+          current = fail[current];
+      }
+      fail[child] = target;
+      outlink[child] = (outputstart[target + 1] > outputstart[target] ? target : outlink[target]);
+      extdepth[child] = (trie.childcount[child] ? trie.depth[child] : extdepth[target]);
+    }
+  }
+  //renumber states so states with matches come first
+  if ((newid = (uint32_t*)malloc(trie.count * sizeof(uint32_t))) == NULL)
+    goto done;
+  matchcount = 0;
+  for (state = 0; state < trie.count; state++)
+    if (outputstart[state + 1] > outputstart[state] || outlink[state] != MULTIFINDER_NO_STATE)
+      newid[state] = matchcount++;
+  j = matchcount;
+  for (state = 0; state < trie.count; state++)
+    if (!(outputstart[state + 1] > outputstart[state] || outlink[state] != MULTIFINDER_NO_STATE))
+      newid[state] = (uint32_t)j++;
+  if ((automaton->states = (struct multifinder_automaton_state*)malloc(trie.count * sizeof(struct multifinder_automaton_state))) == NULL || (automaton->outputs = (uint32_t*)malloc((automaton->patterncount + 1) * sizeof(uint32_t))) == NULL)
+    goto done;
+  for (state = 0; state < trie.count; state++) {
+    struct multifinder_automaton_state* info = automaton->states + newid[state];
+    info->depth = trie.depth[state];
+    info->extdepth = extdepth[state];
+    info->outputs = outputstart[state];
+    info->outputcount = outputstart[state + 1] - outputstart[state];
+    info->outlink = (outlink[state] == MULTIFINDER_NO_STATE ? MULTIFINDER_NO_STATE : newid[outlink[state]]);
+  }
+  //list patterns per state in order of precedence
+  for (i = 0; i < automaton->patterncount; i++)
+    if (!(automaton->patterns[i].flags & MULTIFINDER_PATTERN_REMOVED))
+      automaton->outputs[outputstart[patternstate[i]]++] = (uint32_t)i;
+  automaton->statecount = trie.count;
+  //use the dense automaton if it can be indexed with 32 bits and fits in the memory budget
+  commonmemory = sizeof(struct multifinder_automaton) + trie.count * sizeof(struct multifinder_automaton_state) + (automaton->patterncount + 1) * sizeof(uint32_t);
+  if (patternset->automatontype == MULTIFIND_AUTOMATON_COMPACT)
+    automaton->type = MULTIFIND_AUTOMATON_COMPACT;
+  else if (((uint64_t)trie.count << automaton->stride2) > (uint64_t)0xFFFFFFFF)
+    automaton->type = MULTIFIND_AUTOMATON_COMPACT;
+  else if (patternset->automatontype == MULTIFIND_AUTOMATON_AUTO && ((size_t)trie.count << automaton->stride2) * sizeof(uint32_t) + commonmemory > (patternset->memorybudget ? patternset->memorybudget : AUTOMATON_DENSE_MAX_MEMORY))
+    automaton->type = MULTIFIND_AUTOMATON_COMPACT;
+  if (patternset->automatontype == MULTIFIND_AUTOMATON_DENSE && automaton->type != MULTIFIND_AUTOMATON_DENSE)
+    goto done;
+  if (automaton->type == MULTIFIND_AUTOMATON_DENSE) {
+    //fill in missing transitions from the state the failure link points to (which comes earlier breadth first)
+    size_t rowlen = (size_t)1 << automaton->stride2;
+    if ((automaton->trans = (uint32_t*)malloc(((size_t)trie.count << automaton->stride2) * sizeof(uint32_t))) == NULL)
+      goto done;
+    for (state = 0; state < trie.count; state++) {
+      uint32_t* row = automaton->trans + ((size_t)newid[state] << automaton->stride2);
+      uint32_t child = trie.firstchild[state];
+      uint32_t childend = child + trie.childcount[state];
+      if (state == 0) {
+        for (i = 0; i < rowlen; i++)
+          row[i] = newid[0] << automaton->stride2;
+      } else {
+        memcpy(row, automaton->trans + ((size_t)newid[fail[state]] << automaton->stride2), rowlen * sizeof(uint32_t));
+      }
+      for (; child < childend; child++)
+        row[trie.label[child]] = newid[child] << automaton->stride2;
+    }
+  } else {
+    //store transitions of states with more than one child in the double array, breadth first so the states used most are close together
+    uint32_t maxbase = 0;
+    automaton->stride2 = 0;
+    if ((automaton->base = (uint32_t*)malloc(trie.count * sizeof(uint32_t))) == NULL || (automaton->fail = (uint32_t*)malloc(trie.count * sizeof(uint32_t))) == NULL || (automaton->labels = (unsigned char*)malloc(trie.count)) == NULL || (automaton->rootnext = (uint32_t*)malloc(classcount * sizeof(uint32_t))) == NULL)
+      goto done;
+    for (i = 0; i < classcount; i++)
+      automaton->rootnext[i] = newid[0];
+    for (state = 0; state < trie.count; state++) {
+      uint32_t id = newid[state];
+      uint32_t child = trie.firstchild[state];
+      automaton->fail[id] = newid[fail[state]];
+      automaton->base[id] = 0;
+      automaton->labels[id] = 0;
+      if (state == 0) {
+        for (; child < trie.firstchild[state] + trie.childcount[state]; child++)
+          automaton->rootnext[trie.label[child]] = newid[child];
+      } else if (trie.childcount[state] == 1) {
+        automaton->base[id] = newid[child] | MULTIFINDER_COMPACT_SINGLE;
+        automaton->labels[id] = trie.label[child];
+      } else if (trie.childcount[state] > 1) {
+        if ((automaton->base[id] = slots_place(&slots, &trie, state, newid)) == MULTIFINDER_NO_STATE)
+          goto done;
+        if (automaton->base[id] > maxbase)
+          maxbase = automaton->base[id];
+      }
+    }
+    //any byte class can be looked up from any base position
+    if (!slots_grow(&slots, (uint64_t)maxbase + classcount))
+      goto done;
+    automaton->slotcount = maxbase + classcount;
+    automaton->slots = slots.slots;
+    slots.slots = NULL;
+    if (automaton->slotcount < slots.size) {
+      struct multifinder_compact_slot* newslots;
+      if ((newslots = (struct multifinder_compact_slot*)realloc(automaton->slots, automaton->slotcount * sizeof(struct multifinder_compact_slot))) != NULL)
+        automaton->slots = newslots;
+    }
+  }
+  automaton->root = newid[0] << automaton->stride2;
+  automaton->matchlimit = matchcount << automaton->stride2;
+  automaton->prefilter = multifinder_prefilter_create(automaton);
+  //the prefilter is left out if it doesn't fit in the memory budget
+  if (patternset->memorybudget && multifinder_automaton_memory(automaton) > patternset->memorybudget) {
+    multifinder_prefilter_free(automaton->prefilter);
+    automaton->prefilter = NULL;
+    if (multifinder_automaton_memory(automaton) > patternset->memorybudget)
+      goto done;
+  }
+  ok = 1;
+ done:
+  free(trie.firstchild);
+  free(trie.childcount);
+  free(trie.label);
+  free(trie.depth);
+  free(trie.rangestart);
+  free(trie.rangeend);
+  free(slots.slots);
+  free(slots.nextfree);
+  free(slots.prevfree);
+  free(slots.tries);
+  free(order);
+  free(buffer);
+  free(patternstate);
+  free(fail);
+  free(outlink);
+  free(extdepth);
+  free(outputstart);
+  free(newid);
+  if (!ok) {
+    multifinder_automaton_free(automaton);
+    return NULL;
+  }
+  return automaton;
+}
+
+void multifinder_automaton_free (struct multifinder_automaton* automaton)
+{
+  if (automaton) {
+    if (!automaton->mapped) {
+      free(automaton->trans);
+      free(automaton->base);
+      free(automaton->fail);
+      free(automaton->labels);
+      free(automaton->slots);
+      free(automaton->rootnext);
+      free(automaton->states);
+      free(automaton->outputs);
+    }
+    multifinder_prefilter_free(automaton->prefilter);
+    free(automaton);
+  }
+}
+
+size_t multifinder_automaton_memory (const struct multifinder_automaton* automaton)
+{
+  //tables of a loaded compiled pattern set are counted as well, even though they are in a shared mapped file
+  return sizeof(struct multifinder_automaton) + multifinder_automaton_transition_memory(automaton) + automaton->statecount * sizeof(struct multifinder_automaton_state) + (automaton->patterncount + 1) * sizeof(uint32_t) + (automaton->prefilter ? multifinder_prefilter_memory(automaton->prefilter) : 0);
+}
+
+size_t multifinder_automaton_transition_memory (const struct multifinder_automaton* automaton)
+{
+  if (automaton->type == MULTIFIND_AUTOMATON_COMPACT)
+    return automaton->statecount * (2 * sizeof(uint32_t) + 1) + automaton->slotcount * sizeof(struct multifinder_compact_slot) + automaton->classcount * sizeof(uint32_t);
+  return ((size_t)automaton->statecount << automaton->stride2) * sizeof(uint32_t);
+}
@@ -0,0 +1,356 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Saving and loading of compiled pattern sets.
+
+  A compiled pattern set is written as a header followed by the tables of the
+  automaton and the patterns exactly as they are used in memory. All positions
+  in the file are relative to its start, so a loaded file is memory mapped
+  read-only and scanned directly without parsing or copying the tables, and
+  processes loading the same file share the same page cache.
+  The header holds a version number and a byte order marker, files created on
+  a system with a different byte order can't be loaded.
+  Loaded files are trusted: apart from the header and the size of the tables
+  their contents are not validated.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "multifinder_internal.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#define COMPILED_MAGIC "MFNDCOMP"
+#define COMPILED_VERSION 3
+#define COMPILED_BYTE_ORDER 0x01020304
+//alignment of each table in the file
+#define COMPILED_ALIGNMENT 64
+
+enum compiled_table {
+  COMPILED_TRANS,
+  COMPILED_STATES,
+  COMPILED_OUTPUTS,
+  COMPILED_PATTERNS,
+  COMPILED_PATTERNDATA,
+  COMPILED_BASE,
+  COMPILED_FAIL,
+  COMPILED_LABELS,
+  COMPILED_SLOTS,
+  COMPILED_ROOTNEXT,
+  COMPILED_TABLES
+};
+
+struct compiled_header {
+  char magic[8];                                //COMPILED_MAGIC
+  uint32_t version;                             //COMPILED_VERSION
+  uint32_t byteorder;                           //COMPILED_BYTE_ORDER as written by the system that created the file
+  uint32_t headersize;                          //size of this header
+  uint32_t type;                                //MULTIFIND_AUTOMATON_DENSE or MULTIFIND_AUTOMATON_COMPACT (only the tables of this type are used)
+  uint32_t stride2;                             //log2 of the length of a row in the transition table
+  uint32_t statecount;                          //number of states
+  uint32_t root;                                //start state (premultiplied)
+  uint32_t matchlimit;                          //states below this value (premultiplied) have patterns ending in them
+  uint32_t folded;                              //non-zero if the automaton works on case folded input
+  uint32_t slotcount;                           //number of entries in the double array of a compact automaton
+  uint32_t anchors;                             //word and line flags used by any of the patterns
+  uint64_t patterncount;                        //number of patterns
+  uint64_t longestpattern;                      //length of longest pattern
+  uint64_t filesize;                            //total size of the file
+  uint64_t offset[COMPILED_TABLES];             //position of each table in the file
+  uint64_t size[COMPILED_TABLES];               //size of each table in bytes
+  unsigned char classmap[256];                  //byte value to byte class
+  unsigned char wordbytes[256];                 //non-zero for bytes that are part of words
+};
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_save_compiled (multifinder_patternset patternset, const char* filename)
+{
+  const struct multifinder_automaton* automaton;
+  struct compiled_header header;
+  const void* table[COMPILED_TABLES];
+  static const char padding[COMPILED_ALIGNMENT] = {0};
+  uint64_t pos;
+  FILE* dst;
+  int i;
+  int status = 0;
+  if (multifinder_patternset_compile(patternset) != 0)
+    return -1;
+  automaton = (const struct multifinder_automaton*)MULTIFINDER_ATOMIC_LOAD_POINTER(&patternset->automaton);
+  //fill in the header
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPILED_MAGIC, sizeof(header.magic));
+  header.version = COMPILED_VERSION;
+  header.byteorder = COMPILED_BYTE_ORDER;
+  header.headersize = sizeof(header);
+  header.type = automaton->type;
+  header.stride2 = automaton->stride2;
+  header.statecount = automaton->statecount;
+  header.root = automaton->root;
+  header.matchlimit = automaton->matchlimit;
+  header.folded = automaton->folded;
+  header.slotcount = automaton->slotcount;
+  header.anchors = automaton->anchors;
+  header.patterncount = automaton->patterncount;
+  header.longestpattern = automaton->longestpattern;
+  memcpy(header.classmap, automaton->classmap, sizeof(header.classmap));
+  memcpy(header.wordbytes, automaton->wordbytes, sizeof(header.wordbytes));
+  table[COMPILED_TRANS] = automaton->trans;
+  header.size[COMPILED_TRANS] = ((uint64_t)automaton->statecount << automaton->stride2) * sizeof(uint32_t);
+  table[COMPILED_STATES] = automaton->states;
+  header.size[COMPILED_STATES] = (uint64_t)automaton->statecount * sizeof(struct multifinder_automaton_state);
+  table[COMPILED_OUTPUTS] = automaton->outputs;
+  header.size[COMPILED_OUTPUTS] = (uint64_t)automaton->patterncount * sizeof(uint32_t);
+  table[COMPILED_PATTERNS] = automaton->patterns;
+  header.size[COMPILED_PATTERNS] = (uint64_t)automaton->patterncount * sizeof(struct multifinder_pattern);
+  table[COMPILED_PATTERNDATA] = automaton->patterndata;
+  header.size[COMPILED_PATTERNDATA] = patternset->patterndatalen;
+  memset(table + COMPILED_BASE, 0, (COMPILED_TABLES - COMPILED_BASE) * sizeof(const void*));
+  if (automaton->type == MULTIFIND_AUTOMATON_COMPACT) {
+    header.size[COMPILED_TRANS] = 0;
+    table[COMPILED_BASE] = automaton->base;
+    header.size[COMPILED_BASE] = (uint64_t)automaton->statecount * sizeof(uint32_t);
+    table[COMPILED_FAIL] = automaton->fail;
+    header.size[COMPILED_FAIL] = (uint64_t)automaton->statecount * sizeof(uint32_t);
+    table[COMPILED_LABELS] = automaton->labels;
+    header.size[COMPILED_LABELS] = (uint64_t)automaton->statecount;
+    table[COMPILED_SLOTS] = automaton->slots;
+    header.size[COMPILED_SLOTS] = (uint64_t)automaton->slotcount * sizeof(struct multifinder_compact_slot);
+    table[COMPILED_ROOTNEXT] = automaton->rootnext;
+    header.size[COMPILED_ROOTNEXT] = (uint64_t)automaton->classcount * sizeof(uint32_t);
+  }
+  pos = sizeof(header);
+  for (i = 0; i < COMPILED_TABLES; i++) {
+    pos = (pos + COMPILED_ALIGNMENT - 1) & ~(uint64_t)(COMPILED_ALIGNMENT - 1);
+    header.offset[i] = pos;
+    pos += header.size[i];
+  }
+  header.filesize = pos;
+  //write the header followed by the tables
+  if ((dst = fopen(filename, "wb")) == NULL)
+    return -1;
+  if (fwrite(&header, sizeof(header), 1, dst) != 1)
+    status = -1;
+  pos = sizeof(header);
+  for (i = 0; status == 0 && i < COMPILED_TABLES; i++) {
+    if (header.offset[i] > pos && fwrite(padding, (size_t)(header.offset[i] - pos), 1, dst) != 1)
+      status = -1;
+    else if (header.size[i] > 0 && fwrite(table[i], (size_t)header.size[i], 1, dst) != 1)
+      status = -1;
+    pos = header.offset[i] + header.size[i];
+  }
+  if (fclose(dst) != 0)
+    status = -1;
+  if (status != 0)
+    remove(filename);
+  return status;
+}
+
+//map a whole file read-only, returns NULL on error
+static const char* map_compiled (const char* filename, size_t* len)
+{
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+  LARGE_INTEGER filesize;
+  const char* result = NULL;
+  if ((file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL)) == INVALID_HANDLE_VALUE)
+    return NULL;
+  if (GetFileSizeEx(file, &filesize) && filesize.QuadPart >= (LONGLONG)sizeof(struct compiled_header) && (uint64_t)filesize.QuadPart <= (uint64_t)(size_t)-1) {
+    if ((mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+      //the view keeps the mapping alive
+      if ((result = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) != NULL)
+        *len = (size_t)filesize.QuadPart;
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+  return result;
+#else
+  int file;
+  struct stat info;
+  void* result = NULL;
+  if ((file = open(filename, O_RDONLY)) == -1)
+    return NULL;
+  if (fstat(file, &info) == 0 && S_ISREG(info.st_mode) && (uint64_t)info.st_size >= sizeof(struct compiled_header) && (uint64_t)info.st_size <= (uint64_t)(size_t)-1) {
+    //a shared mapping lets all processes using the same file share its pages
+    if ((result = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0)) == MAP_FAILED)
+      result = NULL;
+    else
+      *len = (size_t)info.st_size;
+  }
+  close(file);
+  return (const char*)result;
+#endif
+}
+
+void multifinder_unmap_compiled (const char* data, size_t len)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap((void*)data, len);
+#endif
+}
+
+//get the number of byte classes from the byte classes of all byte values
+static unsigned int count_classes (const unsigned char* classmap)
+{
+  unsigned int result = 0;
+  int i;
+  for (i = 0; i < 256; i++)
+    if (classmap[i] >= result)
+      result = classmap[i] + 1U;
+  return result;
+}
+
+//check if the header of a mapped file describes a compiled pattern set that can be used on this system
+static int check_header (const struct compiled_header* header, size_t len)
+{
+  uint64_t classcount = count_classes(header->classmap);
+  int i;
+  if (memcmp(header->magic, COMPILED_MAGIC, sizeof(header->magic)) != 0 || header->version != COMPILED_VERSION || header->byteorder != COMPILED_BYTE_ORDER || header->headersize != sizeof(struct compiled_header) || header->filesize != len)
+    return 0;
+  if (header->stride2 > 8 || header->statecount == 0 || header->statecount >= (MULTIFINDER_NO_STATE >> header->stride2) || header->root >= (header->statecount << header->stride2) || header->matchlimit > (header->statecount << header->stride2))
+    return 0;
+  if (header->patterncount >= MULTIFINDER_NO_STATE || header->longestpattern >= MULTIFINDER_NO_STATE)
+    return 0;
+  if (header->type == MULTIFIND_AUTOMATON_DENSE) {
+    if (header->size[COMPILED_TRANS] != ((uint64_t)header->statecount << header->stride2) * sizeof(uint32_t) || (1U << header->stride2) < classcount)
+      return 0;
+  } else if (header->type == MULTIFIND_AUTOMATON_COMPACT) {
+    if (header->stride2 != 0 || header->statecount > MULTIFINDER_COMPACT_SINGLE || header->slotcount < classcount || header->size[COMPILED_TRANS] != 0 || header->size[COMPILED_BASE] != (uint64_t)header->statecount * sizeof(uint32_t) || header->size[COMPILED_FAIL] != (uint64_t)header->statecount * sizeof(uint32_t) || header->size[COMPILED_LABELS] != header->statecount || header->size[COMPILED_SLOTS] != (uint64_t)header->slotcount * sizeof(struct multifinder_compact_slot) || header->size[COMPILED_ROOTNEXT] != classcount * sizeof(uint32_t))
+      return 0;
+  } else {
+    return 0;
+  }
+  if (header->size[COMPILED_STATES] != (uint64_t)header->statecount * sizeof(struct multifinder_automaton_state) || header->size[COMPILED_OUTPUTS] != header->patterncount * sizeof(uint32_t) || header->size[COMPILED_PATTERNS] != header->patterncount * sizeof(struct multifinder_pattern))
+    return 0;
+  for (i = 0; i < COMPILED_TABLES; i++)
+    if (header->offset[i] % COMPILED_ALIGNMENT != 0 || header->offset[i] < sizeof(struct compiled_header) || header->offset[i] > len || header->size[i] > len - header->offset[i])
+      return 0;
+  return 1;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_patternset_load_compiled (const char* filename, void* const* patterncallbackdata)
+{
+  const struct compiled_header* header;
+  struct multifinder_patternset_struct* patternset;
+  struct multifinder_automaton* automaton;
+  const char* data;
+  size_t len;
+  size_t i;
+  if ((data = map_compiled(filename, &len)) == NULL)
+    return NULL;
+  header = (const struct compiled_header*)data;
+  if (!check_header(header, len) || (patternset = multifinder_patternset_create()) == NULL) {
+    multifinder_unmap_compiled(data, len);
+    return NULL;
+  }
+  if ((automaton = (struct multifinder_automaton*)malloc(sizeof(struct multifinder_automaton))) == NULL) {
+    multifinder_unmap_compiled(data, len);
+    multifinder_patternset_free(patternset);
+    return NULL;
+  }
+  //use the tables in the mapped file
+  memcpy(automaton->classmap, header->classmap, sizeof(automaton->classmap));
+  automaton->type = header->type;
+  automaton->stride2 = header->stride2;
+  automaton->classcount = count_classes(header->classmap);
+  automaton->statecount = header->statecount;
+  automaton->root = header->root;
+  automaton->matchlimit = header->matchlimit;
+  automaton->trans = NULL;
+  automaton->base = NULL;
+  automaton->fail = NULL;
+  automaton->labels = NULL;
+  automaton->slots = NULL;
+  automaton->slotcount = 0;
+  automaton->rootnext = NULL;
+  if (header->type == MULTIFIND_AUTOMATON_DENSE) {
+    automaton->trans = (uint32_t*)(data + header->offset[COMPILED_TRANS]);
+  } else {
+    automaton->base = (uint32_t*)(data + header->offset[COMPILED_BASE]);
+    automaton->fail = (uint32_t*)(data + header->offset[COMPILED_FAIL]);
+    automaton->labels = (unsigned char*)(data + header->offset[COMPILED_LABELS]);
+    automaton->slots = (struct multifinder_compact_slot*)(data + header->offset[COMPILED_SLOTS]);
+    automaton->slotcount = header->slotcount;
+    automaton->rootnext = (uint32_t*)(data + header->offset[COMPILED_ROOTNEXT]);
+  }
+  automaton->states = (struct multifinder_automaton_state*)(data + header->offset[COMPILED_STATES]);
+  automaton->outputs = (uint32_t*)(data + header->offset[COMPILED_OUTPUTS]);
+  automaton->patterns = (const struct multifinder_pattern*)(data + header->offset[COMPILED_PATTERNS]);
+  automaton->patterndata = data + header->offset[COMPILED_PATTERNDATA];
+  automaton->callbackdata = patterncallbackdata;
+  automaton->patterncount = (size_t)header->patterncount;
+  automaton->longestpattern = (size_t)header->longestpattern;
+  automaton->shortestpattern = 0;
+  for (i = 0; i < automaton->patterncount; i++) {
+    if (automaton->patterns[i].flags & MULTIFINDER_PATTERN_REMOVED)
+      patternset->removedcount++;
+    else if (automaton->shortestpattern == 0 || automaton->patterns[i].datalen < automaton->shortestpattern)
+      automaton->shortestpattern = automaton->patterns[i].datalen;
+  }
+  automaton->folded = (header->folded != 0);
+  automaton->anchors = header->anchors;
+  memcpy(automaton->wordbytes, header->wordbytes, sizeof(automaton->wordbytes));
+  automaton->mapped = 1;
+  automaton->prefilter = multifinder_prefilter_create(automaton);
+  //the pattern set refers to the same tables and can't be changed
+  patternset->patterndata = (char*)automaton->patterndata;
+  patternset->patterndatalen = (size_t)header->size[COMPILED_PATTERNDATA];
+  patternset->patterndatasize = patternset->patterndatalen;
+  patternset->patterns = (struct multifinder_pattern*)automaton->patterns;
+  patternset->callbackdata = (void**)patterncallbackdata;
+  patternset->patterncount = automaton->patterncount;
+  patternset->patternsize = automaton->patterncount;
+  patternset->shortestpattern = automaton->shortestpattern;
+  patternset->longestpattern = automaton->longestpattern;
+  memcpy(patternset->wordbytes, header->wordbytes, sizeof(patternset->wordbytes));
+  patternset->automaton = automaton;
+  patternset->mappeddata = data;
+  patternset->mappedlen = len;
+  return patternset;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_save_compiled (multifinder handle, const char* filename)
+{
+  return multifinder_patternset_save_compiled(handle->patternset, filename);
+}
+
+DLL_EXPORT_MULTIFINDER multifinder multifinder_load_compiled (const char* filename, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+{
+  multifinder_patternset patternset;
+  multifinder result;
+  if ((patternset = multifinder_patternset_load_compiled(filename, NULL)) == NULL)
+    return NULL;
+  result = multifinder_create_with_patternset(patternset, foundfunction, flushfunction, callbackdata);
+  multifinder_patternset_free(patternset);
+  return result;
+}
@@ -0,0 +1,316 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Scanning of files without copying.
+
+  Regular files are memory mapped (in windows of limited size, so large files
+  can be processed in a 32-bit address space) and scanned in place, using
+  multiple threads if requested. The operating system is told the data will be
+  read sequentially, so it can read ahead.
+  Anything that can't be mapped (pipes, character devices, failed mappings) is
+  streamed through multifinder_process() instead. A reader thread fills the
+  next buffers while the current one is scanned, so waiting for input and
+  scanning overlap.
+  Small files are simply read, as mapping them costs more than copying.
+*/
+
+#include <stdlib.h>
+#include "multifinder_internal.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+//size of the part of a file mapped at once (must be a multiple of the page size and allocation granularity)
+#define FILE_MAP_WINDOW ((size_t)256 * 1024 * 1024)
+//size of each buffer used for files that can't be mapped
+#define FILE_READ_BUFFER ((size_t)1024 * 1024)
+//number of buffers used for files that can't be mapped (one being scanned, the others being filled)
+#define FILE_READ_BUFFERS 3
+//alignment of read buffers (allows the system to transfer data directly)
+#define FILE_READ_ALIGNMENT 4096
+//regular files up to this size are read instead of mapped
+#define FILE_SMALL_SIZE ((size_t)64 * 1024)
+
+#ifdef _WIN32
+typedef HANDLE file_handle;
+#define FILE_INVALID INVALID_HANDLE_VALUE
+#else
+typedef int file_handle;
+#define FILE_INVALID -1
+#endif
+
+static file_handle open_file (const char* filename)
+{
+#ifdef _WIN32
+  if (!filename)
+    return GetStdHandle(STD_INPUT_HANDLE);
+  return CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+#else
+  if (!filename)
+    return STDIN_FILENO;
+  return open(filename, O_RDONLY);
+#endif
+}
+
+static void close_file (file_handle file, const char* filename)
+{
+  //don't close standard input
+  if (filename) {
+#ifdef _WIN32
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+  }
+}
+
+//get the size of a regular file, returns zero if the file is not a regular file (e.g. a pipe)
+static int get_file_size (file_handle file, uint64_t* size)
+{
+#ifdef _WIN32
+  LARGE_INTEGER filesize;
+  if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &filesize))
+    return 0;
+  *size = (uint64_t)filesize.QuadPart;
+  return 1;
+#else
+  struct stat info;
+  if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode))
+    return 0;
+  *size = (uint64_t)info.st_size;
+  return 1;
+#endif
+}
+
+//map part of a file in memory, returns NULL on error
+static const char* map_file (file_handle file, uint64_t offset, size_t len)
+{
+#ifdef _WIN32
+  HANDLE mapping;
+  const char* result;
+  if ((mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+    return NULL;
+  result = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)(offset & 0xFFFFFFFF), len);
+  //the view keeps the mapping alive
+  CloseHandle(mapping);
+  return result;
+#else
+  void* result;
+  if ((result = mmap(NULL, len, PROT_READ, MAP_PRIVATE, file, (off_t)offset)) == MAP_FAILED)
+    return NULL;
+  //data is read once from start to end
+#ifdef POSIX_MADV_SEQUENTIAL
+  posix_madvise(result, len, POSIX_MADV_SEQUENTIAL);
+#endif
+  //use huge pages if the system supports them for file mappings
+#ifdef MADV_HUGEPAGE
+  madvise(result, len, MADV_HUGEPAGE);
+#endif
+  return (const char*)result;
+#endif
+}
+
+static void unmap_file (const char* data, size_t len)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap((void*)data, len);
+#endif
+}
+
+//read from file, returns number of bytes read, 0 at end of file or -1 on error
+static long read_file (file_handle file, char* buf, size_t len)
+{
+#ifdef _WIN32
+  DWORD result;
+  if (!ReadFile(file, buf, (DWORD)len, &result, NULL))
+    return (GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1);
+  return (long)result;
+#else
+  ssize_t result;
+  while ((result = read(file, buf, len)) < 0 && errno == EINTR)
+    ;
+  return (long)result;
+#endif
+}
+
+struct file_reader {
+  file_handle file;                             //file to read from
+  char* buffers[FILE_READ_BUFFERS];             //buffers filled in turn
+  long buflen[FILE_READ_BUFFERS];               //result of reading into each buffer
+  multifinder_semaphore emptybuffers;           //counts buffers that can be filled
+  multifinder_semaphore fullbuffers;            //counts buffers that can be scanned
+  volatile int stop;                            //set when the reader must not read any more
+};
+
+//fill buffers in turn until the end of the file, an error or until stopped
+static void read_buffers (void* arg)
+{
+  struct file_reader* reader = (struct file_reader*)arg;
+  int i = 0;
+  for (;;) {
+    multifinder_semaphore_wait(reader->emptybuffers);
+    if (reader->stop)
+      break;
+    reader->buflen[i] = read_file(reader->file, reader->buffers[i], FILE_READ_BUFFER);
+    multifinder_semaphore_post(reader->fullbuffers);
+    if (reader->buflen[i] <= 0)
+      break;
+    i = (i + 1) % FILE_READ_BUFFERS;
+  }
+}
+
+//process a file by reading it, using a reader thread if possible, returns zero on read error
+static int process_read_file (multifinder handle, file_handle file, unsigned int threads, size_t* pcount)
+{
+  struct file_reader reader;
+  multifinder_thread thread = NULL;
+  char* buf;
+  long buflen = 0;
+  int i;
+  if ((buf = (char*)malloc(FILE_READ_BUFFERS * FILE_READ_BUFFER + FILE_READ_ALIGNMENT)) == NULL)
+    return 0;
+  reader.file = file;
+  for (i = 0; i < FILE_READ_BUFFERS; i++)
+    reader.buffers[i] = buf + (FILE_READ_ALIGNMENT - (size_t)buf % FILE_READ_ALIGNMENT) + i * FILE_READ_BUFFER;
+  reader.stop = 0;
+  reader.emptybuffers = multifinder_semaphore_create(FILE_READ_BUFFERS);
+  reader.fullbuffers = multifinder_semaphore_create(0);
+  if (reader.emptybuffers && reader.fullbuffers)
+    thread = multifinder_thread_create(read_buffers, &reader);
+  if (!thread) {
+    //read and scan in turn
+    while (handle->abortstatus == 0 && (buflen = read_file(file, reader.buffers[0], FILE_READ_BUFFER)) > 0)
+      *pcount += multifinder_process_parallel(handle, reader.buffers[0], (size_t)buflen, threads);
+  } else {
+    //scan each buffer while the reader fills the next ones
+    int finished = 0;
+    i = 0;
+    while (handle->abortstatus == 0) {
+      multifinder_semaphore_wait(reader.fullbuffers);
+      if ((buflen = reader.buflen[i]) <= 0) {
+        finished = 1;
+        break;
+      }
+      *pcount += multifinder_process_parallel(handle, reader.buffers[i], (size_t)buflen, threads);
+      multifinder_semaphore_post(reader.emptybuffers);
+      i = (i + 1) % FILE_READ_BUFFERS;
+    }
+    //when aborted the reader may still be reading (or waiting for a buffer)
+    if (!finished) {
+      reader.stop = 1;
+      multifinder_semaphore_post(reader.emptybuffers);
+    }
+    multifinder_thread_join(thread);
+  }
+  multifinder_semaphore_free(reader.emptybuffers);
+  multifinder_semaphore_free(reader.fullbuffers);
+  free(buf);
+  return (buflen >= 0);
+}
+
+//process a small file by reading it in a local buffer, returns zero on read error
+static int process_small_file (multifinder handle, file_handle file, size_t* pcount)
+{
+  char buf[FILE_SMALL_SIZE];
+  long buflen = 0;
+  //the file may have grown since its size was checked
+  while (handle->abortstatus == 0 && (buflen = read_file(file, buf, FILE_SMALL_SIZE)) > 0)
+    *pcount += multifinder_process(handle, buf, (size_t)buflen);
+  return (buflen >= 0);
+}
+
+//process a file by mapping it in memory, returns zero if (the rest of) the file could not be mapped
+static int process_mapped_file (multifinder handle, file_handle file, uint64_t size, unsigned int threads, size_t* pcount)
+{
+  uint64_t offset = 0;
+  while (offset < size && handle->abortstatus == 0) {
+    const char* data;
+    size_t len = (size - offset < FILE_MAP_WINDOW ? (size_t)(size - offset) : FILE_MAP_WINDOW);
+    if ((data = map_file(file, offset, len)) == NULL) {
+      //let the caller read the rest of the file instead
+#ifdef _WIN32
+      LARGE_INTEGER position;
+      position.QuadPart = (LONGLONG)offset;
+      SetFilePointerEx(file, position, NULL, FILE_BEGIN);
+#else
+      lseek(file, (off_t)offset, SEEK_SET);
+#endif
+      return 0;
+    }
+    *pcount += multifinder_process_parallel(handle, data, len, threads);
+    unmap_file(data, len);
+    offset += len;
+  }
+  return 1;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_process_mapped (multifinder handle, const char* data, size_t datalen, unsigned int threads)
+{
+  size_t count;
+  count = multifinder_process_parallel(handle, data, datalen, threads);
+  count += multifinder_finalize(handle);
+  return count;
+}
+
+int multifinder_process_file_limited (multifinder handle, const char* filename, unsigned int threads, uint64_t maxsize, size_t* pcount)
+{
+  file_handle file;
+  uint64_t size;
+  size_t count = 0;
+  int status = 0;
+  if ((file = open_file(filename)) == FILE_INVALID)
+    return -1;
+  if (!get_file_size(file, &size)) {
+    if (!process_read_file(handle, file, threads, &count))
+      status = -1;
+  } else if (maxsize > 0 && size > maxsize) {
+    status = 1;
+  } else if (size <= FILE_SMALL_SIZE) {
+    if (!process_small_file(handle, file, &count))
+      status = -1;
+  } else if (!process_mapped_file(handle, file, size, threads, &count)) {
+    //read data that could not be mapped
+    if (!process_read_file(handle, file, threads, &count))
+      status = -1;
+  }
+  if (status == 0)
+    count += multifinder_finalize(handle);
+  close_file(file, filename);
+  if (pcount)
+    *pcount = count;
+  return status;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_process_file (multifinder handle, const char* filename, unsigned int threads, size_t* pcount)
+{
+  return multifinder_process_file_limited(handle, filename, threads, 0, pcount);
+}
@@ -0,0 +1,433 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Counting matches in many files using a pool of threads.
+
+  Each thread has its own search handle (sharing the pattern set, so the
+  automaton is compiled once) and its own counters, so nothing is shared while
+  scanning. Files and directories to search are queued per thread. A thread
+  takes the items it added last from its own queue (the files of the directory
+  it just read, with no handoff to another thread) and when its queue is empty
+  it takes the oldest item from the queue of another thread.
+  Large files are left until all other files were searched and are then each
+  split in chunks that are scanned by all threads.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "multifinder_internal.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+//files larger than this are scanned after the other files, using all threads
+#define FILES_SPLIT_SIZE ((uint64_t)64 * 1024 * 1024)
+//maximum number of threads
+#define FILES_MAX_THREADS 256
+//number of matches a thread collects before counting them
+#define FILES_BATCH_SIZE 1024
+
+#ifdef _WIN32
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+//kind of queued item
+#define FILES_ITEM_PATH 0                       //path given by the caller (file or directory)
+#define FILES_ITEM_FILE 1                       //file found in a directory
+#define FILES_ITEM_DIRECTORY 2                  //directory found in a directory
+
+struct files_item {
+  struct files_item* next;                      //next item (only used in the list of large files)
+  int kind;                                     //FILES_ITEM_* kind of item
+  char* path;                                   //path of file or directory (stored after the item)
+};
+
+struct files_scan;
+
+struct files_worker {
+  struct files_scan* scan;                      //scan the thread belongs to
+  multifinder handle;                           //search handle of the thread
+  multifinder_thread thread;                    //thread (NULL for the calling thread)
+  multifinder_mutex lock;                       //protects the queue
+  struct files_item** queue;                    //items to search (the oldest at queuestart)
+  size_t queuestart;                            //index of first item in queue
+  size_t queuelen;                              //index after last item in queue
+  size_t queuesize;                             //number of allocated entries in queue
+  size_t* patterncounts;                        //number of matches of each pattern found by this thread
+  size_t count;                                 //number of matches found by this thread
+  multifinder_match matches[FILES_BATCH_SIZE];  //matches not yet counted
+};
+
+struct files_scan {
+  struct files_worker* workers;                 //threads searching files
+  unsigned int workercount;                     //number of threads
+  size_t patterncount;                          //number of patterns
+  volatile long pending;                        //number of queued items not finished yet
+  volatile int abortstatus;                     //non-zero if a callback function requested to abort (or on memory allocation error)
+  multifinder_mutex lock;                       //protects large files and calling the callback function
+  struct files_item* largefiles;                //large files to scan after the other files
+  multifinder_file_callback_fn filefunction;    //user callback function called for each file
+  void* callbackdata;                           //user callback data
+};
+
+//count matches of a thread
+static int count_matches (const multifinder_match* matches, size_t count, void* callbackdata)
+{
+  struct files_worker* worker = (struct files_worker*)callbackdata;
+  size_t i;
+  for (i = 0; i < count; i++)
+    worker->patterncounts[matches[i].pattern]++;
+  return 0;
+}
+
+static struct files_item* create_item (int kind, const char* dir, const char* name)
+{
+  struct files_item* item;
+  size_t dirlen = (dir ? strlen(dir) : 0);
+  size_t namelen = strlen(name);
+  if ((item = (struct files_item*)malloc(sizeof(struct files_item) + dirlen + namelen + 2)) == NULL)
+    return NULL;
+  item->next = NULL;
+  item->kind = kind;
+  item->path = (char*)(item + 1);
+  if (dir) {
+    memcpy(item->path, dir, dirlen);
+    //don't add a separator after a root directory
+    if (dirlen > 0 && dir[dirlen - 1] != PATH_SEPARATOR && dir[dirlen - 1] != '/')
+      item->path[dirlen++] = PATH_SEPARATOR;
+  }
+  memcpy(item->path + dirlen, name, namelen + 1);
+  return item;
+}
+
+//add an item to the queue of a thread, returns zero on memory allocation error
+static int push_item (struct files_worker* worker, struct files_item* item)
+{
+  int result = 1;
+  MULTIFINDER_ATOMIC_INCREMENT(&worker->scan->pending);
+  multifinder_mutex_lock(worker->lock);
+  if (worker->queuelen == worker->queuesize) {
+    if (worker->queuestart > 0) {
+      //reuse the space of items taken by other threads
+      memmove(worker->queue, worker->queue + worker->queuestart, (worker->queuelen - worker->queuestart) * sizeof(struct files_item*));
+      worker->queuelen -= worker->queuestart;
+      worker->queuestart = 0;
+    } else {
+      struct files_item** newqueue;
+      size_t newsize = (worker->queuesize ? worker->queuesize * 2 : 256);
+      if ((newqueue = (struct files_item**)realloc(worker->queue, newsize * sizeof(struct files_item*))) == NULL) {
+        result = 0;
+      } else {
+        worker->queue = newqueue;
+        worker->queuesize = newsize;
+      }
+    }
+  }
+  if (result)
+    worker->queue[worker->queuelen++] = item;
+  multifinder_mutex_unlock(worker->lock);
+  if (!result) {
+    MULTIFINDER_ATOMIC_DECREMENT(&worker->scan->pending);
+    free(item);
+  }
+  return result;
+}
+
+//take the newest item from the queue of a thread (or the oldest one when taken by another thread), returns NULL if the queue is empty
+static struct files_item* take_item (struct files_worker* worker, int steal)
+{
+  struct files_item* item = NULL;
+  multifinder_mutex_lock(worker->lock);
+  if (worker->queuestart < worker->queuelen) {
+    item = (steal ? worker->queue[worker->queuestart++] : worker->queue[--worker->queuelen]);
+    if (worker->queuestart == worker->queuelen)
+      worker->queuestart = worker->queuelen = 0;
+  }
+  multifinder_mutex_unlock(worker->lock);
+  return item;
+}
+
+//report the result of searching a file to the callback function
+static void report_file (struct files_scan* scan, const char* path, int status, size_t count)
+{
+  if (scan->filefunction) {
+    int result;
+    multifinder_mutex_lock(scan->lock);
+    if (scan->abortstatus == 0 && (result = (*scan->filefunction)(path, status, count, scan->callbackdata)) != 0)
+      scan->abortstatus = result;
+    multifinder_mutex_unlock(scan->lock);
+  }
+}
+
+//search a file, large files are only queued to be scanned later
+static void search_file (struct files_worker* worker, struct files_item* item)
+{
+  struct files_scan* scan = worker->scan;
+  size_t count = 0;
+  int status;
+  if ((status = multifinder_process_file_limited(worker->handle, item->path, 1, FILES_SPLIT_SIZE, &count)) == 1) {
+    multifinder_mutex_lock(scan->lock);
+    item->next = scan->largefiles;
+    scan->largefiles = item;
+    multifinder_mutex_unlock(scan->lock);
+    return;
+  }
+  multifinder_reset(worker->handle);
+  worker->count += count;
+  report_file(scan, item->path, status, count);
+  free(item);
+}
+
+#ifdef _WIN32
+//queue the contents of a directory, returns zero if the directory could not be read
+static int search_directory (struct files_worker* worker, const char* path)
+{
+  WIN32_FIND_DATAA entry;
+  HANDLE find;
+  struct files_item* item;
+  char* pattern;
+  size_t pathlen = strlen(path);
+  if ((pattern = (char*)malloc(pathlen + 3)) == NULL)
+    return 0;
+  memcpy(pattern, path, pathlen);
+  if (pathlen > 0 && path[pathlen - 1] != '\\' && path[pathlen - 1] != '/')
+    pattern[pathlen++] = '\\';
+  strcpy(pattern + pathlen, "*");
+  find = FindFirstFileA(pattern, &entry);
+  free(pattern);
+  if (find == INVALID_HANDLE_VALUE)
+    return 0;
+  do {
+    if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0)
+      continue;
+    //don't follow links to directories (they may cause loops)
+    if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      if (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+        continue;
+      item = create_item(FILES_ITEM_DIRECTORY, path, entry.cFileName);
+    } else if (entry.dwFileAttributes & FILE_ATTRIBUTE_DEVICE) {
+      continue;
+    } else {
+      item = create_item(FILES_ITEM_FILE, path, entry.cFileName);
+    }
+    if (!item || !push_item(worker, item)) {
+      worker->scan->abortstatus = -1;
+      break;
+    }
+  } while (worker->scan->abortstatus == 0 && FindNextFileA(find, &entry));
+  FindClose(find);
+  return 1;
+}
+#else
+//queue the contents of a directory, returns zero if the directory could not be read
+static int search_directory (struct files_worker* worker, const char* path)
+{
+  DIR* dir;
+  struct dirent* entry;
+  struct files_item* item;
+  int kind;
+  if ((dir = opendir(path)) == NULL)
+    return 0;
+  while (worker->scan->abortstatus == 0 && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if ((item = create_item(FILES_ITEM_FILE, path, entry->d_name)) == NULL) {
+      worker->scan->abortstatus = -1;
+      break;
+    }
+    //only search regular files and don't follow links to directories (they may cause loops)
+#ifdef DT_DIR
+    if (entry->d_type == DT_REG)
+      kind = FILES_ITEM_FILE;
+    else if (entry->d_type == DT_DIR)
+      kind = FILES_ITEM_DIRECTORY;
+    else if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK)
+      kind = -1;
+    else
+#endif
+    {
+      struct stat info;
+      if (lstat(item->path, &info) != 0)
+        kind = -1;
+      else if (S_ISDIR(info.st_mode))
+        kind = FILES_ITEM_DIRECTORY;
+      else if (S_ISREG(info.st_mode) || (S_ISLNK(info.st_mode) && stat(item->path, &info) == 0 && S_ISREG(info.st_mode)))
+        kind = FILES_ITEM_FILE;
+      else
+        kind = -1;
+    }
+    if (kind < 0) {
+      free(item);
+      continue;
+    }
+    item->kind = kind;
+    if (!push_item(worker, item)) {
+      worker->scan->abortstatus = -1;
+      break;
+    }
+  }
+  closedir(dir);
+  return 1;
+}
+#endif
+
+//check if a path given by the caller is a directory
+static int is_directory (const char* path)
+{
+#ifdef _WIN32
+  DWORD attributes = GetFileAttributesA(path);
+  return (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY));
+#else
+  struct stat info;
+  return (stat(path, &info) == 0 && S_ISDIR(info.st_mode));
+#endif
+}
+
+//search queued items until all items are finished
+static void run_worker (void* arg)
+{
+  struct files_worker* worker = (struct files_worker*)arg;
+  struct files_scan* scan = worker->scan;
+  struct files_item* item;
+  unsigned int i;
+  while (scan->abortstatus == 0) {
+    //take own items first, then items of other threads
+    if ((item = take_item(worker, 0)) == NULL) {
+      for (i = 1; i < scan->workercount && !item; i++)
+        item = take_item(scan->workers + (worker - scan->workers + i) % scan->workercount, 1);
+    }
+    if (!item) {
+      //done when no other thread is searching anything that may add items
+      if (MULTIFINDER_ATOMIC_LOAD(&scan->pending) == 0)
+        break;
+      multifinder_thread_yield();
+      continue;
+    }
+    if (item->kind == FILES_ITEM_DIRECTORY || (item->kind == FILES_ITEM_PATH && is_directory(item->path))) {
+      if (!search_directory(worker, item->path))
+        report_file(scan, item->path, -1, 0);
+      free(item);
+    } else {
+      search_file(worker, item);
+    }
+    MULTIFINDER_ATOMIC_DECREMENT(&scan->pending);
+  }
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_count_files (multifinder handle, const char* const* paths, size_t pathcount, unsigned int threads, size_t* patterncounts, multifinder_file_callback_fn filefunction, void* callbackdata, size_t* pcount)
+{
+  struct files_scan scan;
+  struct files_item* item;
+  size_t i;
+  unsigned int n;
+  if (threads == 0)
+    threads = multifinder_cpu_count();
+  if (threads > FILES_MAX_THREADS)
+    threads = FILES_MAX_THREADS;
+  //all files are searched with the same snapshot of a live pattern set
+  if (handle->live)
+    multifinder_live_update_handle(handle);
+  //compile once for all threads
+  if (multifinder_patternset_compile(handle->patternset) != 0)
+    return -1;
+  scan.patterncount = multifinder_count_patterns(handle);
+  scan.pending = 0;
+  scan.abortstatus = 0;
+  scan.largefiles = NULL;
+  scan.filefunction = filefunction;
+  scan.callbackdata = callbackdata;
+  if ((scan.lock = multifinder_mutex_create()) == NULL)
+    return -1;
+  if ((scan.workers = (struct files_worker*)calloc(threads, sizeof(struct files_worker))) == NULL) {
+    multifinder_mutex_free(scan.lock);
+    return -1;
+  }
+  //create a search handle and counters for each thread
+  for (n = 0; n < threads; n++) {
+    struct files_worker* worker = scan.workers + n;
+    worker->scan = &scan;
+    if ((worker->handle = multifinder_create_with_patternset_and_mode(handle->patternset, handle->mode, NULL, NULL, worker)) == NULL || (worker->lock = multifinder_mutex_create()) == NULL || (worker->patterncounts = (size_t*)calloc(scan.patterncount + 1, sizeof(size_t))) == NULL) {
+      scan.abortstatus = -1;
+      break;
+    }
+    multifinder_set_batch(worker->handle, worker->matches, FILES_BATCH_SIZE, count_matches);
+  }
+  scan.workercount = n;
+  //spread the paths over the threads
+  for (i = 0; i < pathcount && scan.abortstatus == 0; i++) {
+    if ((item = create_item(FILES_ITEM_PATH, NULL, paths[i])) == NULL || !push_item(scan.workers + i % scan.workercount, item))
+      scan.abortstatus = -1;
+  }
+  //search with the other threads and the calling thread
+  if (scan.abortstatus == 0) {
+    for (n = 1; n < scan.workercount; n++)
+      scan.workers[n].thread = multifinder_thread_create(run_worker, scan.workers + n);
+    run_worker(scan.workers);
+    for (n = 1; n < scan.workercount; n++) {
+      if (scan.workers[n].thread)
+        multifinder_thread_join(scan.workers[n].thread);
+    }
+  }
+  //scan large files in chunks using all threads
+  while ((item = scan.largefiles) != NULL) {
+    size_t count = 0;
+    int status;
+    scan.largefiles = item->next;
+    if (scan.abortstatus == 0) {
+      status = multifinder_process_file(scan.workers[0].handle, item->path, threads, &count);
+      multifinder_reset(scan.workers[0].handle);
+      scan.workers[0].count += count;
+      report_file(&scan, item->path, status, count);
+    }
+    free(item);
+  }
+  //add up the counters of all threads and clean up
+  if (pcount)
+    *pcount = 0;
+  for (n = 0; n < threads; n++) {
+    struct files_worker* worker = scan.workers + n;
+    while (worker->lock && (item = take_item(worker, 0)) != NULL)
+      free(item);
+    if (worker->patterncounts) {
+      if (patterncounts) {
+        for (i = 0; i < scan.patterncount; i++)
+          patterncounts[i] += worker->patterncounts[i];
+      }
+      if (pcount)
+        *pcount += worker->count;
+    }
+    free(worker->patterncounts);
+    free(worker->queue);
+    multifinder_mutex_free(worker->lock);
+    multifinder_free(worker->handle);
+  }
+  free(scan.workers);
+  multifinder_mutex_free(scan.lock);
+  return scan.abortstatus;
+}
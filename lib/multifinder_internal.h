@@ -0,0 +1,336 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* internal definitions shared by the library source files, not to be installed */
+
+#ifndef INCLUDED_MULTIFINDER_INTERNAL_H
+#define INCLUDED_MULTIFINDER_INTERNAL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "multifinder.h"
+
+#define MULTIFINDER_NO_STATE ((uint32_t)-1)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MULTIFINDER_ATOMIC_INCREMENT(p) _InterlockedIncrement(p)
+#define MULTIFINDER_ATOMIC_DECREMENT(p) _InterlockedDecrement(p)
+#define MULTIFINDER_ATOMIC_LOAD(p) (*(p))
+#define MULTIFINDER_ATOMIC_LOAD_POINTER(p) _InterlockedCompareExchangePointer((void* volatile*)(p), NULL, NULL)
+#define MULTIFINDER_ATOMIC_SET_POINTER_IF_NULL(p, value) (_InterlockedCompareExchangePointer((void* volatile*)(p), (value), NULL) == NULL)
+#else
+#define MULTIFINDER_ATOMIC_INCREMENT(p) __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+#define MULTIFINDER_ATOMIC_DECREMENT(p) __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL)
+#define MULTIFINDER_ATOMIC_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define MULTIFINDER_ATOMIC_LOAD_POINTER(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define MULTIFINDER_ATOMIC_SET_POINTER_IF_NULL(p, value) __extension__ ({ __typeof__(*(p)) expected_ = NULL; __atomic_compare_exchange_n(p, &expected_, (value), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); })
+#endif
+
+//statements only compiled in when statistics are collected
+#ifndef MULTIFINDER_NO_STATS
+#define MULTIFINDER_STAT(statement) statement
+#else
+#define MULTIFINDER_STAT(statement)
+#endif
+
+//ASCII case folding table (not locale dependant)
+extern const unsigned char multifinder_fold_table[256];
+
+//flag in multifinder_pattern.flags set for case sensitive patterns that contain letters (matches on case folded data must be verified)
+#define MULTIFINDER_PATTERN_FOLD_SENSITIVE 0x80000000U
+
+//pattern flag set when a pattern was removed (it keeps its index and is used again if the same pattern is added again)
+#define MULTIFINDER_PATTERN_REMOVED 0x40000000U
+
+//pattern flags that depend on the bytes before a match
+#define MULTIFINDER_PATTERN_ANCHORS_BEFORE (MULTIFIND_PATTERN_WORD_BEFORE | MULTIFIND_PATTERN_LINE_START)
+//pattern flags that depend on the bytes after a match (such matches can only be checked once the next byte is known)
+#define MULTIFINDER_PATTERN_ANCHORS_AFTER (MULTIFIND_PATTERN_WORD_AFTER | MULTIFIND_PATTERN_LINE_END)
+//pattern flags that are part of what makes a pattern unique
+#define MULTIFINDER_PATTERN_KEY_FLAGS (MULTIFIND_PATTERN_CASE_INSENSITIVE | MULTIFINDER_PATTERN_ANCHORS_BEFORE | MULTIFINDER_PATTERN_ANCHORS_AFTER)
+
+//maximum length of a single pattern
+#define MULTIFINDER_MAX_PATTERN_LENGTH ((uint32_t)-2)
+
+//fixed layout, so compiled pattern sets can be saved and used directly from a mapped file
+struct multifinder_pattern {
+  uint64_t offset;                              //position of the pattern data in the pattern data arena
+  uint32_t datalen;                             //length of pattern
+  uint32_t flags;                               //MULTIFIND_PATTERN_* flags (and MULTIFINDER_PATTERN_FOLD_SENSITIVE and MULTIFINDER_PATTERN_REMOVED)
+};
+
+struct multifinder_automaton_state {
+  uint32_t depth;                               //length of the input that leads to this state from the root
+  uint32_t extdepth;                            //depth of the deepest state in the failure chain (including this one) that can still be extended
+  uint32_t outputs;                             //index in outputs of the first pattern ending in this state
+  uint32_t outputcount;                         //number of patterns ending in this state
+  uint32_t outlink;                             //next state in the failure chain that has patterns ending in it (or MULTIFINDER_NO_STATE)
+};
+
+//set in the base of a state of a compact automaton if it has a single child in the trie (the rest of base is the child)
+#define MULTIFINDER_COMPACT_SINGLE 0x80000000U
+
+//transition stored in the double array of a compact automaton
+struct multifinder_compact_slot {
+  uint32_t check;                               //state the transition belongs to (or MULTIFINDER_NO_STATE if the slot is not used)
+  uint32_t next;                                //state the transition leads to
+};
+
+#define MULTIFINDER_PREFILTER_MAX_PATTERNS 64
+
+//maximum number of patterns for which rare bytes are looked for
+#define MULTIFINDER_PREFILTER_RARE_MAX_PATTERNS 8
+
+//maximum number of bytes the skip tables look ahead
+#define MULTIFINDER_PREFILTER_MAX_WINDOW 255
+//number of entries in the skip table
+#define MULTIFINDER_PREFILTER_SKIP_TABLE 65536
+
+struct multifinder_prefilter {
+  const unsigned char* (*find)(const struct multifinder_prefilter*, const unsigned char*, const unsigned char*); //returns first candidate position (or first position that could not be checked), at least length bytes must be supplied
+  unsigned int length;                          //number of leading pattern bytes checked (1 to 3), or length of the window checked with skip tables
+  unsigned char masks[3][256];                  //buckets accepting each byte value for each leading pattern byte
+  unsigned char lomasks[3][16];                 //buckets accepting each low nibble for each leading pattern byte
+  unsigned char himasks[3][16];                 //buckets accepting each high nibble for each leading pattern byte
+  unsigned char* shifts;                        //distance to skip for the last 2 or 3 bytes of the window (NULL unless all patterns are long)
+  unsigned char classes[MULTIFINDER_PREFILTER_MAX_WINDOW]; //byte classes of the start of a single long pattern
+  const unsigned char* classmap;                //byte classes of the automaton
+  const unsigned char* (*findbytes)(const unsigned char*, const unsigned char*, const unsigned char*); //returns first position of one of the rare bytes (or end if not found)
+  unsigned char rarebytes[3];                   //rare bytes that occur in all patterns (repeated if less than 3 are used)
+  unsigned char rareclasses[MULTIFINDER_PREFILTER_RARE_MAX_PATTERNS]; //byte class of the rare byte of each pattern
+  unsigned int rareoffsets[MULTIFINDER_PREFILTER_RARE_MAX_PATTERNS]; //position of the rare byte in each pattern
+  unsigned char rarestartclasses[MULTIFINDER_PREFILTER_RARE_MAX_PATTERNS]; //byte class of the first byte of each pattern
+  unsigned int rarecount;                       //number of patterns with a rare byte (0 if rare bytes are not used)
+  unsigned int rareminoffset;                   //smallest position of the rare byte in a pattern
+  unsigned int raremaxoffset;                   //largest position of the rare byte in a pattern
+  uint64_t* qgrams;                             //bits set for the hashes of the leading bytes of each pattern (NULL unless there are many patterns)
+  unsigned int qgramshift;                      //number of bits to shift a hash to get the index in qgrams
+  uint32_t qgrammask;                           //mask for the bytes hashed when reading 4 bytes at once
+  double falsepositiverate;                     //estimated fraction of positions without a pattern that pass the q-gram filter
+  int restart;                                  //non-zero to look for a new candidate as soon as the partial match being followed no longer includes the candidate
+};
+
+struct multifinder_automaton {
+  unsigned char classmap[256];                  //byte value to byte class (equivalent bytes share the same class)
+  unsigned int type;                            //MULTIFIND_AUTOMATON_DENSE or MULTIFIND_AUTOMATON_COMPACT
+  unsigned int stride2;                         //log2 of the length of a row in trans (0 for compact automata)
+  unsigned int classcount;                      //number of byte classes
+  uint32_t statecount;                          //number of states
+  uint32_t root;                                //start state (premultiplied)
+  uint32_t matchlimit;                          //states below this value (premultiplied) have patterns ending in them
+  uint32_t* trans;                              //transition table: trans[state + classmap[byte]] gives the next state (states are premultiplied by the row length, NULL for compact automata)
+  uint32_t* base;                               //compact automata only: child with MULTIFINDER_COMPACT_SINGLE set for states with a single child in the trie, otherwise position in slots of the transitions of the state
+  uint32_t* fail;                               //compact automata only: state to continue from when a state has no transition for a byte class
+  unsigned char* labels;                        //compact automata only: byte class of the transition of states with a single child
+  struct multifinder_compact_slot* slots;       //compact automata only: double array with the transitions of states with more than one child, slots[base[state] + class]
+  uint32_t slotcount;                           //number of entries in slots
+  uint32_t* rootnext;                           //compact automata only: next state from the root for each byte class
+  struct multifinder_automaton_state* states;   //state information, indexed by state >> stride2
+  uint32_t* outputs;                            //pattern indices ending in each state, in order of precedence
+  const struct multifinder_pattern* patterns;   //patterns indexed by precedence (owned by the pattern set)
+  const char* patterndata;                      //data of the patterns (owned by the pattern set)
+  void* const* callbackdata;                    //user callback data of each pattern (owned by the pattern set, NULL if none)
+  size_t patterncount;                          //number of patterns
+  size_t shortestpattern;                       //length of shortest pattern
+  size_t longestpattern;                        //length of longest pattern
+  int folded;                                   //non-zero if the automaton works on case folded input (matches for case sensitive patterns must be verified)
+  uint32_t anchors;                             //word and line flags used by any of the patterns (0 if matches never depend on the bytes around them)
+  unsigned char wordbytes[256];                 //non-zero for bytes that are part of words
+  int mapped;                                   //non-zero if the tables are part of a loaded compiled pattern set (and are not freed)
+  struct multifinder_prefilter* prefilter;      //prefilter to skip data in which no pattern starts (NULL if there are too many patterns)
+};
+
+struct multifinder_patternset_struct {
+  volatile long refcount;                       //number of owners (pattern set can only be changed when there is only one)
+  char* patterndata;                            //arena with the data of all patterns stored back to back (case folded for case insensitive patterns)
+  size_t patterndatalen;                        //number of bytes used in patterndata
+  size_t patterndatasize;                       //number of bytes allocated for patterndata
+  struct multifinder_pattern* patterns;         //search patterns in order of precedence
+  void** callbackdata;                          //user callback data of each pattern (NULL if none)
+  size_t patterncount;                          //number of patterns
+  size_t patternsize;                           //number of entries allocated for patterns and callbackdata
+  uint32_t* hashtable;                          //hash table of pattern indices plus one (open addressing, 0 if empty) to detect duplicates
+  size_t hashsize;                              //number of entries in hashtable (power of 2)
+  size_t shortestpattern;                       //length of shortest pattern (removed patterns may still be counted)
+  size_t longestpattern;                        //length of longest pattern (removed patterns may still be counted)
+  size_t removedcount;                          //number of patterns marked as removed
+  unsigned long generation;                     //incremented each time patterns are changed
+  struct multifinder_automaton* automaton;      //automaton compiled from patterns (NULL if not compiled since patterns were added)
+  unsigned int automatontype;                   //MULTIFIND_AUTOMATON_* type of automaton to compile
+  size_t memorybudget;                          //maximum number of bytes the compiled automaton may use (0 for no limit)
+  unsigned char wordbytes[256];                 //non-zero for bytes that are part of words
+  const char* mappeddata;                       //mapped file the patterns and automaton were loaded from (NULL if not loaded, the pattern set is read-only if set)
+  size_t mappedlen;                             //length of mappeddata
+};
+
+struct multifinder_struct {
+  multifinder_patternset patternset;            //search patterns (may be shared with other handles)
+  const struct multifinder_automaton* automaton;//automaton used by this handle (NULL if not compiled since patterns were added)
+  unsigned long generation;                     //generation of the pattern set the automaton was compiled from
+  multifinder_live live;                        //live pattern set whose published snapshots are followed (NULL if none)
+  long liveversion;                             //version of the snapshot of the live pattern set in patternset
+  multifinder_found_callback_fn foundfunction;  //user callback function called for each pattern match
+  multifinder_flush_callback_fn flushfunction;  //user callback function called for data without pattern match
+  void* callbackdata;                           //user callback data
+  unsigned int mode;                            //MULTIFIND_MODE_* match mode
+  size_t streampos;                             //position in input stream (only updated at end of multifinder_process())
+  size_t flushedpos;                            //number of input stream bytes that have been sent processed (by multifinder_found_callback_fn or multifinder_found_callback_fn)
+  int abortstatus;                              //when non-zero a callback functions requested to abort
+  uint32_t state;                               //current automaton state
+  int matchpending;                             //non-zero if a match was found but a match with higher precedence may still follow
+  int lookahead;                                //non-zero if the matches ending in the current state must still be checked (once the byte after them is known)
+  int context;                                  //byte right before the data kept in the ring buffer (-1 if that is the start of the stream)
+  size_t matchpos;                              //position in input stream of pending match
+  uint32_t matchpattern;                        //index of pattern of pending match
+  int useprefilter;                             //non-zero if the prefilter is used to skip data
+  size_t prefiltercandidates;                   //number of candidates found by the prefilter since its effectiveness was last checked
+  size_t prefilterskipped;                      //number of bytes skipped by the prefilter since its effectiveness was last checked
+  char* buf;                                    //ring buffer containing data that comes before data currently being processed and that can still be part of a match (allocated twice the size as each byte is stored twice)
+  size_t buflen;                                //number of bytes kept in the ring buffer (the ones right before streampos)
+  size_t bufsize;                               //size of the ring buffer (power of 2)
+  multifinder_match* batch;                     //matches not yet delivered in batch mode (NULL if not in batch mode)
+  size_t batchsize;                             //maximum number of matches in batch
+  size_t batchcount;                            //number of matches in batch
+  multifinder_batch_callback_fn batchfunction;  //user callback function called with a batch of matches
+  multifinder_output_callback_fn outputfunction;//user callback function called with output in replace mode (NULL if not in replace mode)
+  const multifinder_segment* replacements;      //replacement of each pattern in replace mode (NULL if the pattern callback data points to it)
+  size_t replacementcount;                      //number of entries in replacements
+  multifinder_segment* segments;                //output segments not yet delivered in replace mode (NULL if the output is copied to outbuffer)
+  size_t segmentsize;                           //maximum number of segments
+  size_t segmentcount;                          //number of segments
+  char* outbuffer;                              //buffer receiving the output in replace mode (NULL if segments are used)
+  size_t outbuffersize;                         //size of outbuffer
+  size_t outbufferlen;                          //number of bytes in outbuffer not yet delivered
+  char* carry;                                  //copies of data from the ring buffer referred to by segments
+  size_t carrysize;                             //size of carry
+  size_t carrylen;                              //number of bytes used in carry
+  multifinder_stats stats;                      //statistics (bytesprocessed only up to the last reset, patternmatches not set)
+  size_t statsstreampos;                        //stream position at which statistics were cleared
+  unsigned long long* patternmatches;           //number of matches for each pattern (NULL if not allocated)
+  size_t patternmatchescount;                   //number of entries in patternmatches
+  int timing;                                   //non-zero if time spent is measured
+};
+
+struct multifinder_automaton* multifinder_automaton_create (const struct multifinder_patternset_struct* patternset);
+
+void multifinder_automaton_free (struct multifinder_automaton* automaton);
+
+//create an unshared copy of the patterns of a pattern set that can be changed (even if the original is loaded from a file), returns NULL on error
+multifinder_patternset multifinder_patternset_copy (multifinder_patternset patternset);
+
+//switch a search handle that follows a live pattern set to its latest snapshot if it is not in the middle of a match
+void multifinder_live_update_handle (multifinder handle);
+
+//get the number of bytes used by an automaton
+size_t multifinder_automaton_memory (const struct multifinder_automaton* automaton);
+
+//get the number of bytes used by the transitions of an automaton (not including state information and prefilter)
+size_t multifinder_automaton_transition_memory (const struct multifinder_automaton* automaton);
+
+//release the mapped file a compiled pattern set was loaded from
+void multifinder_unmap_compiled (const char* data, size_t len);
+
+struct multifinder_prefilter* multifinder_prefilter_create (const struct multifinder_automaton* automaton);
+
+void multifinder_prefilter_free (struct multifinder_prefilter* prefilter);
+
+size_t multifinder_prefilter_memory (const struct multifinder_prefilter* prefilter);
+
+typedef void (*multifinder_thread_fn)(void* arg);
+
+typedef struct multifinder_thread_struct* multifinder_thread;
+
+//start a thread that runs function(arg), returns NULL on error
+multifinder_thread multifinder_thread_create (multifinder_thread_fn function, void* arg);
+
+//wait for a thread to finish and clean it up
+void multifinder_thread_join (multifinder_thread thread);
+
+//let other threads run before continuing
+void multifinder_thread_yield ();
+
+typedef struct multifinder_mutex_struct* multifinder_mutex;
+
+//create a mutex, returns NULL on error
+multifinder_mutex multifinder_mutex_create ();
+
+//wait until no other thread holds a mutex and take it
+void multifinder_mutex_lock (multifinder_mutex mutex);
+
+//release a mutex taken with multifinder_mutex_lock()
+void multifinder_mutex_unlock (multifinder_mutex mutex);
+
+//clean up a mutex (it must not be held)
+void multifinder_mutex_free (multifinder_mutex mutex);
+
+typedef struct multifinder_semaphore_struct* multifinder_semaphore;
+
+//create a semaphore with an initial count, returns NULL on error
+multifinder_semaphore multifinder_semaphore_create (unsigned int count);
+
+//wait until the count of a semaphore is not zero and decrement it
+void multifinder_semaphore_wait (multifinder_semaphore semaphore);
+
+//increment the count of a semaphore, waking up a waiting thread
+void multifinder_semaphore_post (multifinder_semaphore semaphore);
+
+//clean up a semaphore (no threads may be waiting for it)
+void multifinder_semaphore_free (multifinder_semaphore semaphore);
+
+//get the number of processors available
+unsigned int multifinder_cpu_count ();
+
+//get a monotonic time in nanoseconds
+unsigned long long multifinder_get_time ();
+
+//same as multifinder_process_file() but files larger than maxsize bytes are not searched (0 for no limit), returns 1 for those
+int multifinder_process_file_limited (multifinder handle, const char* filename, unsigned int threads, uint64_t maxsize, size_t* pcount);
+
+//same as multifinder_process() but in batch mode matches are not delivered at the end
+size_t multifinder_process_data (multifinder handle, const char* data, size_t datalen);
+
+//report the match of pattern patternindex at stream position pos (in batch mode only stored), returns zero if aborted
+int multifinder_report (multifinder handle, size_t pos, uint32_t patternindex, const char* data);
+
+//call the batch callback function with the matches stored in batch mode, returns zero if aborted
+int multifinder_deliver_batch (multifinder handle);
+
+//add data to the output in replace mode (copied unless it is in the data supplied to multifinder_process()), returns zero if aborted
+int multifinder_output (multifinder handle, const char* data, size_t datalen, int copy);
+
+//call the output callback function with the output collected in replace mode, returns zero if aborted
+int multifinder_deliver_output (multifinder handle);
+
+//add the scanning counters of the statistics of a search handle to the ones of another
+void multifinder_add_scan_stats (multifinder handle, const multifinder_stats* stats);
+
+//get pointer to stream data at position pos in the ring buffer (up to bufsize bytes are contiguous)
+#define RING_DATA(handle, pos) ((handle)->buf + ((pos) & ((handle)->bufsize - 1)))
+
+//store stream data for position pos in the ring buffer, every byte is stored twice so any part of the ring buffer is contiguous in memory
+void multifinder_ring_store (multifinder handle, size_t pos, const char* data, size_t datalen);
+
+//flush data up to stream position flushpos, data is the data supplied to multifinder_process() (NULL from multifinder_finalize())
+void multifinder_flush_data (multifinder handle, size_t flushpos, const char* data);
+
+#endif //INCLUDED_MULTIFINDER_INTERNAL_H
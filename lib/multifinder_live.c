@@ -0,0 +1,171 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Live pattern sets.
+
+  Patterns are never changed in a pattern set that search handles use. The
+  thread that changes the patterns collects the changes in a private copy of
+  the published snapshot (removed patterns are only marked, so pattern
+  indices stay the same in all snapshots). Publishing compiles the copy in
+  that thread and then swaps it in under a lock that is only held for the
+  swap, after which the version number is incremented.
+  Search handles following a live pattern set only compare the version
+  number when data is passed to them and take the new snapshot when it
+  changed. Each snapshot is reference counted, so the previous one is
+  released when the last search handle using it switches or is freed.
+*/
+
+#include <stdlib.h>
+#include "multifinder_internal.h"
+
+struct multifinder_live_struct {
+  volatile long refcount;                       //number of owners (the creator and each search handle following it)
+  multifinder_mutex lock;                       //protects current while it is swapped
+  multifinder_patternset current;               //latest published snapshot (compiled)
+  volatile long version;                        //incremented each time a snapshot is published
+  multifinder_patternset next;                  //unpublished copy with changes made since the last snapshot (NULL if none)
+};
+
+DLL_EXPORT_MULTIFINDER multifinder_live multifinder_live_create (multifinder_patternset patternset)
+{
+  struct multifinder_live_struct* result;
+  if ((result = (struct multifinder_live_struct*)malloc(sizeof(struct multifinder_live_struct))) == NULL)
+    return NULL;
+  if (patternset)
+    multifinder_patternset_reference(patternset);
+  else if ((patternset = multifinder_patternset_create()) == NULL) {
+    free(result);
+    return NULL;
+  }
+  if (multifinder_patternset_compile(patternset) != 0 || (result->lock = multifinder_mutex_create()) == NULL) {
+    multifinder_patternset_free(patternset);
+    free(result);
+    return NULL;
+  }
+  result->refcount = 1;
+  result->current = patternset;
+  result->version = 0;
+  result->next = NULL;
+  return result;
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_live_free (multifinder_live live)
+{
+  if (live && MULTIFINDER_ATOMIC_DECREMENT(&live->refcount) == 0) {
+    multifinder_patternset_free(live->current);
+    multifinder_patternset_free(live->next);
+    multifinder_mutex_free(live->lock);
+    free(live);
+  }
+}
+
+//get the copy of the latest snapshot in which changes are collected, returns NULL on error
+static multifinder_patternset get_next (multifinder_live live)
+{
+  if (!live->next)
+    live->next = multifinder_patternset_copy(live->current);
+  return live->next;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_live_add_pattern (multifinder_live live, const char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata)
+{
+  multifinder_patternset next;
+  if ((next = get_next(live)) == NULL)
+    return -1;
+  return multifinder_patternset_add_patterns(next, &pattern, &patternlen, 1, flags, &patterncallbackdata);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_live_remove_pattern (multifinder_live live, const char* pattern, size_t patternlen, unsigned int flags)
+{
+  multifinder_patternset next;
+  if ((next = get_next(live)) == NULL)
+    return -1;
+  return multifinder_patternset_remove_pattern(next, pattern, patternlen, flags);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_live_publish (multifinder_live live)
+{
+  multifinder_patternset previous;
+  if (!live->next)
+    return 0;
+  //compile before taking the lock so search handles never wait for it
+  if (multifinder_patternset_compile(live->next) != 0)
+    return -1;
+  multifinder_mutex_lock(live->lock);
+  previous = live->current;
+  live->current = live->next;
+  MULTIFINDER_ATOMIC_INCREMENT(&live->version);
+  multifinder_mutex_unlock(live->lock);
+  live->next = NULL;
+  //search handles still using the previous snapshot keep their own reference
+  multifinder_patternset_free(previous);
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_live_get_patternset (multifinder_live live)
+{
+  multifinder_patternset result;
+  multifinder_mutex_lock(live->lock);
+  result = live->current;
+  multifinder_patternset_reference(result);
+  multifinder_mutex_unlock(live->lock);
+  return result;
+}
+
+void multifinder_live_update_handle (multifinder handle)
+{
+  multifinder_live live = handle->live;
+  multifinder_patternset previous;
+  //a pending match is reported with the patterns it was found with first
+  if (MULTIFINDER_ATOMIC_LOAD(&live->version) == handle->liveversion || handle->matchpending)
+    return;
+  previous = handle->patternset;
+  multifinder_mutex_lock(live->lock);
+  handle->patternset = live->current;
+  handle->liveversion = live->version;
+  multifinder_patternset_reference(handle->patternset);
+  multifinder_mutex_unlock(live->lock);
+  multifinder_patternset_free(previous);
+  //data kept in the buffer is scanned again with the new snapshot
+  handle->automaton = NULL;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder multifinder_create_live (multifinder_live live, unsigned int mode, multifinder_found_callback_fn foundfunction, multifinder_flush_callback_fn flushfunction, void* callbackdata)
+{
+  multifinder result;
+  multifinder_patternset patternset;
+  long version;
+  multifinder_mutex_lock(live->lock);
+  patternset = live->current;
+  version = live->version;
+  multifinder_patternset_reference(patternset);
+  multifinder_mutex_unlock(live->lock);
+  //the snapshot is already compiled, the search handle takes its own reference
+  if ((result = multifinder_create_with_patternset_and_mode(patternset, mode, foundfunction, flushfunction, callbackdata)) != NULL) {
+    MULTIFINDER_ATOMIC_INCREMENT(&live->refcount);
+    result->live = live;
+    result->liveversion = version;
+  }
+  multifinder_patternset_free(patternset);
+  return result;
+}
@@ -0,0 +1,312 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Scanning of large blocks of data using multiple threads.
+
+  The data is split in chunks that are scanned by separate threads, each
+  starting from the root of the automaton and collecting the matches that start
+  in the chunk. To complete those matches each thread scans up to the length of
+  the longest pattern past the end of its chunk.
+  A thread can't know where the previous match ended, so its first matches may
+  differ from the ones found by scanning all data in one go. The calling thread
+  therefore scans serially from the end of the last reported match until it
+  reaches a position where the results of the chunk can be trusted: with the
+  automaton in its start state and the collected match before that position
+  (if any) not extending beyond it. From there on the results are identical to
+  a serial scan and are reported in order from the calling thread.
+  When reporting overlapping matches the state of the automaton only depends
+  on the data before it, so each thread starts scanning the length of the
+  longest pattern before its chunk and collects the matches ending in it. The
+  calling thread reports them and only needs to scan the end of each chunk
+  again to continue in the same state.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "multifinder_internal.h"
+
+//minimum amount of data scanned by each thread
+#define PARALLEL_MIN_CHUNK (1024 * 1024)
+//chunks must be much larger than the longest pattern as data near the start of a chunk may be scanned twice
+#define PARALLEL_CHUNK_PATTERN_FACTOR 64
+//amount of data scanned serially at once when looking for a position where the results of a chunk can be used
+#define PARALLEL_SYNC_WINDOW 256
+//maximum number of threads
+#define PARALLEL_MAX_THREADS 256
+
+//number of matches a thread collects before adding them to the results of its chunk
+#define PARALLEL_BATCH_SIZE 256
+
+struct parallel_chunk {
+  multifinder_patternset patternset;            //compiled pattern set to search
+  unsigned int mode;                            //MULTIFIND_MODE_* match mode
+  const char* data;                             //start of chunk (in overlapping mode including the end of the previous chunk)
+  size_t datalen;                               //length of chunk (only matches starting in the chunk are collected, in overlapping mode all matches)
+  size_t scanlen;                               //length of data to scan (chunk plus the data needed to complete matches starting in it)
+  int context;                                  //byte before the chunk (-1 at the start of the stream)
+  multifinder_match batch[PARALLEL_BATCH_SIZE]; //batch of matches being collected
+  multifinder_match* matches;                   //matches found in chunk (positions are relative to the start of the chunk)
+  size_t matchcount;                            //number of matches found in chunk
+  size_t matchsize;                             //allocated number of matches
+  int error;                                    //non-zero if scanning the chunk failed
+  multifinder_stats stats;                      //statistics of scanning the chunk
+  multifinder_thread thread;                    //thread scanning the chunk (NULL if scanned by the calling thread)
+};
+
+static int collect_matches (const multifinder_match* matches, size_t count, void* callbackdata)
+{
+  struct parallel_chunk* chunk = (struct parallel_chunk*)callbackdata;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    //stop at the first match that starts after the chunk
+    if (matches[i].pos >= chunk->datalen && chunk->mode != MULTIFIND_MODE_OVERLAPPING)
+      return 1;
+    //overlapping matches ending after the chunk (only found when the byte after the chunk is scanned as well) are left to the next chunk
+    if (matches[i].pos + matches[i].length > chunk->datalen && chunk->mode == MULTIFIND_MODE_OVERLAPPING)
+      continue;
+    if (chunk->matchcount == chunk->matchsize) {
+      multifinder_match* newmatches;
+      size_t newsize = (chunk->matchsize ? chunk->matchsize * 2 : 1024);
+      if ((newmatches = (multifinder_match*)realloc(chunk->matches, newsize * sizeof(multifinder_match))) == NULL) {
+        chunk->error = 1;
+        return 1;
+      }
+      chunk->matches = newmatches;
+      chunk->matchsize = newsize;
+    }
+    chunk->matches[chunk->matchcount++] = matches[i];
+  }
+  return 0;
+}
+
+static void scan_chunk (void* arg)
+{
+  struct parallel_chunk* chunk = (struct parallel_chunk*)arg;
+  multifinder handle;
+  if ((handle = multifinder_create_with_patternset_and_mode(chunk->patternset, chunk->mode, NULL, NULL, chunk)) == NULL) {
+    chunk->error = 1;
+    return;
+  }
+  multifinder_set_batch(handle, chunk->batch, PARALLEL_BATCH_SIZE, collect_matches);
+  //patterns with word or line flags look at the byte before the chunk
+  handle->context = chunk->context;
+  //no finalize needed: a match is always reported before scanning the longest pattern length past its start
+  multifinder_process(handle, chunk->data, chunk->scanlen);
+  if (multifinder_aborted(handle) < 0)
+    chunk->error = 1;
+  MULTIFINDER_STAT(multifinder_get_stats(handle, &chunk->stats));
+  multifinder_free(handle);
+}
+
+//check if the serial scan can continue with the results of a chunk at position pos (relative to the chunk), returns the index of the first match to report or (size_t)-1
+static size_t sync_chunk (multifinder handle, const struct parallel_chunk* chunk, size_t pos)
+{
+  size_t i = 0;
+  //only possible when the automaton is in its start state and nothing is pending
+  if (!handle->automaton || handle->generation != handle->patternset->generation || handle->buflen != 0 || handle->matchpending)
+    return (size_t)-1;
+  while (i < chunk->matchcount && chunk->matches[i].pos < pos)
+    i++;
+  //the match before must not extend beyond the current position
+  if (i > 0 && chunk->matches[i - 1].pos + chunk->matches[i - 1].length > pos)
+    return (size_t)-1;
+  return i;
+}
+
+//report matches of a chunk from the calling thread and continue after them, p points to the data at the current stream position, returns the number of matches reported
+static size_t report_chunk (multifinder handle, const struct parallel_chunk* chunk, size_t i, const char* p)
+{
+  size_t base = handle->streampos - (p - chunk->data);
+  size_t count = 0;
+  size_t end;
+  for (; i < chunk->matchcount; i++) {
+    count++;
+    if (!multifinder_report(handle, base + chunk->matches[i].pos, (uint32_t)chunk->matches[i].pattern, p))
+      return count;
+  }
+  //no other match starts in the chunk, so continue after the chunk or the last match
+  end = base + chunk->datalen;
+  if (handle->flushedpos > end)
+    end = handle->flushedpos;
+  multifinder_flush_data(handle, end, p);
+  handle->context = (unsigned char)p[end - handle->streampos - 1];
+  handle->streampos = end;
+  return count;
+}
+
+//report overlapping matches of a chunk ending after the current position from the calling thread and continue at the end of the chunk, p points to the data at the current stream position, returns the number of matches reported
+static size_t report_chunk_overlapping (multifinder handle, const struct parallel_chunk* chunk, const char* p, size_t longest)
+{
+  size_t base = handle->streampos - (p - chunk->data);
+  size_t count = 0;
+  size_t end;
+  size_t i;
+  //matches ending at the current position are still unreported if the serial scan left checking them for the next byte
+  size_t reported = handle->streampos - (handle->lookahead && handle->flushedpos < handle->streampos ? 1 : 0);
+  for (i = 0; i < chunk->matchcount; i++) {
+    //matches ending before the current position were reported by the serial scan
+    if (base + chunk->matches[i].pos + chunk->matches[i].length <= reported)
+      continue;
+    count++;
+    if (!multifinder_report(handle, base + chunk->matches[i].pos, (uint32_t)chunk->matches[i].pattern, p))
+      return count;
+  }
+  //scan the end of the chunk again to get the automaton in the right state (the matches found there were already reported)
+  end = base + chunk->datalen;
+  multifinder_flush_data(handle, end, p);
+  handle->state = handle->automaton->root;
+  handle->lookahead = 0;
+  handle->context = (unsigned char)chunk->data[chunk->datalen - longest - 1];
+  handle->buflen = 0;
+  handle->streampos = end - longest;
+  multifinder_process_data(handle, chunk->data + chunk->datalen - longest, longest);
+  return count;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_process_parallel (multifinder handle, const char* data, size_t datalen, unsigned int threads)
+{
+  struct parallel_chunk* chunks;
+  size_t longest;
+  size_t chunksize;
+  size_t limit;
+  size_t pos;
+  size_t start;
+  size_t count = 0;
+  unsigned int n;
+  unsigned int i;
+  MULTIFINDER_STAT(unsigned long long totaltime = handle->stats.totaltime);
+  MULTIFINDER_STAT(unsigned long long starttime = (handle->timing ? multifinder_get_time() : 0));
+  if (threads == 0)
+    threads = multifinder_cpu_count();
+  if (threads > PARALLEL_MAX_THREADS)
+    threads = PARALLEL_MAX_THREADS;
+  //all chunks are scanned with the same snapshot of a live pattern set
+  if (handle->live && handle->abortstatus == 0)
+    multifinder_live_update_handle(handle);
+  if (handle->abortstatus != 0 || threads < 2 || multifinder_patternset_compile(handle->patternset) != 0)
+    return multifinder_process(handle, data, datalen);
+  longest = handle->patternset->longestpattern;
+  chunksize = longest * PARALLEL_CHUNK_PATTERN_FACTOR;
+  if (chunksize < PARALLEL_MIN_CHUNK)
+    chunksize = PARALLEL_MIN_CHUNK;
+  if (longest == 0 || datalen < chunksize * 2 + longest)
+    return multifinder_process(handle, data, datalen);
+  if ((chunks = (struct parallel_chunk*)calloc(threads, sizeof(struct parallel_chunk))) == NULL)
+    return multifinder_process(handle, data, datalen);
+  //the end of the data is scanned serially as matches there may continue in the next data
+  limit = datalen - longest;
+  pos = 0;
+  start = 0;
+  while (start < limit) {
+    //scan the next chunks in parallel, the calling thread takes the first one
+    for (n = 0; n < threads && start < limit; n++) {
+      struct parallel_chunk* chunk = chunks + n;
+      chunk->patternset = handle->patternset;
+      chunk->mode = handle->mode;
+      chunk->data = data + start;
+      chunk->datalen = (limit - start < chunksize ? limit - start : chunksize);
+      chunk->scanlen = chunk->datalen + longest;
+      if (handle->mode == MULTIFIND_MODE_OVERLAPPING) {
+        //matches ending in the chunk can start up to the longest pattern length before it
+        if (start > 0) {
+          chunk->data -= longest;
+          chunk->datalen += longest;
+        }
+        //the byte after the chunk is needed to check matches ending at its end (there is always data after it)
+        chunk->scanlen = chunk->datalen + 1;
+      }
+      if (chunk->data > data)
+        chunk->context = (unsigned char)chunk->data[-1];
+      else
+        chunk->context = (handle->buflen > 0 ? (unsigned char)*RING_DATA(handle, handle->streampos - 1) : handle->context);
+      chunk->matchcount = 0;
+      chunk->error = 0;
+      MULTIFINDER_STAT(memset(&chunk->stats, 0, sizeof(multifinder_stats)));
+      chunk->thread = (n > 0 ? multifinder_thread_create(scan_chunk, chunk) : NULL);
+      start += chunk->datalen;
+    }
+    for (i = 0; i < n; i++) {
+      if (chunks[i].thread)
+        multifinder_thread_join(chunks[i].thread);
+      else
+        scan_chunk(chunks + i);
+    }
+    //report the results in order
+    for (i = 0; i < n; i++) {
+      struct parallel_chunk* chunk = chunks + i;
+      size_t chunkend = (chunk->data - data) + chunk->datalen;
+      MULTIFINDER_STAT(multifinder_add_scan_stats(handle, &chunk->stats));
+      if (chunk->error) {
+        start = limit;
+        break;
+      }
+      if (handle->mode == MULTIFIND_MODE_OVERLAPPING) {
+        size_t streampos;
+        //the first chunk may have missed matches that start in earlier data
+        if (pos < (size_t)(chunk->data - data) + longest) {
+          size_t len = (size_t)(chunk->data - data) + longest - pos;
+          count += multifinder_process_data(handle, data + pos, len);
+          pos += len;
+        }
+        if (handle->abortstatus != 0)
+          break;
+        streampos = handle->streampos;
+        count += report_chunk_overlapping(handle, chunk, data + pos, longest);
+        pos += handle->streampos - streampos;
+        if (handle->abortstatus != 0)
+          break;
+        continue;
+      }
+      while (pos < chunkend) {
+        size_t first;
+        size_t len;
+        if ((first = sync_chunk(handle, chunk, pos - (chunk->data - data))) != (size_t)-1) {
+          size_t streampos = handle->streampos;
+          count += report_chunk(handle, chunk, first, data + pos);
+          pos += handle->streampos - streampos;
+          break;
+        }
+        len = (datalen - pos < PARALLEL_SYNC_WINDOW ? datalen - pos : PARALLEL_SYNC_WINDOW);
+        count += multifinder_process_data(handle, data + pos, len);
+        pos += len;
+        if (handle->abortstatus != 0)
+          break;
+      }
+      if (handle->abortstatus != 0)
+        break;
+    }
+    if (handle->abortstatus != 0)
+      break;
+  }
+  for (i = 0; i < threads; i++)
+    free(chunks[i].matches);
+  free(chunks);
+  //process the rest serially
+  if (handle->abortstatus == 0)
+    count += multifinder_process(handle, data + pos, datalen - pos);
+  else
+    handle->streampos += datalen - pos;
+  //the time of the serial part is already included
+  MULTIFINDER_STAT(if (handle->timing) handle->stats.totaltime = totaltime + (multifinder_get_time() - starttime));
+  return count;
+}
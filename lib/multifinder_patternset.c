@@ -0,0 +1,501 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Pattern sets hold the search patterns and the automaton compiled from them.
+  Once compiled and referenced by more than one owner a pattern set is
+  read-only, so it can be shared by search handles in different threads.
+  The pattern data is stored back to back in a single arena and the patterns
+  themselves in a packed array referring to it by offset, so a pattern costs
+  little more than its own bytes and everything is released with a few calls.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "multifinder.h"
+#include "multifinder_internal.h"
+
+const unsigned char multifinder_fold_table[256] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+  0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+  0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+  0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+  0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+  0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+  0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F,
+  0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
+  0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
+  0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+  0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
+  0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF,
+  0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
+  0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+  0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+};
+
+//fill in the default bytes that are part of words: ASCII letters, digits, underscores and all bytes that are part of UTF-8 encoded characters
+static void default_word_bytes (unsigned char* wordbytes)
+{
+  int i;
+  for (i = 0; i < 256; i++)
+    wordbytes[i] = ((i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_' || i >= 0x80);
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_patternset_create ()
+{
+  struct multifinder_patternset_struct* result;
+  if ((result = (struct multifinder_patternset_struct*)malloc(sizeof(struct multifinder_patternset_struct))) != NULL) {
+    result->refcount = 1;
+    result->patterndata = NULL;
+    result->patterndatalen = 0;
+    result->patterndatasize = 0;
+    result->patterns = NULL;
+    result->callbackdata = NULL;
+    result->patterncount = 0;
+    result->patternsize = 0;
+    result->hashtable = NULL;
+    result->hashsize = 0;
+    result->shortestpattern = 0;
+    result->longestpattern = 0;
+    result->removedcount = 0;
+    result->generation = 0;
+    result->automaton = NULL;
+    result->automatontype = MULTIFIND_AUTOMATON_AUTO;
+    result->memorybudget = 0;
+    default_word_bytes(result->wordbytes);
+    result->mappeddata = NULL;
+    result->mappedlen = 0;
+  }
+  return result;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_patternset multifinder_patternset_reference (multifinder_patternset patternset)
+{
+  if (patternset)
+    MULTIFINDER_ATOMIC_INCREMENT(&patternset->refcount);
+  return patternset;
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_patternset_free (multifinder_patternset patternset)
+{
+  if (patternset && MULTIFINDER_ATOMIC_DECREMENT(&patternset->refcount) == 0) {
+    multifinder_automaton_free(patternset->automaton);
+    if (patternset->mappeddata) {
+      multifinder_unmap_compiled(patternset->mappeddata, patternset->mappedlen);
+    } else {
+      free(patternset->patterndata);
+      free(patternset->patterns);
+      free(patternset->callbackdata);
+    }
+    free(patternset->hashtable);
+    free(patternset);
+  }
+}
+
+//hash of pattern data (FNV-1a) combined with the flags that make a pattern unique
+static size_t hash_pattern (const char* data, size_t datalen, unsigned int flags)
+{
+  uint32_t hash = 2166136261U;
+  size_t i;
+  for (i = 0; i < datalen; i++)
+    hash = (hash ^ (unsigned char)data[i]) * 16777619U;
+  hash = (hash ^ (flags & MULTIFINDER_PATTERN_KEY_FLAGS)) * 16777619U;
+  return (size_t)hash;
+}
+
+//find the slot in the hash table where the pattern is (or where it should be added)
+static uint32_t* find_pattern (multifinder_patternset patternset, const char* data, size_t datalen, unsigned int flags)
+{
+  size_t mask = patternset->hashsize - 1;
+  size_t i = hash_pattern(data, datalen, flags) & mask;
+  const struct multifinder_pattern* entry;
+  while (patternset->hashtable[i] != 0) {
+    entry = patternset->patterns + patternset->hashtable[i] - 1;
+    if (entry->datalen == datalen && (entry->flags & MULTIFINDER_PATTERN_KEY_FLAGS) == (flags & MULTIFINDER_PATTERN_KEY_FLAGS) && memcmp(patternset->patterndata + entry->offset, data, datalen) == 0)
+      break;
+    i = (i + 1) & mask;
+  }
+  return &patternset->hashtable[i];
+}
+
+//make sure the hash table has room for one more pattern (it is kept at most half full), returns zero on error
+static int grow_hashtable (multifinder_patternset patternset)
+{
+  uint32_t* oldtable = patternset->hashtable;
+  const struct multifinder_pattern* entry;
+  size_t newsize;
+  size_t i;
+  if ((patternset->patterncount + 1) * 2 <= patternset->hashsize)
+    return 1;
+  newsize = (patternset->hashsize ? patternset->hashsize * 2 : 64);
+  while ((patternset->patterncount + 1) * 2 > newsize)
+    newsize *= 2;
+  if ((patternset->hashtable = (uint32_t*)calloc(newsize, sizeof(uint32_t))) == NULL) {
+    patternset->hashtable = oldtable;
+    return 0;
+  }
+  patternset->hashsize = newsize;
+  for (i = 0; i < patternset->patterncount; i++) {
+    entry = patternset->patterns + i;
+    *find_pattern(patternset, patternset->patterndata + entry->offset, entry->datalen, entry->flags) = (uint32_t)i + 1;
+  }
+  free(oldtable);
+  return 1;
+}
+
+//release the compiled automaton so it is compiled again before the next search
+static void invalidate_automaton (multifinder_patternset patternset)
+{
+  multifinder_automaton_free(patternset->automaton);
+  patternset->automaton = NULL;
+  patternset->generation++;
+}
+
+//make sure there is room for one more pattern of patternlen bytes, returns zero on error
+static int grow_storage (multifinder_patternset patternset, size_t patternlen)
+{
+  //the automaton refers to the storage that is about to move (even if the new pattern turns out to be a duplicate)
+  if (patternset->automaton && (patternset->patterndatasize - patternset->patterndatalen < patternlen || patternset->patterncount == patternset->patternsize))
+    invalidate_automaton(patternset);
+  if (patternset->patterndatasize - patternset->patterndatalen < patternlen) {
+    char* newdata;
+    size_t newsize = (patternset->patterndatasize ? patternset->patterndatasize : 4096);
+    while (newsize - patternset->patterndatalen < patternlen)
+      newsize *= 2;
+    if ((newdata = (char*)realloc(patternset->patterndata, newsize)) == NULL)
+      return 0;
+    patternset->patterndata = newdata;
+    patternset->patterndatasize = newsize;
+  }
+  if (patternset->patterncount == patternset->patternsize) {
+    struct multifinder_pattern* newpatterns;
+    void** newcallbackdata;
+    size_t newsize = (patternset->patternsize ? patternset->patternsize * 2 : 64);
+    if ((newpatterns = (struct multifinder_pattern*)realloc(patternset->patterns, newsize * sizeof(struct multifinder_pattern))) == NULL)
+      return 0;
+    patternset->patterns = newpatterns;
+    if ((newcallbackdata = (void**)realloc(patternset->callbackdata, newsize * sizeof(void*))) == NULL)
+      return 0;
+    patternset->callbackdata = newcallbackdata;
+    patternset->patternsize = newsize;
+  }
+  return grow_hashtable(patternset);
+}
+
+//release unused storage (the hash table is rebuilt when more patterns are added)
+static void compact_storage (multifinder_patternset patternset)
+{
+  char* newdata;
+  struct multifinder_pattern* newpatterns;
+  void** newcallbackdata;
+  if (patternset->patterndatalen > 0 && patternset->patterndatalen < patternset->patterndatasize && (newdata = (char*)realloc(patternset->patterndata, patternset->patterndatalen)) != NULL) {
+    patternset->patterndata = newdata;
+    patternset->patterndatasize = patternset->patterndatalen;
+  }
+  if (patternset->patterncount > 0 && patternset->patterncount < patternset->patternsize && (newpatterns = (struct multifinder_pattern*)realloc(patternset->patterns, patternset->patterncount * sizeof(struct multifinder_pattern))) != NULL) {
+    patternset->patterns = newpatterns;
+    patternset->patternsize = patternset->patterncount;
+    if ((newcallbackdata = (void**)realloc(patternset->callbackdata, patternset->patterncount * sizeof(void*))) != NULL)
+      patternset->callbackdata = newcallbackdata;
+  }
+  free(patternset->hashtable);
+  patternset->hashtable = NULL;
+  patternset->hashsize = 0;
+}
+
+//copy a pattern into the pattern set, returns 0 on success or non-zero on error
+static int add_pattern_data (multifinder_patternset patternset, const char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata)
+{
+  struct multifinder_pattern* entry;
+  uint32_t* slot;
+  char* data;
+  size_t i;
+  //a pattern set shared with others or loaded from a file can't be changed
+  if (MULTIFINDER_ATOMIC_LOAD(&patternset->refcount) > 1 || patternset->mappeddata)
+    return -1;
+  //empty patterns can't be searched for
+  if (patternlen == 0)
+    return 0;
+  if (patternlen > MULTIFINDER_MAX_PATTERN_LENGTH || patternset->patterncount >= MULTIFINDER_NO_STATE - 1 || !grow_storage(patternset, patternlen))
+    return -1;
+  //copy to the end of the arena, folding case insensitive patterns once so the scanner only needs to fold input data via a table
+  flags &= MULTIFINDER_PATTERN_KEY_FLAGS;
+  data = patternset->patterndata + patternset->patterndatalen;
+  for (i = 0; i < patternlen; i++) {
+    unsigned char c = (unsigned char)pattern[i];
+    if (flags & MULTIFIND_PATTERN_CASE_INSENSITIVE)
+      c = multifinder_fold_table[c];
+    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+      flags |= MULTIFINDER_PATTERN_FOLD_SENSITIVE;
+    data[i] = (char)c;
+  }
+  //abort if the same pattern was already added (the copied data is simply not kept), unless it was removed
+  if (*(slot = find_pattern(patternset, data, patternlen, flags)) != 0) {
+    entry = patternset->patterns + *slot - 1;
+    if (entry->flags & MULTIFINDER_PATTERN_REMOVED) {
+      entry->flags &= ~MULTIFINDER_PATTERN_REMOVED;
+      patternset->callbackdata[*slot - 1] = patterncallbackdata;
+      patternset->removedcount--;
+      if (patternset->shortestpattern == 0 || patternlen < patternset->shortestpattern)
+        patternset->shortestpattern = patternlen;
+      if (patternlen > patternset->longestpattern)
+        patternset->longestpattern = patternlen;
+      invalidate_automaton(patternset);
+    }
+    return 0;
+  }
+  //add after last entry
+  entry = patternset->patterns + patternset->patterncount;
+  entry->offset = patternset->patterndatalen;
+  entry->datalen = (uint32_t)patternlen;
+  entry->flags = flags;
+  patternset->callbackdata[patternset->patterncount] = patterncallbackdata;
+  *slot = (uint32_t)++patternset->patterncount;
+  patternset->patterndatalen += patternlen;
+  //update values
+  if (patternset->shortestpattern == 0 || patternlen < patternset->shortestpattern)
+    patternset->shortestpattern = patternlen;
+  if (patternlen > patternset->longestpattern)
+    patternset->longestpattern = patternlen;
+  //automaton needs to be compiled again
+  invalidate_automaton(patternset);
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_pattern (multifinder_patternset patternset, const char* pattern, unsigned int flags, void* patterncallbackdata)
+{
+  if (pattern && *pattern)
+    return add_pattern_data(patternset, pattern, strlen(pattern), flags, patterncallbackdata);
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_allocated_pattern (multifinder_patternset patternset, char* pattern, size_t patternlen, unsigned int flags, void* patterncallbackdata)
+{
+  int status = add_pattern_data(patternset, pattern, patternlen, flags, patterncallbackdata);
+  free(pattern);
+  return status;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_patterns (multifinder_patternset patternset, const char* const* patterns, const size_t* patternlens, size_t count, unsigned int flags, void* const* patterncallbackdata)
+{
+  size_t i;
+  for (i = 0; i < count; i++) {
+    if (add_pattern_data(patternset, patterns[i], (patternlens ? patternlens[i] : strlen(patterns[i])), flags, (patterncallbackdata ? patterncallbackdata[i] : NULL)) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_add_patterns_from_file (multifinder_patternset patternset, const char* filename, unsigned int flags)
+{
+  FILE* src;
+  char* data = NULL;
+  size_t datalen = 0;
+  size_t datasize = 0;
+  size_t len;
+  size_t start;
+  size_t i;
+  char separator;
+  int status = 0;
+  //read whole file
+  if ((src = fopen(filename, "rb")) == NULL)
+    return -1;
+  for (;;) {
+    if (datalen == datasize) {
+      char* newdata;
+      datasize = (datasize ? datasize * 2 : 65536);
+      if ((newdata = (char*)realloc(data, datasize)) == NULL) {
+        free(data);
+        fclose(src);
+        return -1;
+      }
+      data = newdata;
+    }
+    if ((len = fread(data + datalen, 1, datasize - datalen, src)) == 0)
+      break;
+    datalen += len;
+  }
+  if (ferror(src))
+    status = -1;
+  fclose(src);
+  //patterns are separated by NULL bytes if there are any, otherwise by newlines (with or without carriage return)
+  separator = (memchr(data, 0, datalen) ? '\0' : '\n');
+  start = 0;
+  for (i = 0; status == 0 && i <= datalen; i++) {
+    if (i == datalen || data[i] == separator) {
+      len = i - start;
+      if (separator == '\n' && len > 0 && data[start + len - 1] == '\r')
+        len--;
+      status = add_pattern_data(patternset, data + start, len, flags, NULL);
+      start = i + 1;
+    }
+  }
+  free(data);
+  return status;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_count_patterns (multifinder_patternset patternset)
+{
+  return patternset->patterncount;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_get_longest_pattern (multifinder_patternset patternset)
+{
+  return patternset->longestpattern;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_get_pattern_memory (multifinder_patternset patternset)
+{
+  //patterns loaded from a file are only counted once (they don't need room for more patterns or callback data)
+  if (patternset->mappeddata)
+    return sizeof(struct multifinder_patternset_struct) + patternset->patterndatalen + patternset->patterncount * sizeof(struct multifinder_pattern);
+  return sizeof(struct multifinder_patternset_struct) + patternset->patterndatasize + patternset->patternsize * (sizeof(struct multifinder_pattern) + sizeof(void*)) + patternset->hashsize * sizeof(uint32_t);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_compile (multifinder_patternset patternset)
+{
+  struct multifinder_automaton* automaton;
+  if (!MULTIFINDER_ATOMIC_LOAD_POINTER(&patternset->automaton)) {
+    //with a single owner nothing else can be using the storage, so it can be trimmed to what is needed
+    if (MULTIFINDER_ATOMIC_LOAD(&patternset->refcount) == 1)
+      compact_storage(patternset);
+    if ((automaton = multifinder_automaton_create(patternset)) == NULL)
+      return -1;
+    //another thread may have compiled the same pattern set in the mean time
+    if (!MULTIFINDER_ATOMIC_SET_POINTER_IF_NULL(&patternset->automaton, automaton))
+      multifinder_automaton_free(automaton);
+  }
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_set_automaton (multifinder_patternset patternset, unsigned int type, size_t memorybudget)
+{
+  //a pattern set shared with others or loaded from a file can't be changed
+  if (type > MULTIFIND_AUTOMATON_COMPACT || MULTIFINDER_ATOMIC_LOAD(&patternset->refcount) > 1 || patternset->mappeddata)
+    return -1;
+  if (type != patternset->automatontype || memorybudget != patternset->memorybudget) {
+    patternset->automatontype = type;
+    patternset->memorybudget = memorybudget;
+    invalidate_automaton(patternset);
+  }
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_set_word_bytes (multifinder_patternset patternset, const char* wordbytes, size_t wordbyteslen)
+{
+  unsigned char newwordbytes[256];
+  size_t i;
+  //a pattern set shared with others or loaded from a file can't be changed
+  if (MULTIFINDER_ATOMIC_LOAD(&patternset->refcount) > 1 || patternset->mappeddata)
+    return -1;
+  if (wordbytes) {
+    memset(newwordbytes, 0, sizeof(newwordbytes));
+    for (i = 0; i < wordbyteslen; i++)
+      newwordbytes[(unsigned char)wordbytes[i]] = 1;
+  } else {
+    default_word_bytes(newwordbytes);
+  }
+  if (memcmp(newwordbytes, patternset->wordbytes, sizeof(newwordbytes)) != 0) {
+    memcpy(patternset->wordbytes, newwordbytes, sizeof(newwordbytes));
+    invalidate_automaton(patternset);
+  }
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_patternset_get_automaton_memory (multifinder_patternset patternset, unsigned int* ptype)
+{
+  const struct multifinder_automaton* automaton;
+  if (multifinder_patternset_compile(patternset) != 0)
+    return 0;
+  automaton = (const struct multifinder_automaton*)MULTIFINDER_ATOMIC_LOAD_POINTER(&patternset->automaton);
+  if (ptype)
+    *ptype = automaton->type;
+  return multifinder_automaton_memory(automaton);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_patternset_remove_pattern (multifinder_patternset patternset, const char* pattern, size_t patternlen, unsigned int flags)
+{
+  struct multifinder_pattern* entry;
+  uint32_t* slot;
+  char* data;
+  size_t i;
+  //a pattern set shared with others or loaded from a file can't be changed
+  if (MULTIFINDER_ATOMIC_LOAD(&patternset->refcount) > 1 || patternset->mappeddata)
+    return -1;
+  if (patternlen == 0 || patternset->patterncount == 0)
+    return 0;
+  //the hash table is released when the pattern set is compiled
+  if (!grow_hashtable(patternset) || (data = (char*)malloc(patternlen)) == NULL)
+    return -1;
+  for (i = 0; i < patternlen; i++)
+    data[i] = (char)(flags & MULTIFIND_PATTERN_CASE_INSENSITIVE ? multifinder_fold_table[(unsigned char)pattern[i]] : (unsigned char)pattern[i]);
+  slot = find_pattern(patternset, data, patternlen, flags);
+  free(data);
+  //the pattern keeps its index, so matches and statistics of other patterns keep referring to the same pattern
+  if (*slot != 0 && !((entry = patternset->patterns + *slot - 1)->flags & MULTIFINDER_PATTERN_REMOVED)) {
+    entry->flags |= MULTIFINDER_PATTERN_REMOVED;
+    patternset->removedcount++;
+    invalidate_automaton(patternset);
+  }
+  return 0;
+}
+
+multifinder_patternset multifinder_patternset_copy (multifinder_patternset patternset)
+{
+  struct multifinder_patternset_struct* result;
+  size_t i;
+  if ((result = multifinder_patternset_create()) == NULL)
+    return NULL;
+  result->automatontype = patternset->automatontype;
+  result->memorybudget = patternset->memorybudget;
+  memcpy(result->wordbytes, patternset->wordbytes, sizeof(result->wordbytes));
+  //the copy continues the generations of the original, so search states of the original are not mistaken for states of the copy
+  result->generation = patternset->generation + 1;
+  if (patternset->patterncount > 0) {
+    if ((result->patterndata = (char*)malloc(patternset->patterndatalen)) == NULL || (result->patterns = (struct multifinder_pattern*)malloc(patternset->patterncount * sizeof(struct multifinder_pattern))) == NULL || (result->callbackdata = (void**)malloc(patternset->patterncount * sizeof(void*))) == NULL) {
+      multifinder_patternset_free(result);
+      return NULL;
+    }
+    memcpy(result->patterndata, patternset->patterndata, patternset->patterndatalen);
+    memcpy(result->patterns, patternset->patterns, patternset->patterncount * sizeof(struct multifinder_pattern));
+    for (i = 0; i < patternset->patterncount; i++)
+      result->callbackdata[i] = (patternset->callbackdata ? patternset->callbackdata[i] : NULL);
+    result->patterndatalen = patternset->patterndatalen;
+    result->patterndatasize = patternset->patterndatalen;
+    result->patterncount = patternset->patterncount;
+    result->patternsize = patternset->patterncount;
+    result->removedcount = patternset->removedcount;
+    //removed patterns are no longer counted
+    for (i = 0; i < result->patterncount; i++) {
+      const struct multifinder_pattern* entry = result->patterns + i;
+      if (entry->flags & MULTIFINDER_PATTERN_REMOVED)
+        continue;
+      if (result->shortestpattern == 0 || entry->datalen < result->shortestpattern)
+        result->shortestpattern = entry->datalen;
+      if (entry->datalen > result->longestpattern)
+        result->longestpattern = entry->datalen;
+    }
+  }
+  return result;
+}
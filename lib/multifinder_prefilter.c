@@ -0,0 +1,741 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Prefilter that finds positions where a pattern may start.
+
+  Patterns are spread over 8 buckets. For each of the first 1 to 3 bytes of the
+  patterns a table holds the buckets that accept each byte value. On x86 CPUs
+  with SSSE3 or AVX2 the tables are split in a low and a high nibble table, so
+  16 or 32 positions can be checked at once with byte shuffles (as done by the
+  Teddy algorithm). Positions that pass are only candidates, the automaton
+  decides if there really is a match.
+  The implementation is chosen at runtime based on the CPU features available.
+
+  When all patterns are long (or there are too many patterns for the buckets to
+  tell them apart), skip tables are used instead to jump ahead by up to the
+  length of the shortest pattern at a time. A window as long as the shortest
+  pattern is checked at each step, only looking at the last 2 bytes of the
+  window (or a hash of the last 3 bytes when there are many patterns) to find
+  how far the window can move before these bytes line up with the same bytes
+  in the start of a pattern (Wu-Manber). A window where they already line up
+  is a candidate. For a single pattern the whole window is compared first, so
+  only real matches of the start of the pattern are reported (as done by the
+  Boyer-Moore-Horspool algorithm).
+
+  For a few patterns that each contain a byte that is rare in typical data
+  (according to a built-in table of byte frequencies), only the occurrences of
+  these (up to 3) bytes are looked for, with memchr() or with vector compares.
+  The position of the rare byte in each pattern gives where the pattern would
+  start. A single pattern is compared before reporting a candidate, for
+  several patterns the first byte is checked.
+
+  With more patterns than the buckets can hold and an automaton too large to
+  stay in the cache, the first (up to 4) bytes at each position are hashed
+  and looked up in a bitmap with 2 bits set for each pattern in the same 64-bit
+  word (a blocked Bloom filter). Positions that pass are candidates. Bytes are
+  hashed as they are, so all combinations of bytes equivalent to the pattern
+  bytes (like upper and lower case letters) are added.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "multifinder_internal.h"
+
+//minimum length of all patterns to use skip tables instead of byte masks
+#define PREFILTER_SKIP_MIN_LENGTH 48
+//minimum length of all patterns to use skip tables when there are too many patterns for byte masks to work well
+#define PREFILTER_SKIP_MANY_MIN_LENGTH 16
+//number of patterns above which byte masks find too many candidates
+#define PREFILTER_SKIP_MANY_PATTERNS 16
+//maximum combined frequency (in 64K of data) of the rare bytes of all patterns
+#define PREFILTER_RARE_MAX_FREQUENCY 128
+//number of leading pattern bytes hashed by the q-gram filter
+#define PREFILTER_QGRAM_LENGTH 4
+//number of bits in the q-gram filter for each pattern
+#define PREFILTER_QGRAM_BITS_PER_PATTERN 16
+//minimum and maximum size of the q-gram filter (as a power of 2 of the number of 64-bit words, 2MB at most)
+#define PREFILTER_QGRAM_MIN_WORD_BITS 6
+#define PREFILTER_QGRAM_MAX_WORD_BITS 18
+//minimum size of the transitions of the automaton to use the q-gram filter (smaller tables stay in the cache, so following the automaton is just as fast)
+#define PREFILTER_QGRAM_MIN_TABLE_SIZE (512 * 1024)
+//maximum fraction of positions that may pass the q-gram filter although no pattern starts there
+#define PREFILTER_QGRAM_MAX_RATE 0.2
+//maximum number of patterns for which skip tables use pairs of bytes (instead of 3 bytes)
+#define PREFILTER_SKIP_BLOCK2_MAX_PATTERNS 16
+
+#if !defined(MULTIFINDER_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PREFILTER_X86
+#include <immintrin.h>
+#endif
+
+static const unsigned char* find_scalar (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  const unsigned char* last = end - prefilter->length;
+  const unsigned char* mask0 = prefilter->masks[0];
+  const unsigned char* mask1 = prefilter->masks[1];
+  const unsigned char* mask2 = prefilter->masks[2];
+  switch (prefilter->length) {
+    case 1 :
+      while (p <= last && !mask0[p[0]])
+        p++;
+      break;
+    case 2 :
+      while (p <= last && !(mask0[p[0]] & mask1[p[1]]))
+        p++;
+      break;
+    default :
+      while (p <= last && !(mask0[p[0]] & mask1[p[1]] & mask2[p[2]]))
+        p++;
+      break;
+  }
+  return p;
+}
+
+#ifdef PREFILTER_X86
+
+__attribute__((target("ssse3")))
+static const unsigned char* find_ssse3 (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  const __m128i nibblemask = _mm_set1_epi8(0x0F);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i lo0 = _mm_loadu_si128((const __m128i*)prefilter->lomasks[0]);
+  const __m128i hi0 = _mm_loadu_si128((const __m128i*)prefilter->himasks[0]);
+  const __m128i lo1 = _mm_loadu_si128((const __m128i*)prefilter->lomasks[1]);
+  const __m128i hi1 = _mm_loadu_si128((const __m128i*)prefilter->himasks[1]);
+  const __m128i lo2 = _mm_loadu_si128((const __m128i*)prefilter->lomasks[2]);
+  const __m128i hi2 = _mm_loadu_si128((const __m128i*)prefilter->himasks[2]);
+  size_t length = prefilter->length;
+  __m128i v;
+  __m128i r;
+  unsigned int bits;
+  while ((size_t)(end - p) >= 16 + length - 1) {
+    v = _mm_loadu_si128((const __m128i*)p);
+    r = _mm_and_si128(_mm_shuffle_epi8(lo0, _mm_and_si128(v, nibblemask)), _mm_shuffle_epi8(hi0, _mm_and_si128(_mm_srli_epi16(v, 4), nibblemask)));
+    if (length > 1) {
+      v = _mm_loadu_si128((const __m128i*)(p + 1));
+      r = _mm_and_si128(r, _mm_and_si128(_mm_shuffle_epi8(lo1, _mm_and_si128(v, nibblemask)), _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(v, 4), nibblemask))));
+      if (length > 2) {
+        v = _mm_loadu_si128((const __m128i*)(p + 2));
+        r = _mm_and_si128(r, _mm_and_si128(_mm_shuffle_epi8(lo2, _mm_and_si128(v, nibblemask)), _mm_shuffle_epi8(hi2, _mm_and_si128(_mm_srli_epi16(v, 4), nibblemask))));
+      }
+    }
+    if ((bits = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(r, zero)) ^ 0xFFFFU) != 0)
+      return p + __builtin_ctz(bits);
+    p += 16;
+  }
+  return find_scalar(prefilter, p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char* find_avx2 (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  const __m256i nibblemask = _mm256_set1_epi8(0x0F);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)prefilter->lomasks[0]));
+  const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)prefilter->himasks[0]));
+  const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)prefilter->lomasks[1]));
+  const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)prefilter->himasks[1]));
+  const __m256i lo2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)prefilter->lomasks[2]));
+  const __m256i hi2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)prefilter->himasks[2]));
+  size_t length = prefilter->length;
+  __m256i v;
+  __m256i r;
+  unsigned int bits;
+  while ((size_t)(end - p) >= 32 + length - 1) {
+    v = _mm256_loadu_si256((const __m256i*)p);
+    r = _mm256_and_si256(_mm256_shuffle_epi8(lo0, _mm256_and_si256(v, nibblemask)), _mm256_shuffle_epi8(hi0, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibblemask)));
+    if (length > 1) {
+      v = _mm256_loadu_si256((const __m256i*)(p + 1));
+      r = _mm256_and_si256(r, _mm256_and_si256(_mm256_shuffle_epi8(lo1, _mm256_and_si256(v, nibblemask)), _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibblemask))));
+      if (length > 2) {
+        v = _mm256_loadu_si256((const __m256i*)(p + 2));
+        r = _mm256_and_si256(r, _mm256_and_si256(_mm256_shuffle_epi8(lo2, _mm256_and_si256(v, nibblemask)), _mm256_shuffle_epi8(hi2, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibblemask))));
+      }
+    }
+    if ((bits = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(r, zero)) ^ 0xFFFFFFFFU) != 0)
+      return p + __builtin_ctz(bits);
+    p += 32;
+  }
+  return find_scalar(prefilter, p, end);
+}
+
+#endif
+
+//index in the skip table of the 2 or 3 bytes at p
+#define SKIP_BLOCK2(p) ((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8))
+#define SKIP_BLOCK3(p) (((((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8) | ((unsigned int)(p)[2] << 16)) * 2654435761U) >> 16) & 0xFFFF)
+
+static const unsigned char* find_horspool (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  size_t length = prefilter->length;
+  const unsigned char* last = end - length;
+  const unsigned char* shifts = prefilter->shifts;
+  const unsigned char* classmap = prefilter->classmap;
+  const unsigned char* classes = prefilter->classes;
+  unsigned int shift;
+  size_t i;
+  while (p <= last) {
+    if ((shift = shifts[SKIP_BLOCK2(p + length - 2)]) == 0) {
+      //compare the whole window with the start of the pattern
+      for (i = 0; i < length - 2 && classmap[p[i]] == classes[i]; i++)
+        ;
+      if (i == length - 2)
+        return p;
+      shift = 1;
+    }
+    p += shift;
+  }
+  return p;
+}
+
+static const unsigned char* find_wumanber2 (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  size_t length = prefilter->length;
+  const unsigned char* last = end - length;
+  const unsigned char* shifts = prefilter->shifts;
+  unsigned int shift;
+  while (p <= last) {
+    if ((shift = shifts[SKIP_BLOCK2(p + length - 2)]) == 0)
+      return p;
+    p += shift;
+  }
+  return p;
+}
+
+static const unsigned char* find_wumanber3 (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  size_t length = prefilter->length;
+  const unsigned char* last = end - length;
+  const unsigned char* shifts = prefilter->shifts;
+  unsigned int shift;
+  while (p <= last) {
+    if ((shift = shifts[SKIP_BLOCK3(p + length - 3)]) == 0)
+      return p;
+    p += shift;
+  }
+  return p;
+}
+
+//set up skip tables for patterns that are all long enough, returns zero on memory allocation error
+static int create_skip_tables (struct multifinder_prefilter* prefilter, const struct multifinder_automaton* automaton, const struct multifinder_pattern* const* patterns, size_t patterncount)
+{
+  const unsigned char* classmap = automaton->classmap;
+  unsigned char classbytes[256][256];
+  unsigned int classsize[256];
+  unsigned int length;
+  unsigned int blocklength;
+  unsigned char block[3];
+  size_t i;
+  unsigned int j;
+  unsigned int b;
+  unsigned int c;
+  unsigned int d;
+  //list the bytes in each byte class (bytes in the same class as a pattern byte can match it)
+  memset(classsize, 0, sizeof(classsize));
+  for (b = 0; b < 256; b++)
+    classbytes[classmap[b]][classsize[classmap[b]]++] = (unsigned char)b;
+  //the window is as long as the shortest pattern (only the start of longer patterns is checked)
+  length = (automaton->shortestpattern < MULTIFINDER_PREFILTER_MAX_WINDOW ? (unsigned int)automaton->shortestpattern : MULTIFINDER_PREFILTER_MAX_WINDOW);
+  prefilter->length = length;
+  prefilter->classmap = classmap;
+  //with many patterns most pairs of bytes occur somewhere, so use 3 bytes
+  blocklength = (patterncount > PREFILTER_SKIP_BLOCK2_MAX_PATTERNS ? 3 : 2);
+  if ((prefilter->shifts = (unsigned char*)malloc(MULTIFINDER_PREFILTER_SKIP_TABLE)) == NULL)
+    return 0;
+  //skip so the bytes at the end of the window are not past any place they occur in the start of a pattern
+  memset(prefilter->shifts, length - blocklength + 1, MULTIFINDER_PREFILTER_SKIP_TABLE);
+  for (i = 0; i < patterncount; i++) {
+    const char* data = automaton->patterndata + patterns[i]->offset;
+    for (j = blocklength - 1; j < length; j++) {
+      unsigned char class0 = classmap[(unsigned char)data[j + 1 - blocklength]];
+      unsigned char class1 = classmap[(unsigned char)data[j + 2 - blocklength]];
+      unsigned char class2 = classmap[(unsigned char)data[j]];
+      unsigned char shift = (unsigned char)(length - 1 - j);
+      for (b = 0; b < classsize[class0]; b++) {
+        block[0] = classbytes[class0][b];
+        for (c = 0; c < classsize[class1]; c++) {
+          block[1] = classbytes[class1][c];
+          for (d = 0; d < (blocklength == 3 ? classsize[class2] : 1); d++) {
+            unsigned char* entry;
+            block[2] = classbytes[class2][d];
+            entry = prefilter->shifts + (blocklength == 3 ? SKIP_BLOCK3(block) : SKIP_BLOCK2(block));
+            if (*entry > shift)
+              *entry = shift;
+          }
+        }
+      }
+    }
+  }
+  if (patterncount == 1) {
+    const char* data = automaton->patterndata + patterns[0]->offset;
+    for (j = 0; j < length; j++)
+      prefilter->classes[j] = classmap[(unsigned char)data[j]];
+    prefilter->find = &find_horspool;
+  } else {
+    prefilter->find = (blocklength == 3 ? &find_wumanber3 : &find_wumanber2);
+  }
+  prefilter->restart = 1;
+  return 1;
+}
+
+//approximate number of times each byte value occurs in 64K of data (measured on a mix of text, source code and executables)
+static const unsigned short byte_frequency[256] = {
+  7065,  298,  131,   95,  116,  119,   55,   72,  246,   78, 1146,   31,   35,   36,  107,  363,
+   139,   42,   61,   26,   34,   28,   16,   13,   80,   13,   13,   14,   21,   17,   13,   95,
+  7032,   24,  140,  139,  336,   72,   22,  198,  382,  354,  217,   38,  454,  300,  523, 1209,
+   380,  362,  208,  103,   83,  139,   59,   52,   93,  151,  213,  100,   60,  140,   57,   18,
+   105,  524,  171,  342,  333,  563,  194,  156,  921,  508,   40,   71,  550,  195,  375,  356,
+   299,   23,  345,  581,  453,  157,   76,   75,  111,   76,   30,   58,   74,   65,   22, 1328,
+    50, 1499,  604, 1196, 1016, 3106,  676,  454,  738, 1962,   40,  257, 1405,  847, 1584, 1732,
+  1314,   50, 1699, 2041, 2277,  776,  244,  211,  274,  400,   47,   37,   54,   37,   19,   17,
+    76,   28,   12,  165,  156,  155,   19,   16,   33,  462,   11,  293,   28,  188,   15,   14,
+    47,   15,   10,   10,   19,   11,    9,    8,   20,    9,    8,    7,   14,    8,    7,   10,
+    28,    8,   13,   10,   11,    7,    8,    7,   21,    9,   10,    9,   14,    8,    7,    9,
+    26,    8,    8,    8,   17,    9,   30,   11,   35,   19,   46,   12,   27,   12,   40,   30,
+   158,   48,   32,   62,   39,   30,   48,   83,   29,   32,   13,   10,   13,   11,   13,   11,
+    39,   16,   36,   13,   11,   12,   13,   11,   38,   21,   14,   27,   11,   21,   20,   38,
+    40,   16,   21,   12,   20,   13,   18,   23,  246,  118,   19,   50,   31,   29,   35,   60,
+    39,   14,   18,   20,   14,   16,   47,   28,   45,   23,   29,   27,   26,   40,   86,  816
+};
+
+static const unsigned char* find_bytes1 (const unsigned char* bytes, const unsigned char* p, const unsigned char* end)
+{
+  const unsigned char* q = (const unsigned char*)memchr(p, bytes[0], end - p);
+  return (q ? q : end);
+}
+
+static const unsigned char* find_bytes3_scalar (const unsigned char* bytes, const unsigned char* p, const unsigned char* end)
+{
+  unsigned char b0 = bytes[0];
+  unsigned char b1 = bytes[1];
+  unsigned char b2 = bytes[2];
+  while (p < end && *p != b0 && *p != b1 && *p != b2)
+    p++;
+  return p;
+}
+
+#ifdef PREFILTER_X86
+
+__attribute__((target("sse2")))
+static const unsigned char* find_bytes3_sse2 (const unsigned char* bytes, const unsigned char* p, const unsigned char* end)
+{
+  const __m128i b0 = _mm_set1_epi8((char)bytes[0]);
+  const __m128i b1 = _mm_set1_epi8((char)bytes[1]);
+  const __m128i b2 = _mm_set1_epi8((char)bytes[2]);
+  __m128i v;
+  unsigned int bits;
+  while (end - p >= 16) {
+    v = _mm_loadu_si128((const __m128i*)p);
+    if ((bits = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, b0), _mm_cmpeq_epi8(v, b1)), _mm_cmpeq_epi8(v, b2)))) != 0)
+      return p + __builtin_ctz(bits);
+    p += 16;
+  }
+  return find_bytes3_scalar(bytes, p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char* find_bytes3_avx2 (const unsigned char* bytes, const unsigned char* p, const unsigned char* end)
+{
+  const __m256i b0 = _mm256_set1_epi8((char)bytes[0]);
+  const __m256i b1 = _mm256_set1_epi8((char)bytes[1]);
+  const __m256i b2 = _mm256_set1_epi8((char)bytes[2]);
+  __m256i v;
+  unsigned int bits;
+  while (end - p >= 32) {
+    v = _mm256_loadu_si256((const __m256i*)p);
+    if ((bits = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, b0), _mm256_cmpeq_epi8(v, b1)), _mm256_cmpeq_epi8(v, b2)))) != 0)
+      return p + __builtin_ctz(bits);
+    p += 32;
+  }
+  return find_bytes3_scalar(bytes, p, end);
+}
+
+#endif
+
+static const unsigned char* find_rarebytes (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  const unsigned char* last = end - prefilter->length;
+  const unsigned char* classmap = prefilter->classmap;
+  const unsigned char* from;
+  const unsigned char* q;
+  const unsigned char* candidate = NULL;
+  unsigned int i;
+  if (p > last)
+    return p;
+  //a pattern starting at p or later has its rare byte at p + rareminoffset or later
+  from = p + prefilter->rareminoffset;
+  //rare bytes further on may still belong to a pattern that starts before the first candidate found
+  while ((q = (*prefilter->findbytes)(prefilter->rarebytes, from, end)) != end && (!candidate || q < candidate + prefilter->raremaxoffset)) {
+    for (i = 0; i < prefilter->rarecount; i++) {
+      const unsigned char* start = q - prefilter->rareoffsets[i];
+      if (classmap[*q] == prefilter->rareclasses[i] && (size_t)(q - p) >= prefilter->rareoffsets[i] && classmap[*start] == prefilter->rarestartclasses[i] && (!candidate || start < candidate))
+        candidate = start;
+    }
+    from = q + 1;
+  }
+  return (candidate && candidate <= last ? candidate : last + 1);
+}
+
+static const unsigned char* find_rarebytes_single (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  size_t length = prefilter->length;
+  const unsigned char* last = end - length;
+  const unsigned char* classmap = prefilter->classmap;
+  const unsigned char* classes = prefilter->classes;
+  const unsigned char* q;
+  size_t i;
+  if (p > last)
+    return p;
+  //the rare byte is at a fixed position in the pattern, so only one start position needs to be compared for each rare byte found
+  while ((q = (*prefilter->findbytes)(prefilter->rarebytes, p + prefilter->rareminoffset, end)) != end) {
+    if ((p = q - prefilter->rareminoffset) > last)
+      break;
+    for (i = 0; i < length && classmap[p[i]] == classes[i]; i++)
+      ;
+    if (i == length)
+      return p;
+    p++;
+  }
+  return last + 1;
+}
+
+//set up searching for the rarest bytes of the patterns, returns zero if the patterns don't have bytes that are rare enough
+static int create_rare_bytes (struct multifinder_prefilter* prefilter, const struct multifinder_automaton* automaton, const struct multifinder_pattern* const* patterns, size_t patterncount)
+{
+  const unsigned char* classmap = automaton->classmap;
+  unsigned char classbytes[256][3];
+  unsigned int classsize[256];
+  unsigned char bytes[3];
+  unsigned int bytecount = 0;
+  unsigned int frequency = 0;
+  unsigned int minoffset = MULTIFINDER_PREFILTER_MAX_WINDOW;
+  unsigned int maxoffset = 0;
+  size_t i;
+  unsigned int j;
+  unsigned int k;
+  unsigned int b;
+  //list the bytes in each byte class (classes with more than 3 bytes can't be searched for)
+  memset(classsize, 0, sizeof(classsize));
+  for (b = 0; b < 256; b++) {
+    unsigned char byteclass = classmap[b];
+    if (classsize[byteclass] < 3)
+      classbytes[byteclass][classsize[byteclass]] = (unsigned char)b;
+    classsize[byteclass]++;
+  }
+  //pick the rarest byte class in each pattern that still fits with the bytes picked for the other patterns
+  for (i = 0; i < patterncount; i++) {
+    const char* data = automaton->patterndata + patterns[i]->offset;
+    uint32_t datalen = patterns[i]->datalen;
+    unsigned int bestoffset = 0;
+    unsigned int bestfrequency = 0;
+    unsigned int bestnew = 0;
+    int found = 0;
+    for (j = 0; j < datalen && j < MULTIFINDER_PREFILTER_MAX_WINDOW; j++) {
+      unsigned char byteclass = classmap[(unsigned char)data[j]];
+      unsigned int newbytes = 0;
+      unsigned int newfrequency = 0;
+      if (classsize[byteclass] > 3)
+        continue;
+      //only bytes not picked yet add to the number of candidates
+      for (b = 0; b < classsize[byteclass]; b++) {
+        for (k = 0; k < bytecount && bytes[k] != classbytes[byteclass][b]; k++)
+          ;
+        if (k == bytecount) {
+          newbytes++;
+          newfrequency += byte_frequency[classbytes[byteclass][b]];
+        }
+      }
+      if (bytecount + newbytes > 3)
+        continue;
+      if (!found || newfrequency < bestfrequency) {
+        found = 1;
+        bestoffset = j;
+        bestfrequency = newfrequency;
+        bestnew = newbytes;
+      }
+    }
+    if (!found)
+      return 0;
+    //add the bytes of the chosen class
+    if (bestnew > 0) {
+      unsigned char byteclass = classmap[(unsigned char)data[bestoffset]];
+      for (b = 0; b < classsize[byteclass]; b++) {
+        for (k = 0; k < bytecount && bytes[k] != classbytes[byteclass][b]; k++)
+          ;
+        if (k == bytecount)
+          bytes[bytecount++] = classbytes[byteclass][b];
+      }
+    }
+    frequency += bestfrequency;
+    prefilter->rareclasses[i] = classmap[(unsigned char)data[bestoffset]];
+    prefilter->rareoffsets[i] = bestoffset;
+    prefilter->rarestartclasses[i] = classmap[(unsigned char)data[0]];
+    if (bestoffset < minoffset)
+      minoffset = bestoffset;
+    if (bestoffset > maxoffset)
+      maxoffset = bestoffset;
+  }
+  //only worth it if the bytes are rare enough to be found less often than the byte masks would find candidates
+  if (frequency > PREFILTER_RARE_MAX_FREQUENCY)
+    return 0;
+  for (k = 0; k < 3; k++)
+    prefilter->rarebytes[k] = bytes[k < bytecount ? k : bytecount - 1];
+  prefilter->rarecount = (unsigned int)patterncount;
+  prefilter->rareminoffset = minoffset;
+  prefilter->raremaxoffset = maxoffset;
+  prefilter->classmap = classmap;
+  //pick the fastest implementation supported by the CPU
+  if (bytecount == 1) {
+    prefilter->findbytes = &find_bytes1;
+  } else {
+    prefilter->findbytes = &find_bytes3_scalar;
+#ifdef PREFILTER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      prefilter->findbytes = &find_bytes3_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+      prefilter->findbytes = &find_bytes3_sse2;
+#endif
+  }
+  if (patterncount == 1) {
+    //compare the start of the pattern where the rare byte is found
+    const char* data = automaton->patterndata + patterns[0]->offset;
+    prefilter->length = (automaton->shortestpattern < MULTIFINDER_PREFILTER_MAX_WINDOW ? (unsigned int)automaton->shortestpattern : MULTIFINDER_PREFILTER_MAX_WINDOW);
+    for (j = 0; j < prefilter->length; j++)
+      prefilter->classes[j] = classmap[(unsigned char)data[j]];
+    prefilter->find = &find_rarebytes_single;
+  } else {
+    prefilter->length = maxoffset + 1;
+    prefilter->find = &find_rarebytes;
+  }
+  return 1;
+}
+
+//hash of the (up to 4) leading bytes at a position
+#define QGRAM_HASH(value) ((uint64_t)(value) * 0x9E3779B97F4A7C15ULL)
+//2 bits in the same 64-bit word are set for each q-gram
+#define QGRAM_BIT1(hash) (((hash) >> 20) & 63)
+#define QGRAM_BIT2(hash) (((hash) >> 26) & 63)
+
+static const unsigned char* find_qgram (const struct multifinder_prefilter* prefilter, const unsigned char* p, const unsigned char* end)
+{
+  const unsigned char* last = end - prefilter->length;
+  const uint64_t* qgrams = prefilter->qgrams;
+  unsigned int qgramshift = prefilter->qgramshift;
+  uint32_t qgrammask = prefilter->qgrammask;
+  uint32_t value;
+  uint64_t hash;
+  uint64_t bits;
+  while (p <= last) {
+    //bytes are hashed as they are (all bytes in the same class as the pattern bytes were added), so positions don't depend on each other
+    if (end - p >= 4) {
+      memcpy(&value, p, 4);
+    } else {
+      value = 0;
+      memcpy(&value, p, end - p);
+    }
+    hash = QGRAM_HASH(value & qgrammask);
+    bits = qgrams[hash >> qgramshift];
+    if ((bits >> QGRAM_BIT1(hash)) & (bits >> QGRAM_BIT2(hash)) & 1)
+      return p;
+    p++;
+  }
+  return p;
+}
+
+//set up a filter with the hashes of the leading bytes of all patterns, returns zero if too many positions would pass or on memory allocation error
+static int create_qgram_filter (struct multifinder_prefilter* prefilter, const struct multifinder_automaton* automaton, const struct multifinder_pattern* const* patterns, size_t patterncount)
+{
+  const unsigned char* classmap = automaton->classmap;
+  unsigned char classbytes[256][256];
+  unsigned int classsize[256];
+  unsigned int length = (automaton->shortestpattern < PREFILTER_QGRAM_LENGTH ? (unsigned int)automaton->shortestpattern : PREFILTER_QGRAM_LENGTH);
+  unsigned int wordbits = PREFILTER_QGRAM_MIN_WORD_BITS;
+  unsigned char mask[4] = {0, 0, 0, 0};
+  size_t words;
+  size_t i;
+  unsigned int k;
+  unsigned int b;
+  double rate = 0;
+  //list the bytes in each byte class (the q-grams of all bytes that are equivalent to the pattern bytes are added)
+  memset(classsize, 0, sizeof(classsize));
+  for (b = 0; b < 256; b++)
+    classbytes[classmap[b]][classsize[classmap[b]]++] = (unsigned char)b;
+  //use enough bits to keep the filter sparse, but small enough to stay in the cache
+  while (wordbits < PREFILTER_QGRAM_MAX_WORD_BITS && ((size_t)64 << wordbits) < patterncount * PREFILTER_QGRAM_BITS_PER_PATTERN)
+    wordbits++;
+  words = (size_t)1 << wordbits;
+  if ((prefilter->qgrams = (uint64_t*)calloc(words, sizeof(uint64_t))) == NULL)
+    return 0;
+  prefilter->qgramshift = 64 - wordbits;
+  memset(mask, 0xFF, length);
+  memcpy(&prefilter->qgrammask, mask, 4);
+  for (i = 0; i < patterncount; i++) {
+    const char* data = automaton->patterndata + patterns[i]->offset;
+    unsigned int variant[4] = {0, 0, 0, 0};
+    unsigned char qgram[4] = {0, 0, 0, 0};
+    uint32_t value;
+    uint64_t hash;
+    //add each combination of equivalent bytes (like upper and lower case letters)
+    for (;;) {
+      for (k = 0; k < length; k++)
+        qgram[k] = classbytes[classmap[(unsigned char)data[k]]][variant[k]];
+      memcpy(&value, qgram, 4);
+      hash = QGRAM_HASH(value);
+      prefilter->qgrams[hash >> prefilter->qgramshift] |= ((uint64_t)1 << QGRAM_BIT1(hash)) | ((uint64_t)1 << QGRAM_BIT2(hash));
+      for (k = 0; k < length && ++variant[k] == classsize[classmap[(unsigned char)data[k]]]; k++)
+        variant[k] = 0;
+      if (k == length)
+        break;
+    }
+  }
+  //a random q-gram passes if both its bits are set in the word it hashes to
+  for (i = 0; i < words; i++) {
+    double filled = (double)__builtin_popcountll(prefilter->qgrams[i]) / 64;
+    rate += filled * filled;
+  }
+  prefilter->falsepositiverate = rate / words;
+  if (prefilter->falsepositiverate > PREFILTER_QGRAM_MAX_RATE) {
+    free(prefilter->qgrams);
+    prefilter->qgrams = NULL;
+    return 0;
+  }
+  prefilter->length = length;
+  prefilter->restart = 1;
+  prefilter->find = &find_qgram;
+  return 1;
+}
+
+static int compare_keys (const void* a, const void* b)
+{
+  uint32_t keya = *(const uint32_t*)a;
+  uint32_t keyb = *(const uint32_t*)b;
+  return (keya < keyb ? -1 : (keya > keyb ? 1 : 0));
+}
+
+//set up the prefilter for a list of patterns
+static struct multifinder_prefilter* create_prefilter (const struct multifinder_automaton* automaton, const struct multifinder_pattern* const* patterns, size_t patterncount)
+{
+  struct multifinder_prefilter* prefilter;
+  uint32_t keys[MULTIFINDER_PREFILTER_MAX_PATTERNS];
+  size_t shortest = automaton->shortestpattern;
+  size_t i;
+  unsigned int k;
+  unsigned int b;
+  int skip;
+  if (patterncount == 0)
+    return NULL;
+  skip = (shortest >= (patterncount > PREFILTER_SKIP_MANY_PATTERNS ? PREFILTER_SKIP_MANY_MIN_LENGTH : PREFILTER_SKIP_MIN_LENGTH));
+  if ((prefilter = (struct multifinder_prefilter*)malloc(sizeof(struct multifinder_prefilter))) == NULL)
+    return NULL;
+  memset(prefilter, 0, sizeof(struct multifinder_prefilter));
+  //a few patterns with rare bytes can be found by looking for these bytes only
+  if (patterncount <= MULTIFINDER_PREFILTER_RARE_MAX_PATTERNS && create_rare_bytes(prefilter, automaton, patterns, patterncount))
+    return prefilter;
+  //long patterns allow skipping ahead
+  if (skip) {
+    if (!create_skip_tables(prefilter, automaton, patterns, patterncount)) {
+      multifinder_prefilter_free(prefilter);
+      return NULL;
+    }
+    return prefilter;
+  }
+  //with too many patterns for the byte masks only positions where the leading bytes hash to bits set for a pattern are candidates
+  if (patterncount > MULTIFINDER_PREFILTER_MAX_PATTERNS) {
+    if (multifinder_automaton_transition_memory(automaton) < PREFILTER_QGRAM_MIN_TABLE_SIZE || !create_qgram_filter(prefilter, automaton, patterns, patterncount)) {
+      multifinder_prefilter_free(prefilter);
+      return NULL;
+    }
+    return prefilter;
+  }
+  //check as many leading bytes as the shortest pattern has (up to 3)
+  prefilter->length = (shortest < 3 ? (unsigned int)shortest : 3);
+  //sort patterns on their leading bytes so patterns that start the same share a bucket
+  for (i = 0; i < patterncount; i++) {
+    keys[i] = (uint32_t)i;
+    for (k = 0; k < prefilter->length; k++)
+      keys[i] |= (uint32_t)automaton->classmap[(unsigned char)automaton->patterndata[patterns[i]->offset + k]] << (24 - k * 8);
+  }
+  qsort(keys, patterncount, sizeof(uint32_t), compare_keys);
+  //accept all bytes in the same byte class as the pattern byte (covers case insensitive patterns)
+  for (i = 0; i < patterncount; i++) {
+    unsigned char bucket = (unsigned char)(1 << (i * 8 / patterncount));
+    const char* data = automaton->patterndata + patterns[keys[i] & 0xFF]->offset;
+    for (k = 0; k < prefilter->length; k++) {
+      unsigned char byteclass = automaton->classmap[(unsigned char)data[k]];
+      for (b = 0; b < 256; b++)
+        if (automaton->classmap[b] == byteclass)
+          prefilter->masks[k][b] |= bucket;
+    }
+  }
+  //unused positions accept anything
+  for (k = prefilter->length; k < 3; k++)
+    memset(prefilter->masks[k], 0xFF, 256);
+  for (k = 0; k < 3; k++) {
+    for (b = 0; b < 256; b++) {
+      prefilter->lomasks[k][b & 0x0F] |= prefilter->masks[k][b];
+      prefilter->himasks[k][b >> 4] |= prefilter->masks[k][b];
+    }
+  }
+  //pick the fastest implementation supported by the CPU
+  prefilter->find = &find_scalar;
+#ifdef PREFILTER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    prefilter->find = &find_avx2;
+  else if (__builtin_cpu_supports("ssse3"))
+    prefilter->find = &find_ssse3;
+#endif
+  return prefilter;
+}
+
+struct multifinder_prefilter* multifinder_prefilter_create (const struct multifinder_automaton* automaton)
+{
+  const struct multifinder_pattern** patterns;
+  struct multifinder_prefilter* prefilter;
+  size_t patterncount = 0;
+  size_t i;
+  //removed patterns are not in the automaton
+  if ((patterns = (const struct multifinder_pattern**)malloc((automaton->patterncount + 1) * sizeof(const struct multifinder_pattern*))) == NULL)
+    return NULL;
+  for (i = 0; i < automaton->patterncount; i++)
+    if (!(automaton->patterns[i].flags & MULTIFINDER_PATTERN_REMOVED))
+      patterns[patterncount++] = automaton->patterns + i;
+  prefilter = create_prefilter(automaton, patterns, patterncount);
+  free(patterns);
+  return prefilter;
+}
+
+void multifinder_prefilter_free (struct multifinder_prefilter* prefilter)
+{
+  if (prefilter) {
+    free(prefilter->shifts);
+    free(prefilter->qgrams);
+    free(prefilter);
+  }
+}
+
+size_t multifinder_prefilter_memory (const struct multifinder_prefilter* prefilter)
+{
+  return sizeof(struct multifinder_prefilter) + (prefilter->shifts ? MULTIFINDER_PREFILTER_SKIP_TABLE : 0) + (prefilter->qgrams ? ((size_t)1 << (64 - prefilter->qgramshift)) * sizeof(uint64_t) : 0);
+}
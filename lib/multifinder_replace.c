@@ -0,0 +1,329 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Replacing patterns in a stream.
+
+  In replace mode a search handle builds the output as a list of segments
+  instead of calling the found and flush callback functions. Segments refer to
+  the supplied input data and to the replacements directly, so the output can
+  be written without copying (e.g. with writev()). Only data from the ring
+  buffer (kept between calls) is copied, as the ring buffer is overwritten
+  while scanning. The segments are delivered before multifinder_process()
+  returns, while the input data is still valid.
+  multifinder_replace_stream() copies the segments into large blocks that are
+  written by a separate thread, so writing overlaps with scanning.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "multifinder_internal.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+//initial size of the buffer for data from the ring buffer
+#define REPLACE_CARRY_SIZE 4096
+//number of segments collected by multifinder_replace_stream() before writing them
+#define REPLACE_STREAM_SEGMENTS 1024
+//size of each block of output written by multifinder_replace_stream()
+#define REPLACE_WRITE_BLOCK ((size_t)1024 * 1024)
+//number of output blocks (one being filled, the others being written)
+#define REPLACE_WRITE_BLOCKS 3
+//alignment of output blocks
+#define REPLACE_WRITE_ALIGNMENT 4096
+
+static int set_replace (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, multifinder_segment* segments, size_t maxsegments, char* buffer, size_t buffersize, multifinder_output_callback_fn outputfunction)
+{
+  if ((!segments || maxsegments == 0) && (!buffer || buffersize == 0))
+    outputfunction = NULL;
+  if (outputfunction) {
+    //a match can only be replaced once
+    if (handle->mode == MULTIFIND_MODE_OVERLAPPING)
+      return -1;
+    multifinder_set_batch(handle, NULL, 0, NULL);
+  }
+  handle->outputfunction = outputfunction;
+  handle->replacements = (outputfunction ? replacements : NULL);
+  handle->replacementcount = (outputfunction && replacements ? replacementcount : 0);
+  handle->segments = (outputfunction ? segments : NULL);
+  handle->segmentsize = (outputfunction && segments ? maxsegments : 0);
+  handle->segmentcount = 0;
+  handle->outbuffer = (outputfunction && !segments ? buffer : NULL);
+  handle->outbuffersize = (outputfunction && !segments ? buffersize : 0);
+  handle->outbufferlen = 0;
+  handle->carrylen = 0;
+  return 0;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_set_replace (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, multifinder_segment* segments, size_t maxsegments, multifinder_output_callback_fn outputfunction)
+{
+  return set_replace(handle, replacements, replacementcount, segments, maxsegments, NULL, 0, outputfunction);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_set_replace_buffer (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, char* buffer, size_t buffersize, multifinder_output_callback_fn outputfunction)
+{
+  return set_replace(handle, replacements, replacementcount, NULL, 0, buffer, buffersize, outputfunction);
+}
+
+int multifinder_deliver_output (multifinder handle)
+{
+  multifinder_segment segment;
+  const multifinder_segment* segments;
+  size_t count;
+  MULTIFINDER_STAT(unsigned long long starttime);
+  if (handle->outbuffer) {
+    if (handle->outbufferlen == 0)
+      return 1;
+    segment.data = handle->outbuffer;
+    segment.datalen = handle->outbufferlen;
+    segments = &segment;
+    count = 1;
+    handle->outbufferlen = 0;
+  } else {
+    if (handle->segmentcount == 0)
+      return 1;
+    segments = handle->segments;
+    count = handle->segmentcount;
+    handle->segmentcount = 0;
+  }
+  MULTIFINDER_STAT(starttime = (handle->timing ? multifinder_get_time() : 0));
+  handle->abortstatus = (*handle->outputfunction)(segments, count, handle->callbackdata);
+  MULTIFINDER_STAT(handle->stats.flushcalls++);
+  MULTIFINDER_STAT(if (handle->timing) handle->stats.callbacktime += multifinder_get_time() - starttime);
+  //copied data is no longer referred to
+  handle->carrylen = 0;
+  return (handle->abortstatus == 0);
+}
+
+int multifinder_output (multifinder handle, const char* data, size_t datalen, int copy)
+{
+  multifinder_segment* segment;
+  if (datalen == 0)
+    return 1;
+  //copy into output buffer, delivering it each time it is full
+  if (handle->outbuffer) {
+    while (datalen > 0) {
+      size_t len = handle->outbuffersize - handle->outbufferlen;
+      if (len > datalen)
+        len = datalen;
+      memcpy(handle->outbuffer + handle->outbufferlen, data, len);
+      handle->outbufferlen += len;
+      data += len;
+      datalen -= len;
+      if (handle->outbufferlen == handle->outbuffersize && !multifinder_deliver_output(handle))
+        return 0;
+    }
+    return 1;
+  }
+  //data that won't stay valid is copied first
+  if (copy) {
+    if (handle->carrylen + datalen > handle->carrysize) {
+      if (!multifinder_deliver_output(handle))
+        return 0;
+      if (datalen > handle->carrysize) {
+        char* newcarry;
+        size_t newsize = (handle->carrysize ? handle->carrysize : REPLACE_CARRY_SIZE);
+        while (newsize < datalen)
+          newsize *= 2;
+        if ((newcarry = (char*)realloc(handle->carry, newsize)) == NULL) {
+          handle->abortstatus = -1;
+          return 0;
+        }
+        handle->carry = newcarry;
+        handle->carrysize = newsize;
+      }
+    }
+    memcpy(handle->carry + handle->carrylen, data, datalen);
+    data = handle->carry + handle->carrylen;
+    handle->carrylen += datalen;
+  }
+  //extend the last segment if the data follows it directly
+  if (handle->segmentcount > 0) {
+    segment = handle->segments + handle->segmentcount - 1;
+    if (segment->data + segment->datalen == data) {
+      segment->datalen += datalen;
+      return 1;
+    }
+  }
+  if (handle->segmentcount == handle->segmentsize) {
+    //copied data must stay valid for the segment that will refer to it
+    if (copy) {
+      size_t carrylen = handle->carrylen;
+      if (!multifinder_deliver_output(handle))
+        return 0;
+      handle->carrylen = carrylen;
+    } else if (!multifinder_deliver_output(handle)) {
+      return 0;
+    }
+  }
+  segment = handle->segments + handle->segmentcount++;
+  segment->data = data;
+  segment->datalen = datalen;
+  return 1;
+}
+
+struct replace_output {
+  FILE* dst;                                    //file to write to
+  char* blocks[REPLACE_WRITE_BLOCKS];           //blocks of output written in turn
+  size_t blocklen[REPLACE_WRITE_BLOCKS];        //number of bytes used in each block
+  int current;                                  //index of the block being filled
+  multifinder_thread writer;                    //thread writing full blocks (NULL if blocks are written when full)
+  multifinder_semaphore emptyblocks;            //counts blocks that can be filled
+  multifinder_semaphore fullblocks;             //counts blocks that can be written
+  volatile int failed;                          //set when writing failed
+  char* memory;                                 //memory for the blocks
+};
+
+//write data to a file, returns zero on error
+static int write_data (FILE* dst, const char* data, size_t datalen)
+{
+#ifndef _WIN32
+  int fd = fileno(dst);
+  ssize_t len;
+  //streams without a file descriptor (e.g. from fmemopen()) are written with stdio
+  if (fd >= 0) {
+    while (datalen > 0) {
+      if ((len = write(fd, data, datalen)) < 0) {
+        if (errno == EINTR)
+          continue;
+        return 0;
+      }
+      //writing may stop part way
+      data += len;
+      datalen -= (size_t)len;
+    }
+    return 1;
+  }
+#endif
+  return (fwrite(data, 1, datalen, dst) == datalen);
+}
+
+//write blocks in turn until an empty block is received
+static void write_blocks (void* arg)
+{
+  struct replace_output* output = (struct replace_output*)arg;
+  int i = 0;
+  for (;;) {
+    multifinder_semaphore_wait(output->fullblocks);
+    if (output->blocklen[i] == 0)
+      break;
+    if (!output->failed && !write_data(output->dst, output->blocks[i], output->blocklen[i]))
+      output->failed = 1;
+    multifinder_semaphore_post(output->emptyblocks);
+    i = (i + 1) % REPLACE_WRITE_BLOCKS;
+  }
+}
+
+//pass the current block to the writer and continue with the next one (or write it when there is no writer)
+static void submit_block (struct replace_output* output)
+{
+  if (output->writer) {
+    multifinder_semaphore_post(output->fullblocks);
+    output->current = (output->current + 1) % REPLACE_WRITE_BLOCKS;
+    multifinder_semaphore_wait(output->emptyblocks);
+  } else if (output->blocklen[output->current] > 0 && !output->failed && !write_data(output->dst, output->blocks[output->current], output->blocklen[output->current])) {
+    output->failed = 1;
+  }
+  output->blocklen[output->current] = 0;
+}
+
+//copy output segments to the blocks written to the file in callbackdata (segments refer to input data that is only valid until returning)
+static int write_segments (const multifinder_segment* segments, size_t count, void* callbackdata)
+{
+  struct replace_output* output = (struct replace_output*)callbackdata;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    const char* data = segments[i].data;
+    size_t datalen = segments[i].datalen;
+    while (datalen > 0) {
+      size_t len = REPLACE_WRITE_BLOCK - output->blocklen[output->current];
+      if (len > datalen)
+        len = datalen;
+      memcpy(output->blocks[output->current] + output->blocklen[output->current], data, len);
+      output->blocklen[output->current] += len;
+      data += len;
+      datalen -= len;
+      if (output->blocklen[output->current] == REPLACE_WRITE_BLOCK)
+        submit_block(output);
+    }
+  }
+  return (output->failed ? -2 : 0);
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_replace_stream (multifinder handle, const multifinder_segment* replacements, size_t replacementcount, const char* filename, FILE* dst, unsigned int threads, size_t* pcount)
+{
+  multifinder_segment segments[REPLACE_STREAM_SEGMENTS];
+  struct replace_output* output;
+  void* callbackdata = handle->callbackdata;
+  int status;
+  int i;
+  if ((output = (struct replace_output*)malloc(sizeof(struct replace_output))) == NULL)
+    return -1;
+  if ((output->memory = (char*)malloc(REPLACE_WRITE_BLOCKS * REPLACE_WRITE_BLOCK + REPLACE_WRITE_ALIGNMENT)) == NULL) {
+    free(output);
+    return -1;
+  }
+  if (set_replace(handle, replacements, replacementcount, segments, REPLACE_STREAM_SEGMENTS, NULL, 0, write_segments) != 0) {
+    free(output->memory);
+    free(output);
+    return -3;
+  }
+  output->dst = dst;
+  for (i = 0; i < REPLACE_WRITE_BLOCKS; i++) {
+    output->blocks[i] = output->memory + (REPLACE_WRITE_ALIGNMENT - (size_t)output->memory % REPLACE_WRITE_ALIGNMENT) + i * REPLACE_WRITE_BLOCK;
+    output->blocklen[i] = 0;
+  }
+  output->current = 0;
+  output->failed = 0;
+  output->writer = NULL;
+  //the block being filled is not empty
+  output->emptyblocks = multifinder_semaphore_create(REPLACE_WRITE_BLOCKS - 1);
+  output->fullblocks = multifinder_semaphore_create(0);
+  //output written before must come first
+  fflush(dst);
+  //write blocks while scanning continues
+  if (output->emptyblocks && output->fullblocks)
+    output->writer = multifinder_thread_create(write_blocks, output);
+  handle->callbackdata = output;
+  status = multifinder_process_file(handle, filename, threads, pcount);
+  //write the last block and stop the writer with an empty block
+  if (output->blocklen[output->current] > 0)
+    submit_block(output);
+  if (output->writer) {
+    multifinder_semaphore_post(output->fullblocks);
+    multifinder_thread_join(output->writer);
+  }
+  //data written with stdio may still be buffered
+  if (!output->failed && fflush(dst) != 0)
+    output->failed = 1;
+  if (status == 0 && (handle->abortstatus == -2 || output->failed))
+    status = -2;
+  handle->callbackdata = callbackdata;
+  set_replace(handle, NULL, 0, NULL, 0, NULL, 0, NULL);
+  multifinder_semaphore_free(output->emptyblocks);
+  multifinder_semaphore_free(output->fullblocks);
+  free(output->memory);
+  free(output);
+  return status;
+}
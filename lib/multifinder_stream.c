@@ -0,0 +1,312 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Searching many input streams with one search handle.
+
+  A stream context only stores what a search handle needs to continue where
+  it left off: the automaton state, the stream position, a pending match and
+  the data that can still be part of a match (only while the automaton is not
+  in its start state). Processing data for a stream loads its context into the
+  search handle, runs the normal search and stores the context again, so all
+  match modes, batch mode and replace mode work the same way.
+  Contexts and kept data are allocated from a pool of fixed size blocks in
+  power of 2 size classes, which only calls malloc() when a size class runs
+  out of blocks. Blocks are never returned to the system before the pool is
+  freed.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "multifinder_internal.h"
+
+//size of the smallest block of kept data
+#define STREAM_MIN_BLOCK 16
+//number of size classes for kept data
+#define STREAM_CLASSES 28
+//minimum amount of memory allocated at once for a size class
+#define STREAM_SLAB_SIZE 65536
+
+//stream context flags
+#define STREAM_STARTED       0x01
+#define STREAM_MATCHPENDING  0x02
+#define STREAM_USEPREFILTER  0x04
+#define STREAM_LOOKAHEAD     0x08
+#define STREAM_CONTEXT       0x10
+
+struct multifinder_stream_struct {
+  multifinder_stream_pool pool;                 //pool the context belongs to
+  void* callbackdata;                           //user callback data
+  size_t streampos;                             //position in input stream
+  unsigned long generation;                     //generation of the pattern set the automaton state belongs to
+  char* kept;                                   //data kept for matches continuing in the next data (NULL if none)
+  uint32_t state;                               //automaton state
+  uint32_t keptlen;                             //number of bytes in kept
+  uint32_t flushedback;                         //number of bytes before streampos that were not yet flushed
+  uint32_t matchback;                           //number of bytes before streampos the pending match starts
+  uint32_t matchpattern;                        //index of pattern of pending match
+  int abortstatus;                              //non-zero if a callback function requested to abort
+  unsigned char keptclass;                      //size class of kept
+  unsigned char flags;                          //STREAM_* flags
+  unsigned char context;                        //byte before kept (only if STREAM_CONTEXT is set, otherwise that is the start of the stream)
+};
+
+struct stream_pool_class {
+  void* freelist;                               //first unused block, each unused block starts with a pointer to the next one
+  size_t blocksize;                             //size of the blocks
+};
+
+struct stream_slab {
+  struct stream_slab* next;                     //slab allocated before this one
+  size_t size;                                  //size of the slab including this header
+};
+
+struct multifinder_stream_pool_struct {
+  multifinder handle;                           //search handle used to process the data of all streams
+  struct stream_pool_class contexts;            //blocks for stream contexts
+  struct stream_pool_class classes[STREAM_CLASSES];//blocks for kept data (STREAM_MIN_BLOCK bytes and each next class twice as large)
+  struct stream_slab* slabs;                    //all memory allocated by the pool
+  size_t memory;                                //total size of slabs
+};
+
+//get a block from a size class, allocating a new slab if there are no unused blocks
+static void* pool_alloc (multifinder_stream_pool pool, struct stream_pool_class* sizeclass)
+{
+  void* block;
+  if (!sizeclass->freelist) {
+    struct stream_slab* slab;
+    size_t count = (sizeclass->blocksize < STREAM_SLAB_SIZE ? STREAM_SLAB_SIZE / sizeclass->blocksize : 1);
+    size_t headersize = (sizeof(struct stream_slab) + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    char* p;
+    if ((slab = (struct stream_slab*)malloc(headersize + count * sizeclass->blocksize)) == NULL)
+      return NULL;
+    slab->next = pool->slabs;
+    slab->size = headersize + count * sizeclass->blocksize;
+    pool->slabs = slab;
+    pool->memory += slab->size;
+    //add blocks to the free list in reverse, so they are used in order
+    p = (char*)slab + headersize + count * sizeclass->blocksize;
+    while (count-- > 0) {
+      p -= sizeclass->blocksize;
+      *(void**)p = sizeclass->freelist;
+      sizeclass->freelist = p;
+    }
+  }
+  block = sizeclass->freelist;
+  sizeclass->freelist = *(void**)block;
+  return block;
+}
+
+static void pool_release (struct stream_pool_class* sizeclass, void* block)
+{
+  *(void**)block = sizeclass->freelist;
+  sizeclass->freelist = block;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_stream_pool multifinder_stream_pool_create (multifinder handle)
+{
+  struct multifinder_stream_pool_struct* pool;
+  int i;
+  if (!handle || (pool = (struct multifinder_stream_pool_struct*)malloc(sizeof(struct multifinder_stream_pool_struct))) == NULL)
+    return NULL;
+  pool->handle = handle;
+  pool->contexts.freelist = NULL;
+  pool->contexts.blocksize = (sizeof(struct multifinder_stream_struct) + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+  for (i = 0; i < STREAM_CLASSES; i++) {
+    pool->classes[i].freelist = NULL;
+    pool->classes[i].blocksize = (size_t)STREAM_MIN_BLOCK << i;
+  }
+  pool->slabs = NULL;
+  pool->memory = 0;
+  return pool;
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_stream_pool_free (multifinder_stream_pool pool)
+{
+  if (pool) {
+    while (pool->slabs) {
+      struct stream_slab* slab = pool->slabs;
+      pool->slabs = slab->next;
+      free(slab);
+    }
+    free(pool);
+  }
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_pool_get_memory (multifinder_stream_pool pool)
+{
+  return sizeof(struct multifinder_stream_pool_struct) + pool->memory;
+}
+
+static void init_stream (multifinder_stream stream)
+{
+  stream->streampos = 0;
+  stream->generation = 0;
+  stream->kept = NULL;
+  stream->state = 0;
+  stream->keptlen = 0;
+  stream->flushedback = 0;
+  stream->matchback = 0;
+  stream->matchpattern = 0;
+  stream->abortstatus = 0;
+  stream->keptclass = 0;
+  stream->flags = 0;
+  stream->context = 0;
+}
+
+static void release_kept (multifinder_stream stream)
+{
+  if (stream->kept) {
+    pool_release(stream->pool->classes + stream->keptclass, stream->kept);
+    stream->kept = NULL;
+  }
+  stream->keptlen = 0;
+}
+
+DLL_EXPORT_MULTIFINDER multifinder_stream multifinder_stream_open (multifinder_stream_pool pool, void* callbackdata)
+{
+  multifinder_stream stream;
+  if ((stream = (multifinder_stream)pool_alloc(pool, &pool->contexts)) == NULL)
+    return NULL;
+  stream->pool = pool;
+  stream->callbackdata = callbackdata;
+  init_stream(stream);
+  return stream;
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_stream_close (multifinder_stream stream)
+{
+  if (stream) {
+    release_kept(stream);
+    pool_release(&stream->pool->contexts, stream);
+  }
+}
+
+DLL_EXPORT_MULTIFINDER void multifinder_stream_reset (multifinder_stream stream)
+{
+  release_kept(stream);
+  init_stream(stream);
+}
+
+//continue the search of a stream with the search handle of the pool
+static void load_stream (multifinder handle, multifinder_stream stream)
+{
+  //count the data processed for the previous stream
+  handle->stats.bytesprocessed += handle->streampos - handle->statsstreampos;
+  handle->statsstreampos = stream->streampos;
+  handle->callbackdata = stream->callbackdata;
+  handle->streampos = stream->streampos;
+  handle->flushedpos = stream->streampos - stream->flushedback;
+  handle->abortstatus = stream->abortstatus;
+  handle->matchpending = ((stream->flags & STREAM_MATCHPENDING) != 0);
+  handle->matchpos = stream->streampos - stream->matchback;
+  handle->matchpattern = stream->matchpattern;
+  handle->prefiltercandidates = 0;
+  handle->prefilterskipped = 0;
+  handle->batchcount = 0;
+  handle->segmentcount = 0;
+  handle->outbufferlen = 0;
+  handle->carrylen = 0;
+  handle->context = ((stream->flags & STREAM_CONTEXT) ? stream->context : -1);
+  if (handle->automaton && (stream->flags & STREAM_STARTED) && stream->generation == handle->generation && handle->generation == handle->patternset->generation) {
+    handle->state = stream->state;
+    handle->useprefilter = ((stream->flags & STREAM_USEPREFILTER) != 0);
+    handle->lookahead = ((stream->flags & STREAM_LOOKAHEAD) != 0);
+  } else {
+    //new stream or state of other patterns: start from the root state (the kept data is scanned again)
+    handle->automaton = NULL;
+    handle->matchpending = 0;
+    handle->lookahead = 0;
+  }
+  handle->buflen = stream->keptlen;
+  if (stream->keptlen > 0)
+    multifinder_ring_store(handle, stream->streampos - stream->keptlen, stream->kept, stream->keptlen);
+}
+
+//store the state of the search handle in the stream context, returns zero if memory for kept data could not be allocated
+static int save_stream (multifinder handle, multifinder_stream stream)
+{
+  multifinder_stream_pool pool = stream->pool;
+  size_t keptlen = (handle->abortstatus == 0 ? handle->buflen : 0);
+  stream->streampos = handle->streampos;
+  stream->generation = handle->generation;
+  stream->state = handle->state;
+  stream->flushedback = (uint32_t)(handle->flushedpos < handle->streampos ? handle->streampos - handle->flushedpos : 0);
+  stream->matchback = (uint32_t)(handle->matchpending ? handle->streampos - handle->matchpos : 0);
+  stream->matchpattern = handle->matchpattern;
+  stream->abortstatus = handle->abortstatus;
+  stream->flags = (handle->automaton ? STREAM_STARTED : 0) | (handle->matchpending ? STREAM_MATCHPENDING : 0) | (handle->useprefilter ? STREAM_USEPREFILTER : 0) | (handle->lookahead ? STREAM_LOOKAHEAD : 0) | (handle->context >= 0 ? STREAM_CONTEXT : 0);
+  stream->context = (unsigned char)handle->context;
+  //most of the time nothing needs to be kept
+  if (keptlen == 0) {
+    release_kept(stream);
+    return 1;
+  }
+  if (!stream->kept || keptlen > pool->classes[stream->keptclass].blocksize) {
+    unsigned char keptclass = 0;
+    release_kept(stream);
+    while (pool->classes[keptclass].blocksize < keptlen)
+      keptclass++;
+    if ((stream->kept = (char*)pool_alloc(pool, pool->classes + keptclass)) == NULL) {
+      stream->abortstatus = -1;
+      return 0;
+    }
+    stream->keptclass = keptclass;
+  }
+  memcpy(stream->kept, RING_DATA(handle, handle->streampos - keptlen), keptlen);
+  stream->keptlen = (uint32_t)keptlen;
+  return 1;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_process (multifinder_stream stream, const char* data, size_t datalen)
+{
+  multifinder handle = stream->pool->handle;
+  size_t count;
+  void* callbackdata = handle->callbackdata;
+  load_stream(handle, stream);
+  count = multifinder_process(handle, data, datalen);
+  save_stream(handle, stream);
+  handle->callbackdata = callbackdata;
+  return count;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_finalize (multifinder_stream stream)
+{
+  multifinder handle = stream->pool->handle;
+  size_t count;
+  void* callbackdata = handle->callbackdata;
+  load_stream(handle, stream);
+  count = multifinder_finalize(handle);
+  save_stream(handle, stream);
+  handle->callbackdata = callbackdata;
+  return count;
+}
+
+DLL_EXPORT_MULTIFINDER int multifinder_stream_aborted (multifinder_stream stream)
+{
+  return stream->abortstatus;
+}
+
+DLL_EXPORT_MULTIFINDER size_t multifinder_stream_position (multifinder_stream stream)
+{
+  return stream->streampos - stream->flushedback;
+}
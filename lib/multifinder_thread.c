@@ -0,0 +1,252 @@
+/*
+Copyright (c) 2018 Brecht Sanders
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Minimal portable wrapper around native threads (Windows threads or POSIX threads),
+  mutexes, semaphores and other system functions.
+*/
+
+#include <stdlib.h>
+#include "multifinder_internal.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+struct multifinder_thread_struct {
+#ifdef _WIN32
+  HANDLE thread;                                //native thread handle
+#else
+  pthread_t thread;                             //native thread handle
+#endif
+  multifinder_thread_fn function;               //function to run in the thread
+  void* arg;                                    //argument to pass to function
+};
+
+#ifdef _WIN32
+static DWORD WINAPI thread_main (LPVOID arg)
+#else
+static void* thread_main (void* arg)
+#endif
+{
+  struct multifinder_thread_struct* thread = (struct multifinder_thread_struct*)arg;
+  (*thread->function)(thread->arg);
+  return 0;
+}
+
+multifinder_thread multifinder_thread_create (multifinder_thread_fn function, void* arg)
+{
+  struct multifinder_thread_struct* thread;
+  if ((thread = (struct multifinder_thread_struct*)malloc(sizeof(struct multifinder_thread_struct))) == NULL)
+    return NULL;
+  thread->function = function;
+  thread->arg = arg;
+#ifdef _WIN32
+  if ((thread->thread = CreateThread(NULL, 0, thread_main, thread, 0, NULL)) == NULL) {
+#else
+  if (pthread_create(&thread->thread, NULL, thread_main, thread) != 0) {
+#endif
+    free(thread);
+    return NULL;
+  }
+  return thread;
+}
+
+void multifinder_thread_join (multifinder_thread thread)
+{
+#ifdef _WIN32
+  WaitForSingleObject(thread->thread, INFINITE);
+  CloseHandle(thread->thread);
+#else
+  pthread_join(thread->thread, NULL);
+#endif
+  free(thread);
+}
+
+void multifinder_thread_yield ()
+{
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+
+struct multifinder_mutex_struct {
+#ifdef _WIN32
+  CRITICAL_SECTION section;                     //native critical section
+#else
+  pthread_mutex_t mutex;                        //native mutex
+#endif
+};
+
+multifinder_mutex multifinder_mutex_create ()
+{
+  struct multifinder_mutex_struct* mutex;
+  if ((mutex = (struct multifinder_mutex_struct*)malloc(sizeof(struct multifinder_mutex_struct))) == NULL)
+    return NULL;
+#ifdef _WIN32
+  InitializeCriticalSection(&mutex->section);
+#else
+  if (pthread_mutex_init(&mutex->mutex, NULL) != 0) {
+    free(mutex);
+    return NULL;
+  }
+#endif
+  return mutex;
+}
+
+void multifinder_mutex_lock (multifinder_mutex mutex)
+{
+#ifdef _WIN32
+  EnterCriticalSection(&mutex->section);
+#else
+  pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void multifinder_mutex_unlock (multifinder_mutex mutex)
+{
+#ifdef _WIN32
+  LeaveCriticalSection(&mutex->section);
+#else
+  pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+void multifinder_mutex_free (multifinder_mutex mutex)
+{
+  if (mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->section);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+    free(mutex);
+  }
+}
+
+struct multifinder_semaphore_struct {
+#ifdef _WIN32
+  HANDLE semaphore;                             //native semaphore handle
+#else
+  pthread_mutex_t mutex;                        //protects count
+  pthread_cond_t available;                     //signaled when count is increased
+  unsigned int count;                           //number of times wait can return without blocking
+#endif
+};
+
+multifinder_semaphore multifinder_semaphore_create (unsigned int count)
+{
+  struct multifinder_semaphore_struct* semaphore;
+  if ((semaphore = (struct multifinder_semaphore_struct*)malloc(sizeof(struct multifinder_semaphore_struct))) == NULL)
+    return NULL;
+#ifdef _WIN32
+  if ((semaphore->semaphore = CreateSemaphoreA(NULL, (LONG)count, 0x7FFFFFFF, NULL)) == NULL) {
+    free(semaphore);
+    return NULL;
+  }
+#else
+  if (pthread_mutex_init(&semaphore->mutex, NULL) != 0) {
+    free(semaphore);
+    return NULL;
+  }
+  if (pthread_cond_init(&semaphore->available, NULL) != 0) {
+    pthread_mutex_destroy(&semaphore->mutex);
+    free(semaphore);
+    return NULL;
+  }
+  semaphore->count = count;
+#endif
+  return semaphore;
+}
+
+void multifinder_semaphore_wait (multifinder_semaphore semaphore)
+{
+#ifdef _WIN32
+  WaitForSingleObject(semaphore->semaphore, INFINITE);
+#else
+  pthread_mutex_lock(&semaphore->mutex);
+  while (semaphore->count == 0)
+    pthread_cond_wait(&semaphore->available, &semaphore->mutex);
+  semaphore->count--;
+  pthread_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+void multifinder_semaphore_post (multifinder_semaphore semaphore)
+{
+#ifdef _WIN32
+  ReleaseSemaphore(semaphore->semaphore, 1, NULL);
+#else
+  pthread_mutex_lock(&semaphore->mutex);
+  semaphore->count++;
+  pthread_cond_signal(&semaphore->available);
+  pthread_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+void multifinder_semaphore_free (multifinder_semaphore semaphore)
+{
+  if (semaphore) {
+#ifdef _WIN32
+    CloseHandle(semaphore->semaphore);
+#else
+    pthread_cond_destroy(&semaphore->available);
+    pthread_mutex_destroy(&semaphore->mutex);
+#endif
+    free(semaphore);
+  }
+}
+
+unsigned int multifinder_cpu_count ()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0 ? (unsigned int)count : 1);
+#else
+  return 1;
+#endif
+}
+
+unsigned long long multifinder_get_time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL + (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (unsigned long long)frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+#endif
+}
@@ -0,0 +1,684 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include "multifinder.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#define MAXLISTSIZE 32
+
+#define CORPUS_RANDOM   0x01
+#define CORPUS_ENGLISH  0x02
+#define CORPUS_LOG      0x04
+#define CORPUS_FILE     0x08
+
+const char* corpusname[] = {"random", "english", "log", "file"};
+
+const char* words[] = {
+  "the", "of", "and", "to", "a", "in", "is", "it", "you", "that", "he", "was", "for", "on", "are", "with", "as", "his", "they", "be",
+  "at", "one", "have", "this", "from", "or", "had", "by", "hot", "word", "but", "what", "some", "we", "can", "out", "other", "were", "all", "there",
+  "when", "up", "use", "your", "how", "said", "an", "each", "she", "which", "do", "their", "time", "if", "will", "way", "about", "many", "then", "them",
+  "write", "would", "like", "so", "these", "her", "long", "make", "thing", "see", "him", "two", "has", "look", "more", "day", "could", "go", "come", "did",
+  "number", "sound", "no", "most", "people", "my", "over", "know", "water", "than", "call", "first", "who", "may", "down", "side", "been", "now", "find", "search"
+};
+#define WORDCOUNT (sizeof(words) / sizeof(words[0]))
+
+const char* syllables[] = {
+  "ab", "ac", "al", "an", "ar", "be", "ca", "ce", "co", "de", "di", "el", "en", "er", "es", "fa", "ga", "he", "in", "is",
+  "la", "le", "li", "lo", "ma", "me", "mi", "mo", "na", "ne", "no", "on", "or", "pa", "pe", "ra", "re", "ri", "ro", "sa",
+  "se", "si", "so", "ta", "te", "ti", "to", "tr", "un", "ur", "va", "ve", "wa", "st", "th", "ch", "sh", "ing", "ion", "ent"
+};
+#define SYLLABLECOUNT (sizeof(syllables) / sizeof(syllables[0]))
+
+const char* loglevels[] = {"DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR"};
+const char* logmessages[] = {"request completed", "cache miss", "connection opened", "connection closed", "retrying request", "slow query", "user logged in", "session expired"};
+
+//reproducible pseudo random numbers (xorshift64*)
+uint64_t randomstate;
+
+uint64_t random_next ()
+{
+  randomstate ^= randomstate >> 12;
+  randomstate ^= randomstate << 25;
+  randomstate ^= randomstate >> 27;
+  return randomstate * 2685821657736338717ULL;
+}
+
+size_t random_below (size_t limit)
+{
+  return (size_t)((random_next() >> 11) % limit);
+}
+
+void random_seed (uint64_t seed)
+{
+  randomstate = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+//pattern length between 3 and 32 with short patterns being more common
+size_t random_pattern_length ()
+{
+  size_t len = 3 + random_below(6);
+  while (len < 32 && random_below(4) == 0)
+    len += 1 + random_below(8);
+  return (len > 32 ? 32 : len);
+}
+
+struct buffer {
+  char* data;
+  size_t len;
+  size_t size;
+};
+
+int buffer_append (struct buffer* buf, const char* data, size_t len)
+{
+  if (buf->len + len > buf->size) {
+    char* newdata;
+    size_t newsize = (buf->size ? buf->size : 4096);
+    while (newsize < buf->len + len)
+      newsize *= 2;
+    if ((newdata = (char*)realloc(buf->data, newsize)) == NULL)
+      return 0;
+    buf->data = newdata;
+    buf->size = newsize;
+  }
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  return 1;
+}
+
+//generate a pronounceable word consisting of syllables
+size_t generate_word (char* dst, size_t len)
+{
+  size_t n = 0;
+  while (n < len) {
+    const char* s = syllables[random_below(SYLLABLECOUNT)];
+    while (*s && n < len)
+      dst[n++] = *s++;
+  }
+  return n;
+}
+
+struct patternlist {
+  char* data;                                   //pattern data, patterns stored back to back
+  size_t* offsets;                              //start of each pattern in data (plus the end of the last)
+  unsigned int* flags;                          //MULTIFIND_PATTERN_* flags of each pattern
+  size_t count;                                 //number of patterns
+};
+
+void free_patterns (struct patternlist* patterns)
+{
+  free(patterns->data);
+  free(patterns->offsets);
+  free(patterns->flags);
+  memset(patterns, 0, sizeof(struct patternlist));
+}
+
+//generate patterns that fit the corpus type, with mixed lengths and every fourth pattern case insensitive
+int generate_patterns (struct patternlist* patterns, int corpus, size_t count, uint64_t seed)
+{
+  struct buffer buf = {NULL, 0, 0};
+  multifinder_patternset unique;
+  char s[64];
+  const char* pattern = s;
+  size_t i = 0;
+  size_t len;
+  random_seed(seed ^ 0x5041545445524E53ULL);
+  if ((patterns->offsets = (size_t*)malloc((count + 1) * sizeof(size_t))) == NULL || (patterns->flags = (unsigned int*)malloc((count + 1) * sizeof(unsigned int))) == NULL)
+    return 0;
+  //generated patterns are added to a separate pattern set to skip duplicates so the requested number of unique patterns is reached
+  if ((unique = multifinder_patternset_create()) == NULL)
+    return 0;
+  while (i < count) {
+    len = random_pattern_length();
+    switch (corpus) {
+      case CORPUS_RANDOM :
+        {
+          size_t j;
+          for (j = 0; j < len; j++)
+            s[j] = (char)random_below(256);
+        }
+        break;
+      case CORPUS_LOG :
+        switch (random_below(4)) {
+          case 0 :
+            len = sprintf(s, "user=u%06lu", (unsigned long)random_below(1000000));
+            break;
+          case 1 :
+            len = sprintf(s, "id=%08lx", (unsigned long)random_below(0xFFFFFFFF));
+            break;
+          case 2 :
+            len = sprintf(s, "status=%lu", (unsigned long)(100 + random_below(500)));
+            break;
+          default :
+            len = generate_word(s, len);
+            break;
+        }
+        break;
+      default :
+        //English-like text: a real word with a suffix, a made-up word or a combination
+        if (random_below(8) == 0) {
+          len = sprintf(s, "%s %s", words[random_below(WORDCOUNT)], words[random_below(WORDCOUNT)]);
+        } else {
+          len = generate_word(s, len);
+        }
+        break;
+    }
+    patterns->offsets[i] = buf.len;
+    patterns->flags[i] = (i % 4 == 3 ? MULTIFIND_PATTERN_CASE_INSENSITIVE : MULTIFIND_PATTERN_CASE_SENSITIVE);
+    if (multifinder_patternset_add_patterns(unique, &pattern, &len, 1, patterns->flags[i], NULL) != 0) {
+      multifinder_patternset_free(unique);
+      free(buf.data);
+      return 0;
+    }
+    //the pattern set doesn't grow when a duplicate is added
+    if (multifinder_patternset_count_patterns(unique) == i)
+      continue;
+    if (!buffer_append(&buf, s, len)) {
+      multifinder_patternset_free(unique);
+      free(buf.data);
+      return 0;
+    }
+    i++;
+  }
+  multifinder_patternset_free(unique);
+  patterns->offsets[count] = buf.len;
+  patterns->data = buf.data;
+  patterns->count = count;
+  return 1;
+}
+
+//load patterns from a file (one per line)
+int load_patterns (struct patternlist* patterns, const char* filename)
+{
+  struct buffer buf = {NULL, 0, 0};
+  FILE* src;
+  char line[4096];
+  size_t size = 0;
+  size_t len;
+  if ((src = fopen(filename, "rb")) == NULL)
+    return 0;
+  patterns->count = 0;
+  while (fgets(line, sizeof(line), src)) {
+    len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      len--;
+    if (len == 0)
+      continue;
+    if (patterns->count + 1 >= size) {
+      size = (size ? size * 2 : 1024);
+      if ((patterns->offsets = (size_t*)realloc(patterns->offsets, size * sizeof(size_t))) == NULL || (patterns->flags = (unsigned int*)realloc(patterns->flags, size * sizeof(unsigned int))) == NULL) {
+        fclose(src);
+        return 0;
+      }
+    }
+    patterns->offsets[patterns->count] = buf.len;
+    patterns->flags[patterns->count] = MULTIFIND_PATTERN_CASE_SENSITIVE;
+    patterns->count++;
+    if (!buffer_append(&buf, line, len)) {
+      fclose(src);
+      return 0;
+    }
+  }
+  fclose(src);
+  if (patterns->count == 0)
+    return 0;
+  patterns->offsets[patterns->count] = buf.len;
+  patterns->data = buf.data;
+  return 1;
+}
+
+//generate a corpus, for logs density is the number of pattern occurrences inserted per MB
+int generate_corpus (struct buffer* buf, int corpus, size_t size, const struct patternlist* patterns, size_t density, uint64_t seed)
+{
+  char s[256];
+  size_t len;
+  random_seed(seed ^ 0x434F52505553ULL);
+  buf->len = 0;
+  while (buf->len < size) {
+    switch (corpus) {
+      case CORPUS_RANDOM :
+        {
+          size_t j;
+          for (j = 0; j < sizeof(s); j += 8) {
+            uint64_t r = random_next();
+            memcpy(s + j, &r, 8);
+          }
+          len = sizeof(s);
+        }
+        break;
+      case CORPUS_LOG :
+        len = sprintf(s, "2026-10-%02luT%02lu:%02lu:%02lu.%03luZ %-5s [worker-%lu] %s id=%08lx user=u%06lu status=%lu took=%lums ", (unsigned long)(1 + random_below(28)), (unsigned long)random_below(24), (unsigned long)random_below(60), (unsigned long)random_below(60), (unsigned long)random_below(1000), loglevels[random_below(sizeof(loglevels) / sizeof(loglevels[0]))], (unsigned long)random_below(64), logmessages[random_below(sizeof(logmessages) / sizeof(logmessages[0]))], (unsigned long)random_below(0xFFFFFFFF), (unsigned long)random_below(1000000), (unsigned long)(100 + random_below(500)), (unsigned long)random_below(5000));
+        //insert patterns so the requested number of matches per MB is reached on average (a line is about 128 bytes)
+        if (patterns && patterns->count > 0 && density > 0) {
+          size_t n = density * 128;
+          while (n > 0) {
+            if (n >= 1024 * 1024 || random_below(1024 * 1024) < n) {
+              size_t i = random_below(patterns->count);
+              size_t patternlen = patterns->offsets[i + 1] - patterns->offsets[i];
+              if (len + patternlen + 2 < sizeof(s)) {
+                memcpy(s + len, patterns->data + patterns->offsets[i], patternlen);
+                len += patternlen;
+                s[len++] = ' ';
+              }
+            }
+            n = (n >= 1024 * 1024 ? n - 1024 * 1024 : 0);
+          }
+        }
+        s[len++] = '\n';
+        break;
+      default :
+        {
+          //English-like text: common words with punctuation and an occasional made-up word
+          size_t i;
+          len = 0;
+          for (i = 0; i < 8; i++) {
+            if (random_below(16) == 0)
+              len += generate_word(s + len, 3 + random_below(8));
+            else
+              len += sprintf(s + len, "%s", words[random_below(WORDCOUNT) * random_below(WORDCOUNT) / WORDCOUNT]);
+            if (i == 0)
+              s[0] = (char)toupper((unsigned char)s[0]);
+            s[len++] = (random_below(12) == 0 ? ',' : ' ');
+            if (s[len - 1] == ',')
+              s[len++] = ' ';
+          }
+          s[len - 1] = '.';
+          s[len++] = (random_below(6) == 0 ? '\n' : ' ');
+        }
+        break;
+    }
+    if (len > size - buf->len)
+      len = size - buf->len;
+    if (!buffer_append(buf, s, len))
+      return 0;
+  }
+  return 1;
+}
+
+//load a corpus from a file
+int load_corpus (struct buffer* buf, const char* filename)
+{
+  FILE* src;
+  char data[65536];
+  size_t len;
+  if ((src = fopen(filename, "rb")) == NULL)
+    return 0;
+  buf->len = 0;
+  while ((len = fread(data, 1, sizeof(data), src)) > 0) {
+    if (!buffer_append(buf, data, len)) {
+      fclose(src);
+      return 0;
+    }
+  }
+  fclose(src);
+  return 1;
+}
+
+double get_time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+//reset the peak resident set size to the current resident set size (only supported on Linux)
+void reset_peak_rss ()
+{
+#ifdef __linux__
+  FILE* f;
+  if ((f = fopen("/proc/self/clear_refs", "w")) != NULL) {
+    fputs("5", f);
+    fclose(f);
+  }
+#endif
+}
+
+//peak resident set size in bytes (since the last call to reset_peak_rss() on Linux, otherwise since the process was started)
+size_t get_peak_rss ()
+{
+#ifdef __linux__
+  FILE* f;
+  char line[128];
+  unsigned long kb;
+  if ((f = fopen("/proc/self/status", "r")) != NULL) {
+    while (fgets(line, sizeof(line), f)) {
+      if (sscanf(line, "VmHWM: %lu kB", &kb) == 1) {
+        fclose(f);
+        return (size_t)kb * 1024;
+      }
+    }
+    fclose(f);
+  }
+#endif
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return (size_t)usage.ru_maxrss;
+#else
+  return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+//parse a size with an optional K, M or G suffix, returns 0 on error
+size_t parse_size (const char* s, char** end)
+{
+  size_t result = strtoul(s, end, 10);
+  switch (toupper((unsigned char)**end)) {
+    case 'K' :
+      result *= 1024;
+      (*end)++;
+      break;
+    case 'M' :
+      result *= 1024 * 1024;
+      (*end)++;
+      break;
+    case 'G' :
+      result *= (size_t)1024 * 1024 * 1024;
+      (*end)++;
+      break;
+  }
+  return result;
+}
+
+//parse a comma separated list of sizes, returns the number of entries or 0 on error
+size_t parse_size_list (const char* s, size_t* list)
+{
+  size_t count = 0;
+  char* end;
+  while (*s && count < MAXLISTSIZE) {
+    if ((list[count++] = parse_size(s, &end)) == 0 || (*end && *end != ','))
+      return 0;
+    s = (*end ? end + 1 : end);
+  }
+  return (*s ? 0 : count);
+}
+
+int countmatch (const char* data, size_t datalen, void* patterncallbackdata, void* callbackdata)
+{
+  (*(size_t*)callbackdata)++;
+  return 0;
+}
+
+void show_help()
+{
+  printf(
+    "Usage:  multifinder_bench [-?|-h] [-c corpus] [-f file] [-n size] [-p counts] [-F file] [-b sizes] [-d density] [-m mode] [-a type] [-M budget] [-r repeat] [-s seed] [-j]\n" \
+    "Parameters:\n" \
+    "  -? | -h     \tshow help\n" \
+    "  -c corpus   \tgenerated corpus: random, english, log or all (default)\n" \
+    "  -f file     \tuse file as corpus (overrides -c)\n" \
+    "  -n size     \tsize of generated corpus (default 16M)\n" \
+    "  -p counts   \tcomma separated numbers of generated patterns (default 1,10,100,1000,10000,100000, up to 1M or more)\n" \
+    "  -F file     \tuse patterns from file (one per line, overrides -p)\n" \
+    "  -b sizes    \tcomma separated sizes of blocks passed to multifinder_process() (default 1,64,4K,64K,1M,64M)\n" \
+    "  -d density  \tpatterns inserted in log corpus per MB (default 1000)\n" \
+    "  -m mode     \tmatch mode: first (default), longest or all (including overlapping matches)\n" \
+    "  -a type     \tautomaton type: auto (default), dense or compact\n" \
+    "  -M budget   \tmaximum memory used by the automaton (default is no limit)\n" \
+    "  -r repeat   \tnumber of times each test is run (the fastest run is reported, default 3)\n" \
+    "  -s seed     \tseed for generating corpora and patterns (default 1)\n" \
+    "  -j          \toutput results as JSON\n" \
+    "Sizes can be followed by K, M or G.\n" \
+    "Peak RSS is measured per pattern count from building the pattern set on Linux, on other systems it is the peak of the whole process.\n" \
+    "Version: " MULTIFINDER_VERSION_STRING "\n" \
+    "\n"
+  );
+}
+
+int main (int argc, char** argv)
+{
+  int corpora = CORPUS_RANDOM | CORPUS_ENGLISH | CORPUS_LOG;
+  const char* corpusfile = NULL;
+  const char* patternfile = NULL;
+  size_t corpussize = 16 * 1024 * 1024;
+  size_t patterncounts[MAXLISTSIZE] = {1, 10, 100, 1000, 10000, 100000};
+  size_t patterncountslen = 6;
+  size_t blocksizes[MAXLISTSIZE] = {1, 64, 4 * 1024, 64 * 1024, 1024 * 1024, 64 * 1024 * 1024};
+  size_t blocksizeslen = 6;
+  size_t density = 1000;
+  unsigned int mode = MULTIFIND_MODE_LEFTMOST_FIRST;
+  unsigned int automatontype = MULTIFIND_AUTOMATON_AUTO;
+  size_t memorybudget = 0;
+  unsigned long repeat = 3;
+  uint64_t seed = 1;
+  int json = 0;
+  int first = 1;
+  int corpus;
+  struct buffer data = {NULL, 0, 0};
+  //process command line parameters
+  {
+    int i = 0;
+    char* param;
+    char* end;
+    char option;
+    int paramerror = 0;
+    while (!paramerror && ++i < argc) {
+      if (argv[i][0] != '-' || !argv[i][1]) {
+        paramerror++;
+        break;
+      }
+      option = argv[i][1];
+      param = NULL;
+      //all options except -h and -j take a value
+      if (strchr("?hj", option) == NULL) {
+        if (argv[i][2])
+          param = argv[i] + 2;
+        else if (i + 1 < argc && argv[i + 1])
+          param = argv[++i];
+        if (!param) {
+          paramerror++;
+          break;
+        }
+      }
+      switch (option) {
+        case '?' :
+        case 'h' :
+          show_help();
+          return 0;
+        case 'c' :
+          if (strcmp(param, "random") == 0)
+            corpora = CORPUS_RANDOM;
+          else if (strcmp(param, "english") == 0)
+            corpora = CORPUS_ENGLISH;
+          else if (strcmp(param, "log") == 0)
+            corpora = CORPUS_LOG;
+          else if (strcmp(param, "all") == 0)
+            corpora = CORPUS_RANDOM | CORPUS_ENGLISH | CORPUS_LOG;
+          else
+            paramerror++;
+          break;
+        case 'f' :
+          corpusfile = param;
+          break;
+        case 'F' :
+          patternfile = param;
+          break;
+        case 'n' :
+          if ((corpussize = parse_size(param, &end)) == 0 || *end)
+            paramerror++;
+          break;
+        case 'p' :
+          if ((patterncountslen = parse_size_list(param, patterncounts)) == 0)
+            paramerror++;
+          break;
+        case 'b' :
+          if ((blocksizeslen = parse_size_list(param, blocksizes)) == 0)
+            paramerror++;
+          break;
+        case 'd' :
+          density = strtoul(param, NULL, 10);
+          break;
+        case 'm' :
+          if (strcmp(param, "first") == 0)
+            mode = MULTIFIND_MODE_LEFTMOST_FIRST;
+          else if (strcmp(param, "longest") == 0)
+            mode = MULTIFIND_MODE_LEFTMOST_LONGEST;
+          else if (strcmp(param, "all") == 0)
+            mode = MULTIFIND_MODE_OVERLAPPING;
+          else
+            paramerror++;
+          break;
+        case 'a' :
+          if (strcmp(param, "auto") == 0)
+            automatontype = MULTIFIND_AUTOMATON_AUTO;
+          else if (strcmp(param, "dense") == 0)
+            automatontype = MULTIFIND_AUTOMATON_DENSE;
+          else if (strcmp(param, "compact") == 0)
+            automatontype = MULTIFIND_AUTOMATON_COMPACT;
+          else
+            paramerror++;
+          break;
+        case 'M' :
+          if ((memorybudget = parse_size(param, &end)) == 0 || *end)
+            paramerror++;
+          break;
+        case 'r' :
+          if ((repeat = strtoul(param, NULL, 10)) == 0)
+            paramerror++;
+          break;
+        case 's' :
+          seed = strtoul(param, NULL, 10);
+          break;
+        case 'j' :
+          json = 1;
+          break;
+        default :
+          paramerror++;
+          break;
+      }
+    }
+    if (paramerror) {
+      fprintf(stderr, "Invalid command line parameters\n");
+      show_help();
+      return 1;
+    }
+  }
+  if (corpusfile)
+    corpora = CORPUS_FILE;
+  if (patternfile)
+    patterncountslen = 1;
+  //run benchmarks
+  if (json)
+    printf("{\n  \"version\": \"%s\",\n  \"seed\": %lu,\n  \"results\": [", MULTIFINDER_VERSION_STRING, (unsigned long)seed);
+  else
+    printf("%-8s %10s %9s %10s %9s %9s %8s %12s %12s %10s %10s\n", "corpus", "bytes", "patterns", "block", "build s", "MB/s", "ns/byte", "matches", "matches/s", "patmem KB", "peakRSS KB");
+  for (corpus = 0; corpus < 4; corpus++) {
+    size_t p;
+    if (!(corpora & (1 << corpus)))
+      continue;
+    if (corpusfile && !load_corpus(&data, corpusfile)) {
+      fprintf(stderr, "Error reading corpus file: %s\n", corpusfile);
+      return 4;
+    }
+    for (p = 0; p < patterncountslen; p++) {
+      struct patternlist patterns = {NULL, NULL, NULL, 0};
+      multifinder_patternset patternset;
+      multifinder finder;
+      double buildtime;
+      double starttime;
+      size_t matches;
+      size_t i;
+      size_t b;
+      if (patternfile) {
+        if (!load_patterns(&patterns, patternfile)) {
+          fprintf(stderr, "Error reading pattern file: %s\n", patternfile);
+          return 5;
+        }
+      } else if (!generate_patterns(&patterns, (1 << corpus), patterncounts[p], seed)) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 3;
+      }
+      //generated logs contain some of the patterns (the corpus is the same for all pattern sets of the same size)
+      if (!corpusfile && (p == 0 || (1 << corpus) == CORPUS_LOG) && !generate_corpus(&data, (1 << corpus), corpussize, &patterns, density, seed)) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 3;
+      }
+      //add and compile patterns (the peak memory usage reported is measured from here)
+      reset_peak_rss();
+      starttime = get_time();
+      if ((patternset = multifinder_patternset_create()) == NULL || multifinder_patternset_set_automaton(patternset, automatontype, memorybudget) != 0) {
+        fprintf(stderr, "Error in multifinder_patternset_create()\n");
+        return 2;
+      }
+      for (i = 0; i < patterns.count; i++) {
+        const char* pattern = patterns.data + patterns.offsets[i];
+        size_t patternlen = patterns.offsets[i + 1] - patterns.offsets[i];
+        if (multifinder_patternset_add_patterns(patternset, &pattern, &patternlen, 1, patterns.flags[i], NULL) != 0)
+          break;
+      }
+      if (i < patterns.count || multifinder_patternset_compile(patternset) != 0) {
+        fprintf(stderr, "Error adding %lu patterns\n", (unsigned long)patterns.count);
+        return 2;
+      }
+      buildtime = get_time() - starttime;
+      finder = multifinder_create_with_patternset_and_mode(patternset, mode, countmatch, NULL, &matches);
+      if (!finder) {
+        fprintf(stderr, "Error in multifinder_create_with_patternset_and_mode()\n");
+        return 2;
+      }
+      //scan the corpus in blocks of each size
+      for (b = 0; b < blocksizeslen; b++) {
+        double best = 0;
+        unsigned long r;
+        double mbps;
+        multifinder_stats stats;
+        for (r = 0; r < repeat; r++) {
+          size_t pos;
+          double elapsed;
+          multifinder_reset(finder);
+          multifinder_reset_stats(finder);
+          matches = 0;
+          starttime = get_time();
+          for (pos = 0; pos < data.len; pos += blocksizes[b])
+            multifinder_process(finder, data.data + pos, (data.len - pos < blocksizes[b] ? data.len - pos : blocksizes[b]));
+          multifinder_finalize(finder);
+          multifinder_get_stats(finder, &stats);
+          elapsed = get_time() - starttime;
+          if (r == 0 || elapsed < best)
+            best = elapsed;
+        }
+        if (best <= 0)
+          best = 1e-9;
+        mbps = (double)data.len / best / (1024 * 1024);
+        if (json) {
+          printf("%s\n    {\"corpus\": \"%s\", \"bytes\": %lu, \"patterns\": %lu, \"block_size\": %lu, \"mode\": %u, \"build_seconds\": %.6f, \"seconds\": %.6f, \"mb_per_second\": %.3f, \"ns_per_byte\": %.4f, \"matches\": %lu, \"matches_per_second\": %.1f, \"bytes_scanned\": %llu, \"bytes_skipped\": %llu, \"candidates\": %llu, \"comparisons\": %llu, \"pattern_memory_bytes\": %lu, \"automaton_type\": \"%s\", \"automaton_memory_bytes\": %lu, \"prefilter_memory_bytes\": %lu, \"prefilter_false_positive_rate\": %.6f, \"buffer_memory_bytes\": %lu, \"peak_rss_bytes\": %lu}", (first ? "" : ","), corpusname[corpus], (unsigned long)data.len, (unsigned long)multifinder_patternset_count_patterns(patternset), (unsigned long)blocksizes[b], mode, buildtime, best, mbps, best * 1e9 / (double)(data.len ? data.len : 1), (unsigned long)matches, (double)matches / best, stats.bytesscanned, stats.bytesskipped, stats.candidates, stats.comparisons, (unsigned long)stats.patternmemory, (stats.automatontype == MULTIFIND_AUTOMATON_COMPACT ? "compact" : "dense"), (unsigned long)stats.automatonmemory, (unsigned long)stats.prefiltermemory, stats.prefilterfalsepositiverate, (unsigned long)stats.buffermemory, (unsigned long)get_peak_rss());
+          first = 0;
+        } else {
+          printf("%-8s %10lu %9lu %10lu %9.3f %9.1f %8.3f %12lu %12.0f %10lu %10lu\n", corpusname[corpus], (unsigned long)data.len, (unsigned long)multifinder_patternset_count_patterns(patternset), (unsigned long)blocksizes[b], buildtime, mbps, best * 1e9 / (double)(data.len ? data.len : 1), (unsigned long)matches, (double)matches / best, (unsigned long)multifinder_patternset_get_pattern_memory(patternset) / 1024, (unsigned long)get_peak_rss() / 1024);
+        }
+        fflush(stdout);
+      }
+      multifinder_free(finder);
+      multifinder_patternset_free(patternset);
+      free_patterns(&patterns);
+    }
+  }
+  if (json)
+    printf("\n  ]\n}\n");
+  free(data.data);
+  return 0;
+}
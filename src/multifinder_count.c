@@ -4,24 +4,118 @@
 #include <string.h>
 #include "multifinder.h"
 
-#define READBUFFERSIZE 128
+#define MATCHBATCHSIZE 1024
 
-int whenfound (const char* data, size_t datalen, void* patterncallbackdata, void* callbackdata)
+int whenfound (const multifinder_match* matches, size_t count, void* callbackdata)
 {
-  (*(size_t*)patterncallbackdata)++;
+  size_t i;
+  for (i = 0; i < count; i++)
+    (*(size_t**)callbackdata)[matches[i].pattern]++;
+  return 0;
+}
+
+struct path_list {
+  char** paths;
+  size_t count;
+  size_t size;
+};
+
+int add_path (struct path_list* list, const char* path, size_t pathlen)
+{
+  if (list->count == list->size) {
+    char** newpaths;
+    size_t newsize = (list->size ? list->size * 2 : 64);
+    if ((newpaths = (char**)realloc(list->paths, newsize * sizeof(char*))) == NULL)
+      return 0;
+    list->paths = newpaths;
+    list->size = newsize;
+  }
+  if ((list->paths[list->count] = (char*)malloc(pathlen + 1)) == NULL)
+    return 0;
+  memcpy(list->paths[list->count], path, pathlen);
+  list->paths[list->count++][pathlen] = 0;
+  return 1;
+}
+
+//read paths from a file (one per line), returns zero on error
+int add_paths_from_file (struct path_list* list, const char* filename)
+{
+  FILE* src;
+  char* line = NULL;
+  size_t linesize = 0;
+  size_t linelen = 0;
+  int c;
+  int result = 1;
+  if (strcmp(filename, "-") == 0)
+    src = stdin;
+  else if ((src = fopen(filename, "rb")) == NULL)
+    return 0;
+  do {
+    c = getc(src);
+    if (c == EOF || c == '\n' || c == '\r') {
+      if (linelen > 0 && !add_path(list, line, linelen))
+        result = 0;
+      linelen = 0;
+    } else {
+      if (linelen == linesize) {
+        char* newline;
+        linesize = (linesize ? linesize * 2 : 256);
+        if ((newline = (char*)realloc(line, linesize)) == NULL) {
+          result = 0;
+          break;
+        }
+        line = newline;
+      }
+      line[linelen++] = (char)c;
+    }
+  } while (c != EOF && result);
+  if (ferror(src))
+    result = 0;
+  if (src != stdin)
+    fclose(src);
+  free(line);
+  return result;
+}
+
+int showfile (const char* filename, int status, size_t count, void* callbackdata)
+{
+  if (status != 0) {
+    fprintf(stderr, "Error reading file: %s\n", filename);
+    (*(size_t*)callbackdata)++;
+  } else if (count > 0) {
+    printf("%s: %lu matches found\n", filename, (unsigned long)count);
+  }
+  return 0;
+}
+
+int showerror (const char* filename, int status, size_t count, void* callbackdata)
+{
+  if (status != 0) {
+    fprintf(stderr, "Error reading file: %s\n", filename);
+    (*(size_t*)callbackdata)++;
+  }
   return 0;
 }
 
 void show_help()
 {
   printf(
-    "Usage:  multifinder_count [[-?|-h] -c] [-i] [-f file] [-t text] [-p <pattern>] <pattern> ...\n" \
+    "Usage:  multifinder_count [[-?|-h] -c] [-i] [-w] [-f file] [-t text] [-r path] [-L file] [-l] [-j threads] [-m mode] [-F file] [-d file] [-s file] [-p <pattern>] <pattern> ...\n" \
     "Parameters:\n" \
     "  -? | -h     \tshow help\n" \
     "  -c          \tcase sensitive matching for next pattern(s) (default)\n" \
     "  -i          \tcase insensitive matching for next pattern(s)\n" \
+    "  -w          \tmatch next pattern(s) only as whole words\n" \
     "  -f file     \tinput file (default is to use standard input)\n" \
     "  -t text     \tuse text as search data (overrides -f)\n" \
+    "  -r path     \tsearch file or all files in directory recursively (can be used more than once, overrides -f)\n" \
+    "  -L file     \tsearch files and directories listed in file (one per line, \"-\" for standard input)\n" \
+    "  -l          \tshow number of matches for each file searched with -r or -L\n" \
+    "  -j threads  \tnumber of threads used to scan large input or many files (0 = all processors, default is 1)\n" \
+    "  -m mode     \tmatch mode: first (default), longest or all (including overlapping matches)\n" \
+    "  -F file     \tfile with patterns to search for (one per line or separated by NULL bytes)\n" \
+    "  -d file     \tload compiled patterns from file (instead of specifying patterns)\n" \
+    "  -s file     \tsave compiled patterns to file\n" \
     "  -p pattern  \tpattern to search for (can be used if pattern starts with \"-\")\n" \
     "  pattern     \tpattern to search for\n" \
     "Version: " MULTIFINDER_VERSION_STRING "\n" \
@@ -31,22 +125,27 @@ void show_help()
 
 int main (int argc, char** argv)
 {
+  multifinder_patternset patternset;
   multifinder finder;
+  multifinder_match matches[MATCHBATCHSIZE];
   int flags = MULTIFIND_PATTERN_CASE_SENSITIVE;
+  unsigned int mode = MULTIFIND_MODE_LEFTMOST_FIRST;
   const char* srcfile = NULL;
   const char* srctext = NULL;
+  const char* savefile = NULL;
+  unsigned int threads = 1;
   size_t count = 0;
   size_t* patterncounts = NULL;
-  size_t patterns = 0;
-  //initialize
-  if ((finder = multifinder_create(whenfound, NULL, NULL)) == NULL) {
-    fprintf(stderr, "Error in multifinder_create()\n");
+  size_t patterns;
+  struct path_list paths = {NULL, 0, 0};
+  int showfiles = 0;
+  int compiledpatterns = 0;
+  size_t fileerrors = 0;
+  //initialize (the search handle is created once the match mode is known)
+  if ((patternset = multifinder_patternset_create()) == NULL) {
+    fprintf(stderr, "Error in multifinder_patternset_create()\n");
     return 2;
   }
-  if ((patterncounts = (size_t*)malloc((argc - 1) * sizeof(size_t))) == NULL) {
-    fprintf(stderr, "Memory allocation error\n");
-    return 3;
-  }
   //process command line parameters
   {
     int i = 0;
@@ -67,23 +166,71 @@ int main (int argc, char** argv)
             if (argv[i][2])
               paramerror++;
             else
-              flags = MULTIFIND_PATTERN_CASE_SENSITIVE;
+              flags = (flags & ~MULTIFIND_PATTERN_CASE_INSENSITIVE) | MULTIFIND_PATTERN_CASE_SENSITIVE;
             break;
           case 'i' :
             if (argv[i][2])
               paramerror++;
             else
-              flags = MULTIFIND_PATTERN_CASE_INSENSITIVE;
+              flags = (flags & ~MULTIFIND_PATTERN_CASE_SENSITIVE) | MULTIFIND_PATTERN_CASE_INSENSITIVE;
+            break;
+          case 'w' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              flags |= MULTIFIND_PATTERN_WHOLE_WORD;
             break;
           case 'f' :
+            {
+              //-F is pattern file, -f is input file
+              int patternfile = (argv[i][1] == 'F');
+              if (argv[i][2])
+                param = argv[i] + 2;
+              else if (i + 1 < argc && argv[i + 1])
+                param = argv[++i];
+              if (!param)
+                paramerror++;
+              else if (patternfile) {
+                if (multifinder_patternset_add_patterns_from_file(patternset, param, flags) != 0) {
+                  fprintf(stderr, "Error reading pattern file: %s\n", param);
+                  multifinder_patternset_free(patternset);
+                  return 5;
+                }
+              } else
+                srcfile = param;
+              break;
+            }
+          case 'l' :
+            //-L is file with paths, -l shows results per file
+            if (argv[i][1] == 'L') {
+              if (argv[i][2])
+                param = argv[i] + 2;
+              else if (i + 1 < argc && argv[i + 1])
+                param = argv[++i];
+              if (!param)
+                paramerror++;
+              else if (!add_paths_from_file(&paths, param)) {
+                fprintf(stderr, "Error reading file list: %s\n", param);
+                multifinder_patternset_free(patternset);
+                return 5;
+              }
+            } else if (argv[i][2])
+              paramerror++;
+            else
+              showfiles = 1;
+            break;
+          case 'r' :
             if (argv[i][2])
               param = argv[i] + 2;
             else if (i + 1 < argc && argv[i + 1])
               param = argv[++i];
             if (!param)
               paramerror++;
-            else
-              srcfile = param;
+            else if (!add_path(&paths, param, strlen(param))) {
+              fprintf(stderr, "Memory allocation error\n");
+              multifinder_patternset_free(patternset);
+              return 3;
+            }
             break;
           case 't' :
             if (argv[i][2])
@@ -95,58 +242,134 @@ int main (int argc, char** argv)
             else
               srctext = param;
             break;
-          case 'p' :
+          case 'j' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              threads = strtoul(param, NULL, 10);
+            break;
+          case 'm' :
             if (argv[i][2])
               param = argv[i] + 2;
             else if (i + 1 < argc && argv[i + 1])
               param = argv[++i];
             if (!param)
               paramerror++;
+            else if (strcmp(param, "first") == 0)
+              mode = MULTIFIND_MODE_LEFTMOST_FIRST;
+            else if (strcmp(param, "longest") == 0)
+              mode = MULTIFIND_MODE_LEFTMOST_LONGEST;
+            else if (strcmp(param, "all") == 0)
+              mode = MULTIFIND_MODE_OVERLAPPING;
+            else
+              paramerror++;
+            break;
+          case 'd' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || multifinder_patternset_count_patterns(patternset) > 0)
+              paramerror++;
             else {
-              patterncounts[patterns] = 0;
-              multifinder_add_pattern(finder, param, flags, &patterncounts[patterns++]);
+              multifinder_patternset_free(patternset);
+              if ((patternset = multifinder_patternset_load_compiled(param, NULL)) == NULL) {
+                fprintf(stderr, "Error loading compiled patterns: %s\n", param);
+                return 5;
+              }
+              //no other patterns can be given
+              compiledpatterns = 1;
+            }
+            break;
+          case 's' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              savefile = param;
+            break;
+          case 'p' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || compiledpatterns)
+              paramerror++;
+            else if (multifinder_patternset_add_pattern(patternset, param, flags, NULL) != 0) {
+              fprintf(stderr, "Error adding pattern: %s\n", param);
+              multifinder_patternset_free(patternset);
+              return 3;
             }
             break;
           default :
             paramerror++;
             break;
         }
-      } else {
-        patterncounts[patterns] = 0;
-        multifinder_add_pattern(finder, argv[i], flags, &patterncounts[patterns++]);
+      } else if (compiledpatterns) {
+        //patterns can't be added to compiled patterns loaded with -d
+        paramerror++;
+      } else if (multifinder_patternset_add_pattern(patternset, argv[i], flags, NULL) != 0) {
+        fprintf(stderr, "Error adding pattern: %s\n", argv[i]);
+        multifinder_patternset_free(patternset);
+        return 3;
       }
     }
     if (paramerror || argc <= 1) {
       if (paramerror)
         fprintf(stderr, "Invalid command line parameters\n");
       show_help();
+      multifinder_patternset_free(patternset);
       return 1;
     }
   }
+  //save compiled patterns
+  if (savefile && multifinder_patternset_save_compiled(patternset, savefile) != 0) {
+    fprintf(stderr, "Error saving compiled patterns: %s\n", savefile);
+    multifinder_patternset_free(patternset);
+    return 6;
+  }
+  //create search handle (which takes its own reference to the pattern set)
+  finder = multifinder_create_with_patternset_and_mode(patternset, mode, NULL, NULL, &patterncounts);
+  multifinder_patternset_free(patternset);
+  if (!finder) {
+    fprintf(stderr, "Error in multifinder_create_with_patternset_and_mode()\n");
+    return 2;
+  }
+  multifinder_set_batch(finder, matches, MATCHBATCHSIZE, whenfound);
+  //matches are counted by pattern index
+  patterns = multifinder_count_patterns(finder);
+  if ((patterncounts = (size_t*)calloc(patterns + 1, sizeof(size_t))) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    multifinder_free(finder);
+    return 3;
+  }
   //process search data
   if (srctext) {
     //process supplied text
-    count += multifinder_process(finder, srctext, strlen(srctext));
-    count += multifinder_finalize(finder);
-  } else {
-    //process file (or standard input)
-    FILE* src;
-    char buf[READBUFFERSIZE];
-    size_t buflen;
-    if (!srcfile) {
-      src = stdin;
-    } else {
-      if ((src = fopen(srcfile, "rb")) == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", srcfile);
-        multifinder_free(finder);
-        return 4;
-      }
+    count += multifinder_process_mapped(finder, srctext, strlen(srctext), threads);
+  } else if (paths.count > 0) {
+    //process files and directories using a pool of threads
+    if (multifinder_count_files(finder, (const char* const*)paths.paths, paths.count, threads, patterncounts, (showfiles ? showfile : showerror), &fileerrors, &count) != 0) {
+      fprintf(stderr, "Memory allocation error\n");
+      multifinder_free(finder);
+      return 3;
     }
-    while ((buflen = fread(buf, 1, READBUFFERSIZE, src)) > 0) {
-      count += multifinder_process(finder, buf, buflen);
+  } else {
+    //process file (or standard input), memory mapped if possible
+    size_t filecount;
+    if (multifinder_process_file(finder, srcfile, threads, &filecount) != 0) {
+      fprintf(stderr, "Error reading file: %s\n", (srcfile ? srcfile : "standard input"));
+      multifinder_free(finder);
+      return 4;
     }
-    count += multifinder_finalize(finder);
-    fclose(src);
+    count += filecount;
   }
   //show results
   printf("%lu matches found\n", (unsigned long)count);
@@ -156,7 +379,13 @@ int main (int argc, char** argv)
       printf("pattern %lu found %lu times\n", (unsigned long)i + 1, (unsigned long)patterncounts[i]);
   }
   //clean up
+  {
+    size_t i;
+    for (i = 0; i < paths.count; i++)
+      free(paths.paths[i]);
+    free(paths.paths);
+  }
   free(patterncounts);
   multifinder_free(finder);
-  return 0;
+  return (fileerrors > 0 ? 4 : 0);
 }
@@ -4,24 +4,105 @@
 #include <string.h>
 #include "multifinder.h"
 
-#define READBUFFERSIZE 128
+#define OUTPUTBUFFERSIZE 65536
 
-int whenfound (const char* data, size_t datalen, void* patterncallbackdata, void* callbackdata)
+int writeoutput (const multifinder_segment* segments, size_t count, void* callbackdata)
 {
-  fprintf(*(FILE**)callbackdata, "%s", (char*)patterncallbackdata);
+  size_t i;
+  for (i = 0; i < count; i++) {
+    if (fwrite(segments[i].data, 1, segments[i].datalen, *(FILE**)callbackdata) != segments[i].datalen)
+      return 1;
+  }
   return 0;
 }
 
-void flushsearchdata (const char* data, size_t datalen, void* callbackdata)
+//add patterns and replacements from a file in which they alternate (separated by NULL bytes if the file contains any, otherwise by newlines), returns the file data the replacements point to or NULL on error
+char* add_patterns_from_file (multifinder finder, const char* filename, int flags, multifinder_segment** preplacements)
 {
-  if (datalen)
-    fprintf(*(FILE**)callbackdata, "%.*s", (int)datalen, data);
+  FILE* src;
+  char* data = NULL;
+  size_t datalen = 0;
+  size_t datasize = 0;
+  size_t len;
+  const char** patterns = NULL;
+  size_t* patternlens = NULL;
+  multifinder_segment* replacements = NULL;
+  void** replacementpointers = NULL;
+  size_t count = 0;
+  size_t i;
+  size_t start;
+  char separator;
+  int entry = 0;
+  int error = 0;
+  //read whole file
+  if ((src = fopen(filename, "rb")) == NULL)
+    return NULL;
+  for (;;) {
+    if (datalen + 1 >= datasize) {
+      char* newdata;
+      datasize = (datasize ? datasize * 2 : 65536);
+      if ((newdata = (char*)realloc(data, datasize)) == NULL) {
+        error = 1;
+        break;
+      }
+      data = newdata;
+    }
+    if ((len = fread(data + datalen, 1, datasize - datalen - 1, src)) == 0)
+      break;
+    datalen += len;
+  }
+  fclose(src);
+  if (error) {
+    free(data);
+    return NULL;
+  }
+  //ignore separator at end of file
+  separator = (memchr(data, 0, datalen) ? '\0' : '\n');
+  if (datalen > 0 && data[datalen - 1] == separator)
+    datalen--;
+  data[datalen] = 0;
+  //split entries (each pattern or replacement is terminated in place)
+  if ((patterns = (const char**)malloc((datalen / 2 + 1) * sizeof(char*))) == NULL || (patternlens = (size_t*)malloc((datalen / 2 + 1) * sizeof(size_t))) == NULL || (replacements = (multifinder_segment*)malloc((datalen / 2 + 1) * sizeof(multifinder_segment))) == NULL || (replacementpointers = (void**)malloc((datalen / 2 + 1) * sizeof(void*))) == NULL)
+    error = 1;
+  start = 0;
+  for (i = 0; !error && i <= datalen; i++) {
+    if (i == datalen || data[i] == separator) {
+      len = i - start;
+      if (separator == '\n' && len > 0 && data[start + len - 1] == '\r')
+        len--;
+      data[start + len] = 0;
+      if (!entry) {
+        patterns[count] = data + start;
+        patternlens[count] = len;
+      } else {
+        replacements[count].data = data + start;
+        replacements[count].datalen = len;
+        replacementpointers[count] = replacements + count;
+        count++;
+      }
+      entry = !entry;
+      start = i + 1;
+    }
+  }
+  //each pattern needs a replacement
+  if (!error && (entry || multifinder_add_patterns(finder, patterns, patternlens, count, flags, replacementpointers) != 0))
+    error = 1;
+  free(patterns);
+  free(patternlens);
+  free(replacementpointers);
+  if (error) {
+    free(replacements);
+    free(data);
+    return NULL;
+  }
+  *preplacements = replacements;
+  return data;
 }
 
 void show_help()
 {
   printf(
-    "Usage:  multifinder_replace [-?|-h] [-c] [-i] [-f file] [-t text] [-p <pattern> <replacement>] <pattern> <replacement> ...\n" \
+    "Usage:  multifinder_replace [-?|-h] [-c] [-i] [-f file] [-t text] [-j threads] [-F file] [-p <pattern> <replacement>] <pattern> <replacement> ...\n" \
     "Parameters:\n" \
     "  -? | -h     \tshow help\n" \
     "  -c          \tcase sensitive matching for next pattern(s) (default)\n" \
@@ -30,6 +111,8 @@ void show_help()
     "  -o file     \toutput file (default is to use standard output)\n" \
     "  -v          \tprint number of replacements done\n" \
     "  -t text     \tuse text as search data (overrides -f)\n" \
+    "  -j threads  \tnumber of threads used to scan large input (0 = all processors, default is 1)\n" \
+    "  -F file     \tfile with patterns and replacements to search for (on alternating lines or separated by NULL bytes, can only be given once)\n" \
     "  -p          \tnext 2 parameters are pattern and replacement (can be used if pattern or replacement starts with \"-\")\n" \
     "  pattern     \tpattern to search for\n" \
     "  replacement \treplacement to replace pattern with\n" \
@@ -47,9 +130,15 @@ int main (int argc, char** argv)
   const char* srcfile = NULL;
   const char* dstfile = NULL;
   const char* srctext = NULL;
+  unsigned int threads = 1;
   size_t count = 0;
-  //initialize
-  if ((finder = multifinder_create(whenfound, flushsearchdata, &dst)) == NULL) {
+  int status = 0;
+  char* patternfiledata = NULL;
+  multifinder_segment* patternfilereplacements = NULL;
+  multifinder_segment* replacements;
+  size_t replacementcount = 0;
+  //initialize (each pattern's callback data points to its replacement)
+  if ((finder = multifinder_create(NULL, NULL, &dst)) == NULL || (replacements = (multifinder_segment*)malloc(argc * sizeof(multifinder_segment))) == NULL) {
     fprintf(stderr, "Error in multifinder_create()\n");
     return 2;
   }
@@ -82,15 +171,26 @@ int main (int argc, char** argv)
               flags = MULTIFIND_PATTERN_CASE_INSENSITIVE;
             break;
           case 'f' :
-            if (argv[i][2])
-              param = argv[i] + 2;
-            else if (i + 1 < argc && argv[i + 1])
-              param = argv[++i];
-            if (!param)
-              paramerror++;
-            else
-              srcfile = param;
-            break;
+            {
+              //-F is pattern file, -f is input file
+              int patternfile = (argv[i][1] == 'F');
+              if (argv[i][2])
+                param = argv[i] + 2;
+              else if (i + 1 < argc && argv[i + 1])
+                param = argv[++i];
+              //only one pattern file can be given
+              if (!param || (patternfile && patternfiledata))
+                paramerror++;
+              else if (patternfile) {
+                if ((patternfiledata = add_patterns_from_file(finder, param, flags, &patternfilereplacements)) == NULL) {
+                  fprintf(stderr, "Error reading pattern file: %s\n", param);
+                  multifinder_free(finder);
+                  return 5;
+                }
+              } else
+                srcfile = param;
+              break;
+            }
           case 'o' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -117,6 +217,16 @@ int main (int argc, char** argv)
             else
               srctext = param;
             break;
+          case 'j' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              threads = strtoul(param, NULL, 10);
+            break;
           case 'p' :
             {
               const char* param2 = NULL;
@@ -126,10 +236,13 @@ int main (int argc, char** argv)
                 param = argv[++i];
                 param2 = argv[++i];
               }
-              if (!param || !param2)
+              if (!param || !param2) {
                 paramerror++;
-              else
-                multifinder_add_pattern(finder, param, flags, (char*)param2);
+              } else {
+                replacements[replacementcount].data = param2;
+                replacements[replacementcount].datalen = strlen(param2);
+                multifinder_add_pattern(finder, param, flags, replacements + replacementcount++);
+              }
               break;
             }
           default :
@@ -137,7 +250,9 @@ int main (int argc, char** argv)
             break;
         }
       } else if (i + 1 < argc) {
-        multifinder_add_pattern(finder, argv[i], flags, argv[i + 1]);
+        replacements[replacementcount].data = argv[i + 1];
+        replacements[replacementcount].datalen = strlen(argv[i + 1]);
+        multifinder_add_pattern(finder, argv[i], flags, replacements + replacementcount++);
         i++;
       } else {
         paramerror++;
@@ -157,36 +272,36 @@ int main (int argc, char** argv)
   else
     dst = fopen(dstfile, "wb");
   if (dst == NULL) {
-    fprintf(stderr, "Error opening output file: %s\n", srcfile);
+    fprintf(stderr, "Error opening output file: %s\n", dstfile);
     multifinder_free(finder);
     return 3;
   }
   if (srctext) {
-    //process supplied text
-    count += multifinder_process(finder, srctext, strlen(srctext));
-    count += multifinder_finalize(finder);
+    //process supplied text, collecting the output in a buffer
+    char outputbuffer[OUTPUTBUFFERSIZE];
+    multifinder_set_replace_buffer(finder, NULL, 0, outputbuffer, OUTPUTBUFFERSIZE, writeoutput);
+    count += multifinder_process_mapped(finder, srctext, strlen(srctext), threads);
+    multifinder_set_replace_buffer(finder, NULL, 0, NULL, 0, NULL);
+    //the search is aborted when writing fails
+    if (multifinder_aborted(finder))
+      status = -2;
   } else {
-    //process file (or standard input)
-    FILE* src;
-    char buf[READBUFFERSIZE];
-    size_t buflen;
-    if (!srcfile) {
-      src = stdin;
-    } else {
-      if ((src = fopen(srcfile, "rb")) == NULL) {
-        fprintf(stderr, "Error opening input file: %s\n", srcfile);
-        multifinder_free(finder);
-        return 4;
-      }
-    }
-    while ((buflen = fread(buf, 1, READBUFFERSIZE, src)) > 0) {
-      count += multifinder_process(finder, buf, buflen);
-    }
-    count += multifinder_finalize(finder);
-    fclose(src);
+    //process file (or standard input), memory mapped if possible, with the output copied into large blocks that are written by a separate thread
+    size_t filecount;
+    if ((status = multifinder_replace_stream(finder, NULL, 0, srcfile, dst, threads, &filecount)) == 0)
+      count += filecount;
+  }
+  //buffered output is written when the file is closed
+  if ((dst != stdout ? fclose(dst) : fflush(dst)) != 0 && status == 0)
+    status = -2;
+  if (status != 0) {
+    if (status == -2)
+      fprintf(stderr, "Error writing output file: %s\n", (dstfile ? dstfile : "standard output"));
+    else
+      fprintf(stderr, "Error reading input file: %s\n", (srcfile ? srcfile : "standard input"));
+    multifinder_free(finder);
+    return 4;
   }
-  if (dst != stdout)
-    fclose(dst);
   //show results
   if (verbose) {
     if (dst == stdout)
@@ -195,5 +310,8 @@ int main (int argc, char** argv)
   }
   //clean up
   multifinder_free(finder);
+  free(replacements);
+  free(patternfilereplacements);
+  free(patternfiledata);
   return 0;
 }